@@ -0,0 +1,186 @@
+/**
+ * Copyright (C) 2026 Genome Research Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @file arena.c
+ * @author Keith James <kdj@sanger.ac.uk>
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+
+#include <jansson.h>
+
+#include "arena.h"
+#include "config.h"
+
+// Allocations are aligned to this many bytes, enough for any type
+#define ARENA_ALIGNMENT 16
+
+// The header preceding each allocation made by the Jansson allocation
+// functions, recording whether it belongs to an arena. Its size is a
+// multiple of the alignment, so that the memory following it is
+// aligned.
+typedef union alloc_header {
+    arena_t *arena;
+    char align[ARENA_ALIGNMENT];
+} alloc_header_t;
+
+static pthread_key_t thread_arena_key;
+static pthread_once_t thread_arena_once = PTHREAD_ONCE_INIT;
+static int installed = 0;
+
+static size_t align_size(const size_t size) {
+    return (size + ARENA_ALIGNMENT - 1) & ~((size_t) ARENA_ALIGNMENT - 1);
+}
+
+static arena_block_t *make_block(const size_t size) {
+    arena_block_t *block = malloc(sizeof (arena_block_t) + size);
+    if (!block) return NULL;
+
+    block->next = NULL;
+    block->size = size;
+    block->used = 0;
+
+    return block;
+}
+
+void init_arena(arena_t *arena, const size_t block_size) {
+    arena->blocks     = NULL;
+    arena->block_size = align_size(block_size);
+}
+
+void *arena_alloc(arena_t *arena, size_t size) {
+    size = align_size(size > 0 ? size : 1);
+
+    arena_block_t *block = arena->blocks;
+    if (block && block->size - block->used >= size) {
+        void *ptr = block->data + block->used;
+        block->used += size;
+        return ptr;
+    }
+
+    if (size > arena->block_size) {
+        // A large allocation has a block of its own, placed behind the
+        // current block so that the space left in that is not wasted
+        arena_block_t *large = make_block(size);
+        if (!large) return NULL;
+
+        large->used = size;
+        if (block) {
+            large->next = block->next;
+            block->next = large;
+        }
+        else {
+            arena->blocks = large;
+        }
+
+        return large->data;
+    }
+
+    block = make_block(arena->block_size);
+    if (!block) return NULL;
+
+    block->next   = arena->blocks;
+    block->used   = size;
+    arena->blocks = block;
+
+    return block->data;
+}
+
+void reset_arena(arena_t *arena) {
+    arena_block_t *keep = NULL;
+    arena_block_t *block = arena->blocks;
+
+    while (block) {
+        arena_block_t *next = block->next;
+        if (!keep && block->size == arena->block_size) {
+            keep = block;
+            keep->next = NULL;
+            keep->used = 0;
+        }
+        else {
+            free(block);
+        }
+        block = next;
+    }
+
+    arena->blocks = keep;
+}
+
+void free_arena(arena_t *arena) {
+    arena_block_t *block = arena->blocks;
+    while (block) {
+        arena_block_t *next = block->next;
+        free(block);
+        block = next;
+    }
+
+    arena->blocks = NULL;
+}
+
+static void *arena_json_malloc(const size_t size) {
+    arena_t *arena = pthread_getspecific(thread_arena_key);
+
+    alloc_header_t *header;
+    if (arena) {
+        header = arena_alloc(arena, sizeof (alloc_header_t) + size);
+    }
+    else {
+        header = malloc(sizeof (alloc_header_t) + size);
+    }
+    if (!header) return NULL;
+
+    header->arena = arena;
+
+    return header + 1;
+}
+
+static void arena_json_free(void *ptr) {
+    if (!ptr) return;
+
+    alloc_header_t *header = (alloc_header_t *) ptr - 1;
+
+    // Memory from an arena is released when the arena is reset
+    if (!header->arena) free(header);
+}
+
+static void make_thread_arena_key(void) {
+    pthread_key_create(&thread_arena_key, NULL);
+}
+
+void install_arena_allocator(void) {
+    pthread_once(&thread_arena_once, make_thread_arena_key);
+    json_set_alloc_funcs(arena_json_malloc, arena_json_free);
+    installed = 1;
+}
+
+int arena_allocator_installed(void) {
+    return installed;
+}
+
+void free_json_string(char *str) {
+    if (installed) arena_json_free(str);
+    else           free(str);
+}
+
+arena_t *set_thread_arena(arena_t *arena) {
+    if (!installed) return NULL;
+
+    arena_t *previous = pthread_getspecific(thread_arena_key);
+    pthread_setspecific(thread_arena_key, arena);
+
+    return previous;
+}
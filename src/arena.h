@@ -0,0 +1,147 @@
+/**
+ * Copyright (C) 2026 Genome Research Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @file arena.h
+ * @author Keith James <kdj@sanger.ac.uk>
+ */
+
+#ifndef _BATON_ARENA_H
+#define _BATON_ARENA_H
+
+#include <stddef.h>
+
+#include "config.h"
+
+/** The default size of an arena block, in bytes */
+#define DEFAULT_ARENA_BLOCK_SIZE (64 * 1024)
+
+/**
+ *  @struct arena_block
+ *  @brief A block of memory from which an arena allocates.
+ */
+typedef struct arena_block {
+    /** The next block in the arena, or NULL. */
+    struct arena_block *next;
+    /** The capacity of the block, in bytes. */
+    size_t size;
+    /** The number of bytes allocated from the block. */
+    size_t used;
+    /** Unused, pads the header so that the memory is aligned. */
+    size_t padding;
+    /** The memory of the block. */
+    char data[];
+} arena_block_t;
+
+/**
+ *  @struct arena
+ *  @brief A bump-pointer allocator. Memory allocated from an arena is
+ *  not freed individually, but all at once when the arena is reset.
+ */
+typedef struct arena {
+    /** The block currently allocated from, followed by any others. */
+    arena_block_t *blocks;
+    /** The size of a standard block, in bytes. */
+    size_t block_size;
+} arena_t;
+
+/**
+ * Initialise an arena. No memory is allocated until it is needed.
+ *
+ * @param[out] arena        The arena.
+ * @param[in]  block_size   The size of each block of memory, in bytes.
+ */
+void init_arena(arena_t *arena, size_t block_size);
+
+/**
+ * Allocate memory from an arena, suitably aligned for any type.
+ * Allocations larger than the block size are given a block of their
+ * own.
+ *
+ * @param[in,out] arena     The arena.
+ * @param[in]     size      The number of bytes to allocate.
+ *
+ * @return A pointer to the memory, or NULL on failure.
+ */
+void *arena_alloc(arena_t *arena, size_t size);
+
+/**
+ * Release all memory allocated from an arena, keeping one standard
+ * block for reuse.
+ *
+ * @param[in,out] arena     The arena.
+ */
+void reset_arena(arena_t *arena);
+
+/**
+ * Free all memory held by an arena.
+ *
+ * @param[in,out] arena     The arena.
+ */
+void free_arena(arena_t *arena);
+
+/**
+ * Install allocation functions for Jansson that allocate from the
+ * calling thread's current arena, if it has one, otherwise with
+ * malloc. Freeing memory allocated from an arena has no effect; it is
+ * released when the arena is reset.
+ *
+ * Must be called before any JSON is created by the process, because
+ * JSON allocated by other means cannot be freed afterwards.
+ *
+ * The allocation functions apply to all JSON created by the process,
+ * not only to that of the item being processed. JSON that must outlive
+ * the current arena, such as JSON held in a process-wide cache or
+ * shared with other threads, must be created, copied and inserted with
+ * the thread's arena cleared, so that it is allocated with malloc:
+ *
+ *     arena_t *previous = set_thread_arena(NULL);
+ *     ... create the JSON and store it ...
+ *     set_thread_arena(previous);
+ *
+ * Otherwise the JSON refers to memory that is reused once the arena is
+ * reset. Memory that baton allocates other than through Jansson is not
+ * allocated from arenas.
+ */
+void install_arena_allocator(void);
+
+/**
+ * Return true if install_arena_allocator has been called.
+ */
+int arena_allocator_installed(void);
+
+/**
+ * Free a string allocated by Jansson, such as one returned by
+ * json_dumps. Once the arena allocator is installed, such strings must
+ * not be passed to free().
+ *
+ * @param[in] str           The string, or NULL.
+ */
+void free_json_string(char *str);
+
+/**
+ * Set the current arena of the calling thread. JSON created by the
+ * thread is allocated from it until the current arena is changed.
+ * Has no effect unless the arena allocator is installed. Clear the
+ * current arena, and restore it afterwards, to create JSON that
+ * outlives it (see install_arena_allocator).
+ *
+ * @param[in] arena         The arena, or NULL to allocate with malloc.
+ *
+ * @return The previous current arena, or NULL.
+ */
+arena_t *set_thread_arena(arena_t *arena);
+
+#endif // _BATON_ARENA_H
@@ -1,6 +1,6 @@
 /**
- * Copyright (C) 2017, 2018, 2019, 2021, 2025 Genome Research Ltd. All
- * rights reserved.
+ * Copyright (C) 2017, 2018, 2019, 2021, 2025, 2026 Genome Research Ltd.
+ * All rights reserved.
  *
  * This program is free software: you can redistribute it and/or modify
  * it under the terms of the GNU General Public License as published by
@@ -25,15 +25,24 @@
 #include <getopt.h>
 
 #include "config.h"
+#include "arena.h"
 #include "baton.h"
+#include "path_cache.h"
+#include "retry.h"
+#include "shard.h"
 
+static int adaptive_flag       = 0;
+static int adaptive_page_flag  = 0;
+static int arena_flag          = 0;
 static int debug_flag          = 0;
 static int help_flag           = 0;
 static int no_error_flag       = 0;
 static int server_version_flag = 0;
 static int silent_flag         = 0;
 static int single_server_flag  = 0;
+static int stream_flag         = 0;
 static int unbuffered_flag     = 0;
+static int unordered_flag      = 0;
 static int unsafe_flag         = 0;
 static int verbose_flag        = 0;
 static int version_flag        = 0;
@@ -41,43 +50,103 @@ static int wlock_flag          = 0;
 
 static size_t default_buffer_size = 1024 * 64 * 16 * 2;
 
+static const char *rate_limited_ops[] = {
+    JSON_CHMOD_OP, JSON_CHECKSUM_OP, JSON_GET_OP, JSON_LIST_OP,
+    JSON_METAMOD_OP, JSON_METAQUERY_OP, JSON_PUT_OP, JSON_MOVE_OP,
+    JSON_RM_OP, JSON_MKCOLL_OP, JSON_RMCOLL_OP, NULL
+};
+
+static int is_rate_limited_op(const char *name) {
+    for (size_t i = 0; rate_limited_ops[i]; i++) {
+        if (str_equals(name, rate_limited_ops[i], MAX_STR_LEN)) return 1;
+    }
+
+    return 0;
+}
+
 int main(const int argc, char *argv[]) {
     option_flags flags = 0;
     int exit_status    = 0;
     char *zone_name = NULL;
     const char *json_file = NULL;
+    const char *journal_file = NULL;
     FILE *input     = NULL;
     unsigned long max_connect_time = DEFAULT_MAX_CONNECT_TIME;
+    unsigned long num_threads = 1;
+    unsigned long num_shards = 1;
+    unsigned long bulk_threads = 0;
+    unsigned long prefetch_depth = DEFAULT_PREFETCH_DEPTH;
+    unsigned long flush_interval = 0;
+    unsigned long max_retries = DEFAULT_MAX_RETRIES;
+    unsigned long coalesce_window = 0;
+    unsigned long page_size = 0;
+    unsigned long path_cache_ttl = 0;
+    rate_limits_t rate_limits;
+    baton_error_t rate_error;
+
+    init_rate_limits(&rate_limits);
 
     while (1) {
         static struct option long_options[] = {
             // Flag options
+            {"adaptive",       no_argument, &adaptive_flag,       1},
+            {"adaptive-page-size", no_argument, &adaptive_page_flag,  1},
+            {"arena",          no_argument, &arena_flag,          1},
             {"debug",          no_argument, &debug_flag,          1},
             {"help",           no_argument, &help_flag,           1},
             {"no-error",       no_argument, &no_error_flag,       1},
             {"server-version", no_argument, &server_version_flag, 1},
             {"silent",         no_argument, &silent_flag,         1},
             {"single-server",  no_argument, &single_server_flag,  1},
+            {"stream",         no_argument, &stream_flag,         1},
             {"unbuffered",     no_argument, &unbuffered_flag,     1},
+            {"unordered",      no_argument, &unordered_flag,      1},
             {"unsafe",         no_argument, &unsafe_flag,         1},
             {"verbose",        no_argument, &verbose_flag,        1},
             {"version",        no_argument, &version_flag,        1},
             {"wlock",          no_argument, &wlock_flag,          1},
             // Indexed options
+            {"bulk-threads",  required_argument, NULL, 'b'},
+            {"coalesce",      required_argument, NULL, 'C'},
             {"connect-time",  required_argument, NULL, 'c'},
             {"file",          required_argument, NULL, 'f'},
+            {"flush-interval", required_argument, NULL, 'i'},
+            {"journal",       required_argument, NULL, 'j'},
+            {"page-size",     required_argument, NULL, 'P'},
+            {"path-cache",    required_argument, NULL, 'T'},
+            {"prefetch",      required_argument, NULL, 'p'},
+            {"rate",          required_argument, NULL, 'r'},
+            {"retries",       required_argument, NULL, 'R'},
+            {"shards",        required_argument, NULL, 's'},
+            {"threads",       required_argument, NULL, 't'},
             {"zone",          required_argument, NULL, 'z'},
             {0, 0, 0, 0}
         };
 
         int option_index = 0;
-        const int c = getopt_long_only(argc, argv, "c:f:z:",
+        const int c = getopt_long_only(argc, argv, "b:c:C:f:i:j:p:P:r:R:s:t:T:z:",
                                        long_options, &option_index);
 
         /* Detect the end of the options. */
         if (c == -1) break;
 
         switch (c) {
+            case 'b':
+                errno = 0;
+                char *bulk_end_ptr;
+                const unsigned long bulk = strtoul(optarg, &bulk_end_ptr, 10);
+
+                if ((errno == ERANGE && bulk == ULONG_MAX) ||
+                    (errno != 0 && bulk == 0)              ||
+                    bulk_end_ptr == optarg                 ||
+                    bulk == 0 || bulk > MAX_NUM_THREADS) {
+                    fprintf(stderr, "Invalid --bulk-threads '%s'\n", optarg);
+                    exit(1);
+                }
+
+                bulk_threads = bulk;
+                break;
+
             case 'c':
                 errno = 0;
                 char *end_ptr;
@@ -93,10 +162,146 @@ int main(const int argc, char *argv[]) {
                 max_connect_time = val;
                 break;
 
+            case 'C':
+                errno = 0;
+                char *window_end_ptr;
+                const unsigned long window = strtoul(optarg, &window_end_ptr, 10);
+
+                if ((errno == ERANGE && window == ULONG_MAX) ||
+                    (errno != 0 && window == 0)              ||
+                    window_end_ptr == optarg) {
+                    fprintf(stderr, "Invalid --coalesce '%s'\n", optarg);
+                    exit(1);
+                }
+
+                coalesce_window = window;
+                break;
+
             case 'f':
                 json_file = optarg;
                 break;
 
+            case 'i':
+                errno = 0;
+                char *interval_end_ptr;
+                const unsigned long interval = strtoul(optarg, &interval_end_ptr, 10);
+
+                if ((errno == ERANGE && interval == ULONG_MAX) ||
+                    (errno != 0 && interval == 0)              ||
+                    interval_end_ptr == optarg) {
+                    fprintf(stderr, "Invalid --flush-interval '%s'\n", optarg);
+                    exit(1);
+                }
+
+                flush_interval = interval;
+                break;
+
+            case 'j':
+                journal_file = optarg;
+                break;
+
+            case 'p':
+                errno = 0;
+                char *prefetch_end_ptr;
+                const unsigned long prefetch = strtoul(optarg, &prefetch_end_ptr, 10);
+
+                if ((errno == ERANGE && prefetch == ULONG_MAX) ||
+                    (errno != 0 && prefetch == 0)              ||
+                    prefetch_end_ptr == optarg                 ||
+                    prefetch == 0) {
+                    fprintf(stderr, "Invalid --prefetch '%s'\n", optarg);
+                    exit(1);
+                }
+
+                prefetch_depth = prefetch;
+                break;
+
+            case 'P':
+                errno = 0;
+                char *page_end_ptr;
+                const unsigned long page = strtoul(optarg, &page_end_ptr, 10);
+
+                if ((errno == ERANGE && page == ULONG_MAX) ||
+                    (errno != 0 && page == 0)              ||
+                    page_end_ptr == optarg                 ||
+                    page == 0 || page > MAX_SQL_ROWS) {
+                    fprintf(stderr, "Invalid --page-size '%s'\n", optarg);
+                    exit(1);
+                }
+
+                page_size = page;
+                break;
+
+            case 'r':
+                if (add_rate_limit(&rate_limits, optarg, &rate_error) != 0) {
+                    fprintf(stderr, "%s\n", rate_error.message);
+                    exit(1);
+                }
+                break;
+
+            case 'R':
+                errno = 0;
+                char *retries_end_ptr;
+                const unsigned long retries = strtoul(optarg, &retries_end_ptr, 10);
+
+                if ((errno == ERANGE && retries == ULONG_MAX) ||
+                    (errno != 0 && retries == 0)              ||
+                    retries_end_ptr == optarg                 ||
+                    retries > UINT_MAX) {
+                    fprintf(stderr, "Invalid --retries '%s'\n", optarg);
+                    exit(1);
+                }
+
+                max_retries = retries;
+                break;
+
+            case 's':
+                errno = 0;
+                char *shards_end_ptr;
+                const unsigned long shards = strtoul(optarg, &shards_end_ptr, 10);
+
+                if ((errno == ERANGE && shards == ULONG_MAX) ||
+                    (errno != 0 && shards == 0)              ||
+                    shards_end_ptr == optarg                 ||
+                    shards == 0 || shards > MAX_NUM_SHARDS) {
+                    fprintf(stderr, "Invalid --shards '%s'\n", optarg);
+                    exit(1);
+                }
+
+                num_shards = shards;
+                break;
+
+            case 't':
+                errno = 0;
+                char *threads_end_ptr;
+                const unsigned long threads = strtoul(optarg, &threads_end_ptr, 10);
+
+                if ((errno == ERANGE && threads == ULONG_MAX) ||
+                    (errno != 0 && threads == 0)              ||
+                    threads_end_ptr == optarg                 ||
+                    threads == 0 || threads > MAX_NUM_THREADS) {
+                    fprintf(stderr, "Invalid --threads '%s'\n", optarg);
+                    exit(1);
+                }
+
+                num_threads = threads;
+                break;
+
+            case 'T':
+                errno = 0;
+                char *ttl_end_ptr;
+                const unsigned long ttl = strtoul(optarg, &ttl_end_ptr, 10);
+
+                if ((errno == ERANGE && ttl == ULONG_MAX) ||
+                    (errno != 0 && ttl == 0)              ||
+                    ttl_end_ptr == optarg) {
+                    fprintf(stderr, "Invalid --path-cache '%s'\n", optarg);
+                    exit(1);
+                }
+
+                path_cache_ttl = ttl;
+                break;
+
             case 'z':
                 zone_name = optarg;
                 break;
@@ -111,43 +316,129 @@ int main(const int argc, char *argv[]) {
         }
     }
 
-    const char *help =
+    // In parts, each within the length of string literal that C99
+    // compilers are required to support
+    const char *help[] = {
         "Name\n"
         "    baton-do\n"
         "\n"
         "Synopsis\n"
         "\n"
-        "    baton-do [--file <JSON file>] [--connect-time <n>] [--silent]\n"
-        "             [--unbuffered] [--verbose] [--version] [--wlock]\n"
-        "             [--zone]\n"
+        "    baton-do [--adaptive] [--adaptive-page-size] [--arena]\n"
+        "             [--bulk-threads <n>] [--file <JSON file>]\n"
+        "             [--coalesce <ms>] [--connect-time <n>]\n"
+        "             [--flush-interval <ms>] [--journal <file>]\n"
+        "             [--page-size <n>] [--path-cache <s>]\n"
+        "             [--prefetch <n>]\n"
+        "             [--rate <operation>=<n>/<unit>] [--retries <n>]\n"
+        "             [--shards <n>] [--silent] [--stream]\n"
+        "             [--threads <n>] [--unbuffered] [--unordered]\n"
+        "             [--verbose] [--version] [--wlock] [--zone]\n"
         "\n"
         "Description\n"
         "    Performs remote operations as described in the JSON\n"
         "    input file.\n"
         "\n"
+        "    --adaptive       Adapt the number of concurrent operations to\n"
+        "                     server load, up to the number of threads. The\n"
+        "                     number is reduced when iRODS reports connection\n"
+        "                     errors or when operations slow down.\n"
+        "    --adaptive-page-size\n"
+        "                     Adapt the number of rows fetched in each page\n"
+        "                     of a query, starting from --page-size. The\n"
+        "                     number is doubled while pages are fetched\n"
+        "                     quickly and halved when they are slow.\n"
+        "    --arena          Allocate the JSON of each document from an\n"
+        "                     arena that is released in one step once its\n"
+        "                     result has been written.\n"
+        "    --bulk-threads   The maximum number of threads transferring\n"
+        "                     data (get, put and checksum calculation) at\n"
+        "                     once. Other operations are executed first and\n"
+        "                     the remaining threads are kept free for them.\n"
+        "                     Optional, defaults to no limit.\n"
+        "    --coalesce       The maximum time in milliseconds to wait for\n"
+        "                     list operations on data objects in the same\n"
+        "                     collection to be read, so that they may be\n"
+        "                     listed together in one query. Optional,\n"
+        "                     defaults to 0 (no waiting or coalescing).\n"
         "    --connect-time   The duration in seconds after which a connection\n"
-        "                     to iRODS will be refreshed (closed and reopened\n"
-        "                     between JSON documents) to allow iRODS server\n"
-        "                     resources to be released. Optional, defaults to\n"
-        "                     10 minutes.\n"
+        "                     to iRODS will be refreshed (a new connection\n"
+        "                     opened in the background and the old one\n"
+        "                     closed) to allow iRODS server resources to be\n"
+        "                     released. Optional, defaults to 10 minutes.\n"
         "    --file           The JSON file describing the operations.\n"
         "                     Optional, defaults to STDIN.\n"
+        "    --flush-interval The maximum time in milliseconds for which output\n"
+        "                     may be buffered before being written. Optional,\n"
+        "                     defaults to no limit.\n",
+
+        "    --journal        A file in which to record the documents that\n"
+        "                     have been processed. If the file exists, the\n"
+        "                     documents recorded in it are skipped, so that\n"
+        "                     an interrupted run may be resumed with the\n"
+        "                     same input. Optional.\n"
         "    --no-error       Do not return a non-zero exit code on iRODS\n"
         "                     errors. Errors will still be reported in-band\n"
         "                     as JSON responses.\n"
+        "    --page-size      The number of rows to fetch in each page of a\n"
+        "                     query, up to 256. May be overridden by the\n"
+        "                     'page_size' argument of an operation. Optional,\n"
+        "                     defaults to 10.\n"
+        "    --path-cache     The number of seconds for which the type of an\n"
+        "                     iRODS path is remembered after it is looked\n"
+        "                     up, so that later operations on the same path\n"
+        "                     need not look it up again. Paths changed by\n"
+        "                     baton-do are forgotten at once. Optional,\n"
+        "                     defaults to 0 (no caching).\n"
+        "    --prefetch       The maximum number of JSON documents to read\n"
+        "                     and validate ahead of those being processed.\n"
+        "                     Optional, defaults to 64.\n"
+        "    --rate           Limit the rate of an operation, e.g.\n"
+        "                     metaquery=200/s. The unit may be /s, /m or /h.\n"
+        "                     May be given once for each operation.\n"
+        "                     Optional, defaults to no limit.\n"
+        "    --retries        The number of times to retry a list, metaquery,\n"
+        "                     checksum or put operation that fails with a\n"
+        "                     transient error, such as a lost connection.\n"
+        "                     Optional, defaults to 3.\n"
         "    --server-version Print the version of the server and exit.\n"
+        "    --shards         The number of worker processes, each with its\n"
+        "                     own iRODS session and --threads threads.\n"
+        "                     Documents are routed to workers by their\n"
+        "                     collection and results printed as they\n"
+        "                     complete, as for --unordered. Optional,\n"
+        "                     defaults to 1 (no worker processes).\n"
         "    --silent         Silence error messages.\n"
         "    --single-server  Only connect to a single iRODS server\n"
-        "    --unbuffered     Flush print operations for each JSON object.\n"
+        "    --stream         Print the results of metaquery operations one\n"
+        "                     per line as they are fetched, followed by\n"
+        "                     the operation's envelope without a result.\n"
+        "                     Each result carries the 'id' of its input\n"
+        "                     document, as for --unordered. In input order,\n"
+        "                     a query waits for the results of those before\n"
+        "                     it and --bulk-threads is ignored.\n"
+        "    --threads        The number of operations to run concurrently,\n"
+        "                     each on its own iRODS connection. Results are\n"
+        "                     printed in input order. Optional, defaults to 1.\n"
+        "    --unbuffered     Flush output whenever no more is waiting to be\n"
+        "                     written.\n"
+        "    --unordered      Print results as soon as they complete, rather\n"
+        "                     than in input order. Each result carries the\n"
+        "                     'id' of its input document or, if it has none,\n"
+        "                     the document's position in the input.\n"
  
         "    --verbose        Print verbose messages to STDERR.\n"
         "    --version        Print the version number and exit.\n"
         "    --wlock          Enable server-side advisory write locking.\n"
         "                     Optional, defaults to false.\n"
-        "    --zone           The zone to operate within. Optional.\n";
+        "    --zone           The zone to operate within. Optional.\n"
+    };
 
     if (help_flag) {
-        printf("%s\n",help);
+        for (size_t i = 0; i < sizeof help / sizeof help[0]; i++) {
+            fputs(help[i], stdout);
+        }
+        printf("\n");
         exit(0);
     }
 
@@ -170,8 +461,21 @@ int main(const int argc, char *argv[]) {
         exit(0);
     }
 
+    for (size_t i = 0; i < rate_limits.num_buckets; i++) {
+        if (!is_rate_limited_op(rate_limits.buckets[i].name)) {
+            fprintf(stderr, "Invalid --rate operation '%s'\n",
+                    rate_limits.buckets[i].name);
+            exit(1);
+        }
+    }
+
+    if (adaptive_flag)      flags = flags | ADAPTIVE_CONCURRENCY;
+    if (adaptive_page_flag) flags = flags | ADAPTIVE_PAGE_SIZE;
+    if (arena_flag)         flags = flags | ARENA_ALLOC;
     if (single_server_flag) flags = flags | SINGLE_SERVER;
+    if (stream_flag)        flags = flags | STREAM_RESULTS;
     if (unbuffered_flag)    flags = flags | FLUSH;
+    if (unordered_flag)     flags = flags | UNORDERED;
     if (unsafe_flag)        flags = flags | UNSAFE_RESOLVE;
     if (wlock_flag)         flags = flags | WRITE_LOCK;
 
@@ -179,6 +483,18 @@ int main(const int argc, char *argv[]) {
     if (verbose_flag) set_log_threshold(NOTICE);
     if (silent_flag)  set_log_threshold(FATAL);
 
+    if (path_cache_ttl > 0) {
+        baton_error_t cache_error;
+        if (init_path_cache(DEFAULT_PATH_CACHE_SIZE, path_cache_ttl,
+                            &cache_error) != 0) {
+            fprintf(stderr, "%s\n", cache_error.message);
+            exit(1);
+        }
+    }
+
+    // Installed before any JSON is created
+    if (arena_flag) install_arena_allocator();
+
     declare_client_name(argv[0]);
     input = maybe_stdin(json_file);
     if (!input) {
@@ -188,10 +504,32 @@ int main(const int argc, char *argv[]) {
     operation_args_t args = { .flags            = flags,
                               .buffer_size      = default_buffer_size,
                               .zone_name        = zone_name,
-                              .max_connect_time = max_connect_time};
+                              .max_connect_time = max_connect_time,
+                              .num_threads      = num_threads,
+                              .prefetch_depth   = prefetch_depth,
+                              .flush_interval   = flush_interval,
+                              .rate_limits      = &rate_limits,
+                              .max_retries      = max_retries,
+                              .coalesce_window  = coalesce_window,
+                              .journal_path     = journal_file,
+                              .bulk_threads     = bulk_threads,
+                              .page_size        = page_size };
 
-    const int status = do_operation(input, baton_json_dispatch_op, &args);
+    int status;
+    if (num_shards > 1) {
+        if (journal_file) {
+            fprintf(stderr, "--journal may not be used with --shards\n");
+            exit(1);
+        }
+        status = do_sharded_operation(input, baton_json_dispatch_op, &args,
+                                      num_shards);
+    }
+    else {
+        status = do_operation(input, baton_json_dispatch_op, &args);
+    }
     if (input != stdin) fclose(input);
+    free_rate_limits(&rate_limits);
+    free_path_cache();
 
     if (status != 0 && !no_error_flag) exit_status = 5;
 
@@ -1,6 +1,6 @@
 /**
- * Copyright (C) 2013, 2014, 2015, 2017, 2019, 2021, 2025 Genome Research
- * Ltd. All rights reserved.
+ * Copyright (C) 2013, 2014, 2015, 2017, 2019, 2021, 2025, 2026 Genome
+ * Research Ltd. All rights reserved.
  *
  * This program is free software: you can redistribute it and/or modify
  * it under the terms of the GNU General Public License as published by
@@ -29,6 +29,7 @@
 #include "baton.h"
 
 static int acl_flag        = 0;
+static int aggregate_flag  = 0;
 static int avu_flag        = 0;
 static int checksum_flag   = 0;
 static int coll_flag       = 0;
@@ -36,8 +37,10 @@ static int debug_flag      = 0;
 static int help_flag       = 0;
 static int obj_flag        = 0;
 static int replicate_flag  = 0;
+static int server_flag     = 0;
 static int silent_flag     = 0;
 static int size_flag       = 0;
+static int stream_flag     = 0;
 static int timestamp_flag  = 0;
 static int unbuffered_flag = 0;
 static int unsafe_flag     = 0;
@@ -56,6 +59,7 @@ int main(const int argc, char *argv[]) {
         static struct option long_options[] = {
             // Flag options
             {"acl",        no_argument, &acl_flag,        1},
+            {"aggregate",  no_argument, &aggregate_flag,  1},
             {"avu",        no_argument, &avu_flag,        1},
             {"checksum",   no_argument, &checksum_flag,   1},
             {"coll",       no_argument, &coll_flag,       1},
@@ -63,8 +67,10 @@ int main(const int argc, char *argv[]) {
             {"help",       no_argument, &help_flag,       1},
             {"obj",        no_argument, &obj_flag,        1},
             {"replicate",  no_argument, &replicate_flag,  1},
+            {"server-aggregate", no_argument, &server_flag, 1},
             {"silent",     no_argument, &silent_flag,     1},
             {"size",       no_argument, &size_flag,       1},
+            {"stream",     no_argument, &stream_flag,     1},
             {"timestamp",  no_argument, &timestamp_flag,  1},
             {"unbuffered", no_argument, &unbuffered_flag, 1},
             {"unsafe",     no_argument, &unsafe_flag,     1},
@@ -127,8 +133,11 @@ int main(const int argc, char *argv[]) {
 
     if (unsafe_flag)     flags = flags | UNSAFE_RESOLVE;
     if (unbuffered_flag) flags = flags | FLUSH;
+    if (stream_flag)     flags = flags | STREAM_RESULTS;
 
     if (acl_flag)        flags = flags | PRINT_ACL;
+    if (aggregate_flag)  flags = flags | AGGREGATE_RESULTS;
+    if (server_flag)     flags = flags | AGGREGATE_RESULTS | SERVER_AGGREGATE;
     if (avu_flag)        flags = flags | PRINT_AVU;
     if (checksum_flag)   flags = flags | PRINT_CHECKSUM;
     if (replicate_flag)  flags = flags | PRINT_REPLICATE;
@@ -141,17 +150,25 @@ int main(const int argc, char *argv[]) {
         "\n"
         "Synopsis\n"
         "\n"
-        "    baton-metaquery [--acl] [--avu] [--checksum] [--coll]\n"
-        "                    [--connect-time <n>] [--file <JSON file>]\n"
-        "                    [--obj ] [--replicate] [--silent] [--size]\n"
-        "                    [--timestamp] [--unbuffered] [--unsafe]\n"
-        "                    [--verbose] [--version] [--zone <name>]\n"
+        "    baton-metaquery [--acl] [--aggregate] [--avu] [--checksum]\n"
+        "                    [--coll] [--connect-time <n>]\n"
+        "                    [--file <JSON file>] [--obj ] [--replicate]\n"
+        "                    [--server-aggregate] [--silent] [--size]\n"
+        "                    [--stream] [--timestamp]\n"
+        "                    [--unbuffered] [--unsafe] [--verbose]\n"
+        "                    [--version] [--zone <name>]\n"
         "\n"
         "Description\n"
         "    Finds items in iRODS by AVU, given a query constructed\n"
         "from a JSON input file.\n"
         "\n"
         "  --acl          Print access control lists in output.\n"
+        "  --aggregate    Print the number of matching items and the total,\n"
+        "                 minimum and maximum size of the matching data\n"
+        "                 objects, instead of the items. The server still\n"
+        "                 sends one row (an ID and a size) for each\n"
+        "                 matching item, which baton totals, so the time\n"
+        "                 taken grows with the number of matches.\n"
         "  --avu          Print AVU lists in output.\n"
         "  --checksum     Print data object checksums in output.\n"
         "  --connect-time The duration in seconds after which a connection\n"
@@ -164,7 +181,18 @@ int main(const int argc, char *argv[]) {
         "                 defaults to STDIN.\n"
         "  --obj          Limit search to data object metadata only.\n"
         "  --replicate    Report data object replicates.\n"
+        "  --server-aggregate\n"
+        "                 Print aggregates computed by the server in a\n"
+        "                 single row, as match_count, match_total_size,\n"
+        "                 match_min_size and match_max_size. These count\n"
+        "                 the rows matched, not items: an item is counted\n"
+        "                 once for each combination of its AVUs that\n"
+        "                 matches, and only the first replicate (number 0)\n"
+        "                 of each data object is included.\n"
         "  --silent       Silence error messages.\n"
+        "  --stream       Print each result on its own line as soon as\n"
+        "                 it has been fetched, tagged with the 'id'\n"
+        "                 of its query.\n"
         "  --timestamp    Print timestamps in output.\n"
         "  --unbuffered   Flush print operations for each JSON object.\n"
         "  --unsafe       Permit unsafe relative iRODS paths.\n"
@@ -1,6 +1,6 @@
 /**
- * Copyright (C) 2013, 2014, 2015, 2016, 2017, 2020, 2023, 2025 Genome
- * Research Ltd. All rights reserved.
+ * Copyright (C) 2013, 2014, 2015, 2016, 2017, 2020, 2023, 2025, 2026
+ * Genome Research Ltd. All rights reserved.
  *
  * This program is free software: you can redistribute it and/or modify
  * it under the terms of the GNU General Public License as published by
@@ -23,6 +23,7 @@
 #include <errno.h>
 #include <libgen.h>
 #include <math.h>
+#include <pthread.h>
 #include <regex.h>
 #include <signal.h>
 #include <stdarg.h>
@@ -31,7 +32,9 @@
 #include <string.h>
 
 #include "config.h"
+#include "arena.h"
 #include "baton.h"
+#include "path_cache.h"
 #include "signal_handler.h"
 
 static const char *metadata_op_name(const metadata_op op) {
@@ -141,10 +144,19 @@ char* get_client_version() {
     return version;
 }
 
+// The server version regex is compiled once and held for the lifetime
+// of the process
+static const char *ver_re_str = "([0-9]+\\.[0-9]+\\.[0-9]+)$";
+static regex_t ver_re;
+static int ver_re_status = 0;
+static pthread_once_t ver_re_once = PTHREAD_ONCE_INIT;
+
+static void compile_ver_re(void) {
+    ver_re_status = regcomp(&ver_re, ver_re_str, REG_EXTENDED | REG_ICASE);
+}
+
 char* get_server_version(rcComm_t *conn, baton_error_t *error) {
-    const char *ver_re_str = "([0-9]+\\.[0-9]+\\.[0-9]+)$";
     const int ver_re_idx = 0;
-    regex_t ver_re;
     regmatch_t ver_match[ver_re_idx + 1];
 
     char re_msg[MAX_ERROR_MESSAGE_LEN];
@@ -154,7 +166,8 @@ char* get_server_version(rcComm_t *conn, baton_error_t *error) {
 
     init_baton_error(error);
 
-    int re_status = regcomp(&ver_re, ver_re_str, REG_EXTENDED | REG_ICASE);
+    pthread_once(&ver_re_once, compile_ver_re);
+    int re_status = ver_re_status;
     if (re_status != 0) {
         regerror(re_status, &ver_re, re_msg, MAX_ERROR_MESSAGE_LEN);
         set_baton_error(error, re_status, "Could not compile regex: '%s': %s",
@@ -195,7 +208,6 @@ char* get_server_version(rcComm_t *conn, baton_error_t *error) {
     return version;
 
 error:
-    regfree(&ver_re);
     if (version) free(version);
     return NULL;
 }
@@ -289,6 +301,9 @@ int resolve_rods_path(rcComm_t *conn, rodsEnv *env, rodsPath_t *rods_path,
         goto error;
     }
 
+    if (get_cached_path(rods_path)) return rods_path->objState;
+
+    const unsigned long generation = path_cache_generation();
     status = getRodsObjType(conn, rods_path);
     if (status < 0) {
         char *err_subname;
@@ -299,6 +314,8 @@ int resolve_rods_path(rcComm_t *conn, rodsEnv *env, rodsPath_t *rods_path,
         goto error;
     }
 
+    cache_path(rods_path, generation);
+
     return status;
 
 error:
@@ -322,14 +339,22 @@ int set_rods_path(rcComm_t *conn, rodsPath_t *rods_path, char *path,
         goto error;
     }
 
-    status = getRodsObjType(conn, rods_path);
-    if (status < 0) {
-        char *err_subname;
-        const char *err_name = rodsErrorName(status, &err_subname);
-        set_baton_error(error, status,
-                        "Failed to get the type of iRODS path '%s': %d %s",
-                        rods_path->inPath, status, err_name);
-        goto error;
+    if (get_cached_path(rods_path)) {
+        status = rods_path->objState;
+    }
+    else {
+        const unsigned long generation = path_cache_generation();
+        status = getRodsObjType(conn, rods_path);
+        if (status < 0) {
+            char *err_subname;
+            const char *err_name = rodsErrorName(status, &err_subname);
+            set_baton_error(error, status,
+                            "Failed to get the type of iRODS path '%s': %d %s",
+                            rods_path->inPath, status, err_name);
+            goto error;
+        }
+
+        cache_path(rods_path, generation);
     }
 
     if (status != EXIST_ST) {
@@ -344,6 +369,34 @@ error:
     return error->code;
 }
 
+int set_trusted_rods_path(rodsPath_t *rods_path, char *path,
+                          const int obj_type, baton_error_t *error) {
+    init_baton_error(error);
+
+    int status = init_rods_path(rods_path, path);
+    if (status < 0) {
+        set_baton_error(error, status,
+                        "Failed to create iRODS path '%s'", path);
+        goto error;
+    }
+
+    char *dest = rstrcpy(rods_path->outPath, path, MAX_NAME_LEN);
+    if (!dest) {
+        set_baton_error(error, USER_PATH_EXCEEDS_MAX,
+                        "iRODS path '%s' is too long (exceeds %d",
+                        path, MAX_NAME_LEN);
+        goto error;
+    }
+
+    rods_path->objType  = obj_type;
+    rods_path->objState = EXIST_ST;
+
+    return error->code;
+
+error:
+    return error->code;
+}
+
 int move_rods_path(rcComm_t *conn, rodsPath_t *rods_path, char *new_path,
                    baton_error_t *error) {
     dataObjCopyInp_t obj_rename_in;
@@ -397,6 +450,15 @@ int move_rods_path(rcComm_t *conn, rodsPath_t *rods_path, char *new_path,
     }
 
     const int status = rcDataObjRename(conn, &obj_rename_in);
+    if (rods_path->objType == COLL_OBJ_T) {
+        uncache_collection(rods_path->outPath);
+        uncache_collection(new_path);
+    }
+    else {
+        uncache_path(rods_path->outPath);
+        uncache_path(new_path);
+    }
+
     if (status < 0) {
         char *err_subname;
         const char *err_name = rodsErrorName(status, &err_subname);
@@ -455,13 +517,283 @@ finally:
     return error->code;
 }
 
-json_t *search_metadata(rcComm_t *conn, json_t *query, char *zone_name,
-                        const option_flags flags, baton_error_t *error) {
-    json_t *results      = NULL;
-    json_t *collections  = NULL;
-    json_t *data_objects = NULL;
-    int status;
+typedef struct metadata_visit {
+    rcComm_t *conn;
+    option_flags flags;
+    query_visitor visit;
+    void *data;
+    size_t num_rows;
+} metadata_visit_t;
+
+// Add the details requested by the flags to a page of search results
+// and pass it to the caller's visitor
+static int enrich_rows(json_t *rows, void *data, baton_error_t *error) {
+    metadata_visit_t *mv = data;
+
+    init_baton_error(error);
+
+    mv->num_rows += json_array_size(rows);
+
+    if (mv->flags & PRINT_ACL) {
+        add_acl_json_array(mv->conn, rows, error);
+        if (error->code != 0) goto finally;
+    }
+    if (mv->flags & PRINT_AVU) {
+        add_avus_json_array(mv->conn, rows, error);
+        if (error->code != 0) goto finally;
+    }
+    if (mv->flags & PRINT_CHECKSUM) {
+        add_checksum_json_array(mv->conn, rows, error);
+        if (error->code != 0) goto finally;
+    }
+    if (mv->flags & PRINT_TIMESTAMP) {
+        add_tps_json_array(mv->conn, rows, error);
+        if (error->code != 0) goto finally;
+    }
+    if (mv->flags & PRINT_REPLICATE) {
+        add_repl_json_array(mv->conn, rows, error);
+        if (error->code != 0) goto finally;
+    }
+
+    mv->visit(rows, mv->data, error);
+
+finally:
+    return error->code;
+}
+
+// Return the integer value of an aggregate query result, or 0 if the
+// aggregate is empty
+static json_int_t aggregate_value(const json_t *row, const char *key) {
+    const char *value = json_string_value(json_object_get(row, key));
+    if (!value) return 0;
+
+    return strtoll(value, NULL, 10);
+}
+
+// The number and sizes of the data objects matching a search
+typedef struct object_aggregate {
+    json_int_t count;
+    json_int_t total_size;
+    json_int_t min_size;
+    json_int_t max_size;
+} object_aggregate_t;
+
+// A query visitor that adds a page of rows, one per data object, to
+// an object_aggregate_t
+static int aggregate_object_rows(json_t *rows, void *data,
+                                 baton_error_t *error) {
+    object_aggregate_t *agg = data;
+
+    init_baton_error(error);
+
+    size_t index;
+    json_t *row;
+    json_array_foreach(rows, index, row) {
+        const json_int_t size = aggregate_value(row, JSON_SIZE_KEY);
+
+        if (agg->count == 0 || size < agg->min_size) agg->min_size = size;
+        if (agg->count == 0 || size > agg->max_size) agg->max_size = size;
+        agg->total_size += size;
+        agg->count++;
+    }
+
+    return error->code;
+}
+
+// A query visitor that adds the number of rows in a page to a count
+static int count_rows(json_t *rows, void *data, baton_error_t *error) {
+    json_int_t *count = data;
+
+    init_baton_error(error);
+    *count += json_array_size(rows);
+
+    return error->code;
+}
+
+// Search metadata, computing the aggregates exactly. Collections and
+// data objects are grouped by the server into one row each, by their
+// ID, so that each is counted once however many of its AVUs match. A
+// data object row carries the size of its good replicates, so that an
+// object with several replicates is also sized once. GenQuery cannot
+// aggregate over one replicate per object, so these rows, one per
+// matching item, are transferred and totalled here, in pages of
+// MAX_SQL_ROWS, without any details of the items.
+static int aggregate_metadata_exact(rcComm_t *conn, json_t *query,
+                                    char *zone_name, const option_flags flags,
+                                    json_int_t *count,
+                                    object_aggregate_t *agg,
+                                    baton_error_t *error) {
+    query_format_in_t col_format =
+        { .num_columns = 1,
+          .columns     = { COL_COLL_ID },
+          .labels      = { JSON_ID_KEY } };
+
+    // Selecting the data object ID without a modifier groups the rows
+    // by data object. Good replicates have the same size, so any one
+    // of them gives the size of the object.
+    query_format_in_t obj_format =
+        { .num_columns = 2,
+          .columns     = { COL_D_DATA_ID, COL_DATA_SIZE },
+          .labels      = { JSON_ID_KEY, JSON_SIZE_KEY },
+          .modifiers   = { 0, SELECT_MAX },
+          .good_repl   = 1 };
+
+    const size_t page_size = get_query_page_size();
+    const int adaptive     = is_adaptive_page_size();
+
+    init_baton_error(error);
+
+    // Only IDs and sizes are fetched, so take the largest pages
+    set_query_page_size(MAX_SQL_ROWS, 0);
+
+    if (flags & SEARCH_COLLECTIONS) {
+        logmsg(DEBUG, "Counting collections ...");
+        visit_search(conn, zone_name, query, &col_format,
+                     prepare_col_avu_search, prepare_col_acl_search,
+                     prepare_col_cre_search, prepare_col_mod_search,
+                     0, count_rows, count, error);
+        if (error->code != 0) goto finally;
+    }
+
+    if (flags & SEARCH_OBJECTS) {
+        logmsg(DEBUG, "Counting data objects ...");
+        visit_search(conn, zone_name, query, &obj_format,
+                     prepare_obj_avu_search, prepare_obj_acl_search,
+                     prepare_obj_cre_search, prepare_obj_mod_search,
+                     0, aggregate_object_rows, agg, error);
+        if (error->code != 0) goto finally;
+
+        *count += agg->count;
+    }
+
+finally:
+    set_query_page_size(page_size, adaptive);
+
+    return error->code;
+}
+
+// Search metadata, computing the aggregates on the server, each in a
+// single row. Data objects are counted and sized over their first
+// replicate, so that objects whose first replicate has been removed
+// are not included. The server counts the rows of its join of items
+// and AVUs, so an item is counted once for each combination of its
+// AVUs that matches the query, rather than once.
+static int aggregate_metadata_server(rcComm_t *conn, json_t *query,
+                                     char *zone_name,
+                                     const option_flags flags,
+                                     json_int_t *count,
+                                     object_aggregate_t *agg,
+                                     baton_error_t *error) {
+    json_t *rows = NULL;
+
+    query_format_in_t col_format =
+        { .num_columns = 1,
+          .columns     = { COL_COLL_ID },
+          .labels      = { JSON_COUNT_KEY },
+          .modifiers   = { SELECT_COUNT } };
+
+    query_format_in_t obj_format =
+        { .num_columns = 4,
+          .columns     = { COL_D_DATA_ID, COL_DATA_SIZE, COL_DATA_SIZE,
+                           COL_DATA_SIZE },
+          .labels      = { JSON_COUNT_KEY, JSON_TOTAL_SIZE_KEY,
+                           JSON_MIN_SIZE_KEY, JSON_MAX_SIZE_KEY },
+          .modifiers   = { SELECT_COUNT, SELECT_SUM, SELECT_MIN,
+                           SELECT_MAX },
+          .first_repl  = 1 };
+
+    init_baton_error(error);
+
+    if (flags & SEARCH_COLLECTIONS) {
+        logmsg(DEBUG, "Counting collections on the server ...");
+        rows = do_search(conn, zone_name, query, &col_format,
+                         prepare_col_avu_search, prepare_col_acl_search,
+                         prepare_col_cre_search, prepare_col_mod_search,
+                         error);
+        if (error->code != 0) goto finally;
+
+        *count += aggregate_value(json_array_get(rows, 0), JSON_COUNT_KEY);
+        json_decref(rows);
+        rows = NULL;
+    }
+
+    if (flags & SEARCH_OBJECTS) {
+        logmsg(DEBUG, "Counting data objects on the server ...");
+        rows = do_search(conn, zone_name, query, &obj_format,
+                         prepare_obj_avu_search, prepare_obj_acl_search,
+                         prepare_obj_cre_search, prepare_obj_mod_search,
+                         error);
+        if (error->code != 0) goto finally;
+
+        const json_t *row = json_array_get(rows, 0);
+        agg->count      = aggregate_value(row, JSON_COUNT_KEY);
+        agg->total_size = aggregate_value(row, JSON_TOTAL_SIZE_KEY);
+        agg->min_size   = aggregate_value(row, JSON_MIN_SIZE_KEY);
+        agg->max_size   = aggregate_value(row, JSON_MAX_SIZE_KEY);
+
+        *count += agg->count;
+    }
+
+finally:
+    if (rows) json_decref(rows);
+
+    return error->code;
+}
+
+// Search metadata, returning a JSON object with the number of
+// matching items and the total, minimum and maximum size of the
+// matching data objects, without any details of the items. The
+// aggregates are exact unless SERVER_AGGREGATE is set, when they are
+// computed by the server instead. They are then counts of matching
+// rows, not of items, and are reported under their own keys.
+static json_t *aggregate_metadata(rcComm_t *conn, json_t *query,
+                                  char *zone_name, const option_flags flags,
+                                  baton_error_t *error) {
+    json_int_t count       = 0;
+    object_aggregate_t agg = { 0 };
+
+    json_t *result = json_object();
+    if (!result) {
+        set_baton_error(error, -1, "Failed to allocate a new JSON object");
+        goto error;
+    }
+
+    if (flags & SERVER_AGGREGATE) {
+        aggregate_metadata_server(conn, query, zone_name, flags, &count,
+                                  &agg, error);
+    }
+    else {
+        aggregate_metadata_exact(conn, query, zone_name, flags, &count,
+                                 &agg, error);
+    }
+    if (error->code != 0) goto error;
+
+    const int server = flags & SERVER_AGGREGATE;
+
+    // The size aggregates are absent when no data objects match
+    if (agg.count > 0) {
+        json_object_set_new(result, server ? JSON_MATCH_TOTAL_SIZE_KEY :
+                            JSON_TOTAL_SIZE_KEY, json_integer(agg.total_size));
+        json_object_set_new(result, server ? JSON_MATCH_MIN_SIZE_KEY :
+                            JSON_MIN_SIZE_KEY, json_integer(agg.min_size));
+        json_object_set_new(result, server ? JSON_MATCH_MAX_SIZE_KEY :
+                            JSON_MAX_SIZE_KEY, json_integer(agg.max_size));
+    }
+
+    json_object_set_new(result, server ? JSON_MATCH_COUNT_KEY :
+                        JSON_COUNT_KEY, json_integer(count));
+
+    return result;
+
+error:
+    if (result) json_decref(result);
+
+    return NULL;
+}
 
+int visit_metadata(rcComm_t *conn, json_t *query, char *zone_name,
+                   const option_flags flags, const query_visitor visit,
+                   void *data, baton_error_t *error) {
     query_format_in_t col_format =
         { .num_columns = 1,
           .columns     = { COL_COLL_NAME },
@@ -488,6 +820,12 @@ json_t *search_metadata(rcComm_t *conn, json_t *query, char *zone_name,
         obj_format = &obj_format_simple;
     }
 
+    metadata_visit_t mv = { .conn     = conn,
+                            .flags    = flags,
+                            .visit    = visit,
+                            .data     = data,
+                            .num_rows = 0 };
+
     init_baton_error(error);
 
     if (zone_name) {
@@ -498,75 +836,74 @@ json_t *search_metadata(rcComm_t *conn, json_t *query, char *zone_name,
     query = map_access_args(query, error);
     if (error->code != 0) goto error;
 
-    results = json_array();
-    if (!results) {
-        set_baton_error(error, -1, "Failed to allocate a new JSON array");
-        goto error;
-    }
-
-    if (flags & SEARCH_COLLECTIONS) {
-        logmsg(DEBUG, "Searching for collections ...");
-        collections = do_search(conn, zone_name, query, &col_format,
-                                prepare_col_avu_search, prepare_col_acl_search,
-                                prepare_col_cre_search, prepare_col_mod_search,
-                                error);
+    if (flags & AGGREGATE_RESULTS) {
+        json_t *aggregate = aggregate_metadata(conn, query, zone_name, flags,
+                                               error);
         if (error->code != 0) goto error;
 
-        status = json_array_extend(results, collections);
-        if (status != 0) {
-            set_baton_error(error, status, "Failed to add collection results");
+        json_t *rows = json_pack("[o]", aggregate);
+        if (!rows) {
+            set_baton_error(error, -1, "Failed to allocate a new JSON array");
             goto error;
         }
 
-        json_decref(collections);
-    }
-
-    if (flags & SEARCH_OBJECTS) {
-        logmsg(DEBUG, "Searching for data objects ...");
-        data_objects = do_search(conn, zone_name, query, obj_format,
-                                 prepare_obj_avu_search, prepare_obj_acl_search,
-                                 prepare_obj_cre_search, prepare_obj_mod_search,
-                                 error);
+        visit(rows, data, error);
+        json_decref(rows);
         if (error->code != 0) goto error;
 
-        status = json_array_extend(results, data_objects);
-        if (status != 0) {
-            set_baton_error(error, status, "Failed to add data object results");
-            goto error;
-        }
-
-        json_decref(data_objects);
+        return error->code;
     }
 
-    if (flags & PRINT_ACL) {
-        results = add_acl_json_array(conn, results, error);
-        if (error->code != 0) goto error;
-    }
-    if (flags & PRINT_AVU) {
-        results = add_avus_json_array(conn, results, error);
-        if (error->code != 0) goto error;
-    }
-    if (flags & PRINT_CHECKSUM) {
-        results = add_checksum_json_array(conn, results, error);
-        if (error->code != 0) goto error;
-    }
-    if (flags & PRINT_TIMESTAMP) {
-        results = add_tps_json_array(conn, results, error);
+    // The limit applies to collections and data objects together
+    const size_t limit = get_query_limit(query, error);
+    if (error->code != 0) goto error;
+
+    if (flags & SEARCH_COLLECTIONS) {
+        logmsg(DEBUG, "Searching for collections ...");
+        visit_search(conn, zone_name, query, &col_format,
+                     prepare_col_avu_search, prepare_col_acl_search,
+                     prepare_col_cre_search, prepare_col_mod_search,
+                     limit, enrich_rows, &mv, error);
         if (error->code != 0) goto error;
     }
-    if (flags & PRINT_REPLICATE) {
-        results = add_repl_json_array(conn, results, error);
+
+    if ((flags & SEARCH_OBJECTS) && (limit == 0 || mv.num_rows < limit)) {
+        logmsg(DEBUG, "Searching for data objects ...");
+        visit_search(conn, zone_name, query, obj_format,
+                     prepare_obj_avu_search, prepare_obj_acl_search,
+                     prepare_obj_cre_search, prepare_obj_mod_search,
+                     limit == 0 ? 0 : limit - mv.num_rows,
+                     enrich_rows, &mv, error);
         if (error->code != 0) goto error;
     }
 
-    return results;
+    return error->code;
 
 error:
     logmsg(ERROR, "%s", error->message);
 
-    if (results)      json_decref(results);
-    if (collections)  json_decref(collections);
-    if (data_objects) json_decref(data_objects);
+    return error->code;
+}
+
+json_t *search_metadata(rcComm_t *conn, json_t *query, char *zone_name,
+                        const option_flags flags, baton_error_t *error) {
+    init_baton_error(error);
+
+    json_t *results = json_array();
+    if (!results) {
+        set_baton_error(error, -1, "Failed to allocate a new JSON array");
+        logmsg(ERROR, "%s", error->message);
+        goto error;
+    }
+
+    visit_metadata(conn, query, zone_name, flags, append_query_rows, results,
+                   error);
+    if (error->code != 0) goto error;
+
+    return results;
+
+error:
+    if (results) json_decref(results);
 
     return NULL;
 }
@@ -805,7 +1142,7 @@ int maybe_modify_json_metadata(rcComm_t *conn, rodsPath_t *rods_path,
                                  error);
         }
 
-        free(str);
+        free_json_string(str);
 
         if (error->code != 0) goto finally;
     }
@@ -1,6 +1,6 @@
 /**
- * Copyright (C) 2013, 2014, 2015, 2016, 2017, 2025 Genome Research
- * Ltd. All rights reserved.
+ * Copyright (C) 2013, 2014, 2015, 2016, 2017, 2025, 2026 Genome
+ * Research Ltd. All rights reserved.
  *
  * This program is free software: you can redistribute it and/or modify
  * it under the terms of the GNU General Public License as published by
@@ -154,6 +154,22 @@ int resolve_rods_path(rcComm_t *conn, rodsEnv *env,
 int set_rods_path(rcComm_t *conn, rodsPath_t *rods_path, char *path,
                   baton_error_t *error);
 
+/**
+ * Initialise and set an iRODS path as for @ref set_rods_path, for a
+ * path already known to exist with the given type, e.g. because it was
+ * found by a query. The path is not resolved on the server, so the
+ * data object ID, size, checksum and stat of the path are not set.
+ *
+ * @param[out] rods_path An iRODS path.
+ * @param[in]  path      A string representing an iRODS path.
+ * @param[in]  obj_type  The path type, DATA_OBJ_T or COLL_OBJ_T.
+ * @param[out] error     An error report struct.
+ *
+ * @return 0 on success, iRODS error code on failure.
+ */
+int set_trusted_rods_path(rodsPath_t *rods_path, char *path, int obj_type,
+                          baton_error_t *error);
+
 int move_rods_path(rcComm_t *conn, rodsPath_t *rods_path, char *new_path,
                    baton_error_t *error);
 
@@ -179,6 +195,27 @@ int resolve_collection(json_t *object, rcComm_t *conn, rodsEnv *env,
 json_t *search_metadata(rcComm_t *conn, json_t *query, char *zone_name,
                         option_flags flags, baton_error_t *error);
 
+/**
+ * Search metadata as for @ref search_metadata, passing each page of
+ * results to a visitor as soon as it has been fetched and had any
+ * details requested by the flags added, rather than accumulating them.
+ *
+ * @param[in]  conn         An open iRODS connection.
+ * @param[in]  query        A JSON query specification, as for
+ *                          @ref search_metadata.
+ * @param[in]  zone_name    An iRODS zone name. Optional, NULL means the current
+ *                          zone.
+ * @param[in]  flags        Search behaviour options.
+ * @param[in]  visit        The visitor.
+ * @param[in]  data         Data to pass to the visitor.
+ * @param[out] error        An error report struct.
+ *
+ * @return 0 on success, error code on failure.
+ */
+int visit_metadata(rcComm_t *conn, json_t *query, char *zone_name,
+                   option_flags flags, query_visitor visit, void *data,
+                   baton_error_t *error);
+
 /**
  * Perform a specific query (SQL must have been installed on iRODS server by an
  * administrator using `iadmin asq`).
@@ -0,0 +1,199 @@
+/**
+ * Copyright (C) 2026 Genome Research Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @file concurrency.c
+ * @author Keith James <kdj@sanger.ac.uk>
+ */
+
+#include <string.h>
+
+#include <rodsClient.h>
+
+#include "config.h"
+#include "concurrency.h"
+#include "log.h"
+#include "retry.h"
+
+/** Rate at which the baseline latency follows a sustained rise */
+#define BASELINE_DRIFT 0.01
+
+static double elapsed_seconds(const struct timespec *start,
+                              const struct timespec *end) {
+    return (double) (end->tv_sec - start->tv_sec) +
+        (double) (end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+// Return the latency statistics for an operation, adding them if
+// necessary. Returns NULL if no more operation types can be tracked.
+static op_latency_t *find_op_latency(concurrency_controller_t *controller,
+                                     const char *op_name) {
+    const char *name = op_name ? op_name : "";
+
+    for (size_t i = 0; i < controller->num_ops; i++) {
+        if (strncmp(controller->ops[i].name, name,
+                    MAX_TRACKED_OP_NAME_LEN) == 0) {
+            return &controller->ops[i];
+        }
+    }
+
+    if (controller->num_ops == MAX_TRACKED_OPS) return NULL;
+
+    op_latency_t *op = &controller->ops[controller->num_ops++];
+    snprintf(op->name, MAX_TRACKED_OP_NAME_LEN, "%s", name);
+    op->count = 0;
+
+    return op;
+}
+
+// Reduce the limit by a factor, at most once per interval. Must be
+// called with the controller lock held.
+static void decrease_limit(concurrency_controller_t *controller,
+                           const double factor, const char *reason) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    if (elapsed_seconds(&controller->last_decrease, &now) < DECREASE_INTERVAL) {
+        return;
+    }
+
+    const unsigned before = (unsigned) controller->limit;
+
+    controller->limit *= factor;
+    if (controller->limit < controller->min_limit) {
+        controller->limit = controller->min_limit;
+    }
+    controller->successes     = 0;
+    controller->last_decrease = now;
+
+    const unsigned after = (unsigned) controller->limit;
+    if (after != before) {
+        logmsg(NOTICE, "Reduced concurrency from %u to %u (%s)",
+               before, after, reason);
+    }
+}
+
+void init_concurrency_controller(concurrency_controller_t *controller,
+                                 const unsigned min_limit,
+                                 const unsigned max_limit,
+                                 const unsigned initial) {
+    memset(controller, 0, sizeof (concurrency_controller_t));
+
+    controller->min_limit = min_limit > 0 ? min_limit : 1;
+    controller->max_limit = max_limit > controller->min_limit ?
+        max_limit : controller->min_limit;
+
+    controller->limit = initial;
+    if (controller->limit < controller->min_limit) {
+        controller->limit = controller->min_limit;
+    }
+    if (controller->limit > controller->max_limit) {
+        controller->limit = controller->max_limit;
+    }
+
+    // Permit an immediate decrease
+    clock_gettime(CLOCK_MONOTONIC, &controller->last_decrease);
+    controller->last_decrease.tv_sec -= (time_t) DECREASE_INTERVAL + 1;
+
+    pthread_mutex_init(&controller->lock, NULL);
+    pthread_cond_init(&controller->cond, NULL);
+}
+
+void start_operation(concurrency_controller_t *controller) {
+    pthread_mutex_lock(&controller->lock);
+    while (controller->in_flight >= (unsigned) controller->limit) {
+        pthread_cond_wait(&controller->cond, &controller->lock);
+    }
+    controller->in_flight++;
+    pthread_mutex_unlock(&controller->lock);
+}
+
+void finish_operation(concurrency_controller_t *controller,
+                      const char *op_name, const double latency,
+                      const int code) {
+    pthread_mutex_lock(&controller->lock);
+    controller->in_flight--;
+
+    if (is_overload_error(code)) {
+        decrease_limit(controller, ERROR_DECREASE_FACTOR, "server error");
+    }
+    else if (code == 0) {
+        op_latency_t *op = find_op_latency(controller, op_name);
+        int slow = 0;
+
+        if (op) {
+            if (op->count == 0) {
+                op->baseline = latency;
+                op->average  = latency;
+            }
+            else {
+                op->average += LATENCY_SMOOTHING * (latency - op->average);
+
+                if (latency < op->baseline) {
+                    op->baseline = latency;
+                }
+                else {
+                    op->baseline += BASELINE_DRIFT * (op->average - op->baseline);
+                }
+            }
+            op->count++;
+
+            slow = op->average > op->baseline * LATENCY_TOLERANCE;
+        }
+
+        if (slow) {
+            decrease_limit(controller, LATENCY_DECREASE_FACTOR, "latency");
+        }
+        else if (++controller->successes >= (unsigned) controller->limit) {
+            // Additive increase, by one per limit's worth of successes
+            if (controller->limit + 1 <= controller->max_limit) {
+                controller->limit += 1;
+                logmsg(DEBUG, "Increased concurrency to %u",
+                       (unsigned) controller->limit);
+            }
+            controller->successes = 0;
+        }
+    }
+
+    pthread_cond_broadcast(&controller->cond);
+    pthread_mutex_unlock(&controller->lock);
+}
+
+unsigned get_concurrency_limit(concurrency_controller_t *controller) {
+    pthread_mutex_lock(&controller->lock);
+    const unsigned limit = (unsigned) controller->limit;
+    pthread_mutex_unlock(&controller->lock);
+
+    return limit;
+}
+
+void free_concurrency_controller(concurrency_controller_t *controller) {
+    pthread_cond_destroy(&controller->cond);
+    pthread_mutex_destroy(&controller->lock);
+}
+
+int is_overload_error(const int code) {
+    if (is_connection_error(code)) return 1;
+    if (code >= 0) return 0;
+
+    switch (irods_error_base(code)) {
+        case SYS_MAX_CONNECT_COUNT_EXCEEDED:
+        case SYS_SERVER_LOAD_TOO_HIGH:
+        case CAT_CONNECT_ERR:
+            return 1;
+        default:
+            return 0;
+    }
+}
@@ -0,0 +1,150 @@
+/**
+ * Copyright (C) 2026 Genome Research Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @file concurrency.h
+ * @author Keith James <kdj@sanger.ac.uk>
+ */
+
+#ifndef _BATON_CONCURRENCY_H
+#define _BATON_CONCURRENCY_H
+
+#include <pthread.h>
+#include <time.h>
+
+#include "config.h"
+
+/** The maximum number of operation types whose latency is tracked */
+#define MAX_TRACKED_OPS 16
+
+/** The maximum length of a tracked operation name */
+#define MAX_TRACKED_OP_NAME_LEN 32
+
+/** Weight of the latest sample in the moving average latency */
+#define LATENCY_SMOOTHING 0.2
+
+/** The moving average latency of an operation, relative to its
+    baseline, above which the server is considered overloaded */
+#define LATENCY_TOLERANCE 2.0
+
+/** Factor by which the limit is reduced on a server overload error */
+#define ERROR_DECREASE_FACTOR 0.5
+
+/** Factor by which the limit is reduced on excess latency */
+#define LATENCY_DECREASE_FACTOR 0.8
+
+/** The minimum interval between reductions of the limit, in seconds */
+#define DECREASE_INTERVAL 1.0
+
+/**
+ *  @struct op_latency
+ *  @brief Latency statistics for one type of operation.
+ */
+typedef struct op_latency {
+    /** The operation name. */
+    char name[MAX_TRACKED_OP_NAME_LEN];
+    /** The lowest recent latency in seconds, taken as unloaded. */
+    double baseline;
+    /** The moving average latency in seconds. */
+    double average;
+    /** The number of samples. */
+    unsigned long count;
+} op_latency_t;
+
+/**
+ *  @struct concurrency_controller
+ *  @brief An AIMD (additive increase, multiplicative decrease)
+ *  controller of the number of operations in flight. The limit is
+ *  raised by one after each limit's worth of successful operations
+ *  and reduced by a constant factor when an operation fails with an
+ *  error indicating that the server is overloaded, or when latency
+ *  rises well above its baseline.
+ */
+typedef struct concurrency_controller {
+    /** The current limit. Fractional, the effective limit is the
+        integer part. */
+    double limit;
+    /** The lowest permitted limit. */
+    unsigned min_limit;
+    /** The highest permitted limit. */
+    unsigned max_limit;
+    /** The number of operations in flight. */
+    unsigned in_flight;
+    /** Successful operations since the limit was last changed. */
+    unsigned long successes;
+    /** When the limit was last reduced. */
+    struct timespec last_decrease;
+    /** Latency statistics per operation type. */
+    op_latency_t ops[MAX_TRACKED_OPS];
+    /** The number of operation types tracked. */
+    size_t num_ops;
+    /** Mutex protecting all of the above. */
+    pthread_mutex_t lock;
+    /** Signalled when an operation completes. */
+    pthread_cond_t cond;
+} concurrency_controller_t;
+
+/**
+ * Initialise a concurrency controller.
+ *
+ * @param[out] controller   A concurrency controller.
+ * @param[in]  min_limit    The lowest permitted limit, at least 1.
+ * @param[in]  max_limit    The highest permitted limit.
+ * @param[in]  initial      The initial limit.
+ */
+void init_concurrency_controller(concurrency_controller_t *controller,
+                                 unsigned min_limit, unsigned max_limit,
+                                 unsigned initial);
+
+/**
+ * Wait until an operation may start, within the current limit.
+ *
+ * @param[in] controller    A concurrency controller.
+ */
+void start_operation(concurrency_controller_t *controller);
+
+/**
+ * Record the completion of an operation and adjust the limit.
+ *
+ * @param[in] controller    A concurrency controller.
+ * @param[in] op_name       The operation name, may be NULL.
+ * @param[in] latency       The operation latency in seconds.
+ * @param[in] code          The operation error code, 0 on success.
+ */
+void finish_operation(concurrency_controller_t *controller,
+                      const char *op_name, double latency, int code);
+
+/**
+ * Return the current limit.
+ *
+ * @param[in] controller    A concurrency controller.
+ *
+ * @return The limit.
+ */
+unsigned get_concurrency_limit(concurrency_controller_t *controller);
+
+void free_concurrency_controller(concurrency_controller_t *controller);
+
+/**
+ * Test whether an iRODS error code indicates that the server is
+ * overloaded or refusing connections.
+ *
+ * @param[in] code          An iRODS error code.
+ *
+ * @return 1 if the code indicates overload, 0 otherwise.
+ */
+int is_overload_error(int code);
+
+#endif // _BATON_CONCURRENCY_H
@@ -0,0 +1,329 @@
+/**
+ * Copyright (C) 2026 Genome Research Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @file connection_pool.c
+ * @author Keith James <kdj@sanger.ac.uk>
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#include "config.h"
+#include "baton.h"
+#include "connection_pool.h"
+
+// Serialises iRODS environment loading and login, which are not
+// thread-safe in the iRODS client library
+static pthread_mutex_t login_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static rcComm_t *pool_login(rodsEnv *env) {
+    pthread_mutex_lock(&login_mutex);
+    rcComm_t *conn = rods_login(env);
+    pthread_mutex_unlock(&login_mutex);
+
+    return conn;
+}
+
+int is_connection_open(rcComm_t *conn) {
+    if (!conn || conn->sock < 0) return 0;
+
+    // The server sends nothing unprompted, so readable data or
+    // end-of-file on the socket mean the connection is unusable
+    char buf;
+    const ssize_t n = recv(conn->sock, &buf, 1, MSG_PEEK | MSG_DONTWAIT);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return 1;
+
+    return 0;
+}
+
+// Disconnect a connection that has been detached from the pool,
+// without holding the pool lock, so that a slow server does not stall
+// the workers. Expects the lock to be held on entry and holds it on
+// return.
+static void disconnect_unlocked(connection_pool_t *pool, rcComm_t *conn) {
+    pthread_mutex_unlock(&pool->lock);
+    rcDisconnect(conn);
+    pthread_mutex_lock(&pool->lock);
+}
+
+// Replace connections that have outlived their lifetime and close
+// surplus idle ones. Runs in its own thread.
+static void *maintain_connections(void *arg) {
+    connection_pool_t *pool = arg;
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->running) {
+        struct timespec abs_timeout;
+        clock_gettime(CLOCK_REALTIME, &abs_timeout);
+        abs_timeout.tv_sec += POOL_MAINTENANCE_INTERVAL;
+
+        // Wake only for the interval or the pool stopping; anything
+        // else is a spurious wakeup
+        int status = 0;
+        while (pool->running && status != ETIMEDOUT) {
+            status = pthread_cond_timedwait(&pool->maintain_cond,
+                                            &pool->lock, &abs_timeout);
+        }
+
+        if (!pool->running) break;
+
+        const time_t now = time(NULL);
+        int idle_kept = 0;
+
+        for (size_t i = 0; i < pool->size; i++) {
+            pooled_connection_t *pconn = &pool->connections[i];
+            if (!pconn->conn || pconn->refreshing) continue;
+
+            // Keep one idle connection warm, close any others that
+            // have been idle for longer than a connection lifetime
+            if (!pconn->in_use) {
+                if (idle_kept &&
+                    difftime(now, pconn->release_time) >= pool->max_lifetime) {
+                    rcComm_t *idle = pconn->conn;
+                    pconn->conn = NULL;
+                    disconnect_unlocked(pool, idle);
+                    logmsg(NOTICE, "Closed an idle iRODS connection");
+                    continue;
+                }
+                idle_kept = 1;
+            }
+
+            if (pconn->replacement ||
+                difftime(now, pconn->connect_time) < pool->max_lifetime) {
+                continue;
+            }
+
+            // Log in the replacement before retiring the connection,
+            // which may continue to be used in the meantime
+            pconn->refreshing = 1;
+            pthread_mutex_unlock(&pool->lock);
+
+            rodsEnv env;
+            rcComm_t *replacement = pool_login(&env);
+
+            pthread_mutex_lock(&pool->lock);
+            pconn->refreshing = 0;
+
+            if (!replacement) {
+                logmsg(WARN, "Failed to refresh an iRODS connection; "
+                       "will retry");
+                continue;
+            }
+
+            if (pconn->in_use || !pconn->conn) {
+                pconn->replacement     = replacement;
+                pconn->replacement_env = env;
+            }
+            else {
+                rcComm_t *expired = pconn->conn;
+                pconn->conn         = replacement;
+                pconn->env          = env;
+                pconn->connect_time = time(NULL);
+                disconnect_unlocked(pool, expired);
+            }
+
+            logmsg(NOTICE, "Refreshed an iRODS connection after a timeout "
+                   "of %lu seconds", pool->max_lifetime);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return NULL;
+}
+
+connection_pool_t *make_connection_pool(const size_t size,
+                                        const unsigned long max_lifetime,
+                                        baton_error_t *error) {
+    init_baton_error(error);
+
+    connection_pool_t *pool = calloc(1, sizeof (connection_pool_t));
+    if (!pool) goto alloc_error;
+
+    pool->connections = calloc(size, sizeof (pooled_connection_t));
+    if (!pool->connections) goto alloc_error;
+
+    pool->size         = size;
+    pool->max_lifetime = max_lifetime;
+    pool->running      = 1;
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->cond, NULL);
+    pthread_cond_init(&pool->maintain_cond, NULL);
+
+    const int status = pthread_create(&pool->maintainer, NULL,
+                                      &maintain_connections, pool);
+    if (status != 0) {
+        set_baton_error(error, status, "Failed to start connection "
+                        "maintenance thread: %s", strerror(status));
+        pthread_cond_destroy(&pool->maintain_cond);
+        pthread_cond_destroy(&pool->cond);
+        pthread_mutex_destroy(&pool->lock);
+        goto error;
+    }
+
+    return pool;
+
+alloc_error:
+    set_baton_error(error, errno, "Failed to allocate memory: error %d %s",
+                    errno, strerror(errno));
+
+error:
+    if (pool) {
+        if (pool->connections) free(pool->connections);
+        free(pool);
+    }
+
+    return NULL;
+}
+
+pooled_connection_t *acquire_connection(connection_pool_t *pool,
+                                        baton_error_t *error) {
+    pooled_connection_t *pconn = NULL;
+
+    init_baton_error(error);
+
+    pthread_mutex_lock(&pool->lock);
+    while (!pconn) {
+        pooled_connection_t *empty = NULL;
+
+        // Prefer the most recently logged-in idle connection
+        for (size_t i = 0; i < pool->size; i++) {
+            pooled_connection_t *candidate = &pool->connections[i];
+            if (candidate->in_use) continue;
+
+            if (!candidate->conn) {
+                if (!empty) empty = candidate;
+            }
+            else if (!pconn ||
+                     candidate->connect_time > pconn->connect_time) {
+                pconn = candidate;
+            }
+        }
+
+        if (!pconn) pconn = empty;
+        if (!pconn) pthread_cond_wait(&pool->cond, &pool->lock);
+    }
+    pconn->in_use = 1;
+
+    const time_t now = time(NULL);
+    rcComm_t *stale  = NULL;
+
+    if (pconn->conn &&
+        difftime(now, pconn->release_time) >= POOL_PROBE_IDLE_TIME &&
+        !is_connection_open(pconn->conn)) {
+        logmsg(NOTICE, "An idle iRODS connection was closed by the server");
+        stale = pconn->conn;
+        pconn->conn = NULL;
+    }
+
+    if (!pconn->conn && pconn->replacement) {
+        pconn->conn         = pconn->replacement;
+        pconn->env          = pconn->replacement_env;
+        pconn->replacement  = NULL;
+        pconn->connect_time = now;
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    if (stale) rcDisconnect(stale);
+
+    if (!pconn->conn) {
+        logmsg(NOTICE, "Opening a new iRODS connection");
+
+        rcComm_t *conn = pool_login(&pconn->env);
+
+        pthread_mutex_lock(&pool->lock);
+        if (conn) {
+            pconn->conn         = conn;
+            pconn->connect_time = time(NULL);
+        }
+        else {
+            pconn->in_use = 0;
+            pthread_cond_broadcast(&pool->cond);
+        }
+        pthread_mutex_unlock(&pool->lock);
+
+        if (!conn) {
+            set_baton_error(error, USER_SOCK_CONNECT_ERR,
+                            "Failed to log in to iRODS");
+            return NULL;
+        }
+    }
+
+    return pconn;
+}
+
+void release_connection(connection_pool_t *pool, pooled_connection_t *pconn,
+                        const int healthy) {
+    rcComm_t *retired = NULL;
+
+    pthread_mutex_lock(&pool->lock);
+    if (pconn->replacement) {
+        retired             = pconn->conn;
+        pconn->conn         = pconn->replacement;
+        pconn->env          = pconn->replacement_env;
+        pconn->replacement  = NULL;
+        pconn->connect_time = time(NULL);
+    }
+    else if (!healthy) {
+        retired     = pconn->conn;
+        pconn->conn = NULL;
+    }
+
+    pconn->in_use       = 0;
+    pconn->release_time = time(NULL);
+    pthread_cond_broadcast(&pool->cond);
+    pthread_mutex_unlock(&pool->lock);
+
+    if (retired) rcDisconnect(retired);
+}
+
+void free_connection_pool(connection_pool_t *pool) {
+    if (!pool) return;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->running = 0;
+    pthread_cond_broadcast(&pool->cond);
+    pthread_cond_broadcast(&pool->maintain_cond);
+    pthread_mutex_unlock(&pool->lock);
+
+    const int status = pthread_join(pool->maintainer, NULL);
+    if (status != 0) {
+        logmsg(ERROR, "Connection maintenance thread failed to join: %s",
+               strerror(status));
+    }
+
+    int num_closed = 0;
+    for (size_t i = 0; i < pool->size; i++) {
+        pooled_connection_t *pconn = &pool->connections[i];
+        if (pconn->conn) {
+            rcDisconnect(pconn->conn);
+            num_closed++;
+        }
+        if (pconn->replacement) rcDisconnect(pconn->replacement);
+    }
+
+    if (num_closed > 0) {
+        logmsg(NOTICE, "Closed %d iRODS connections on exit", num_closed);
+    }
+
+    pthread_cond_destroy(&pool->maintain_cond);
+    pthread_cond_destroy(&pool->cond);
+    pthread_mutex_destroy(&pool->lock);
+
+    free(pool->connections);
+    free(pool);
+}
@@ -0,0 +1,145 @@
+/**
+ * Copyright (C) 2026 Genome Research Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @file connection_pool.h
+ * @author Keith James <kdj@sanger.ac.uk>
+ */
+
+#ifndef _BATON_CONNECTION_POOL_H
+#define _BATON_CONNECTION_POOL_H
+
+#include <pthread.h>
+#include <time.h>
+
+#include <rodsClient.h>
+
+#include "config.h"
+#include "error.h"
+
+/** The interval in seconds at which the pool is maintained */
+#define POOL_MAINTENANCE_INTERVAL 1
+
+/** Idle connections are probed before reuse after this many seconds */
+#define POOL_PROBE_IDLE_TIME 5
+
+/**
+ *  @struct pooled_connection
+ *  @brief A logged-in iRODS connection managed by a connection pool.
+ */
+typedef struct pooled_connection {
+    /** The iRODS environment of the connection. */
+    rodsEnv env;
+    /** The connection, or NULL if the slot is empty. */
+    rcComm_t *conn;
+    /** A newly logged-in connection to replace conn when it is released. */
+    rcComm_t *replacement;
+    /** The iRODS environment of the replacement. */
+    rodsEnv replacement_env;
+    /** When the connection was logged in. */
+    time_t connect_time;
+    /** When the connection was last released. */
+    time_t release_time;
+    /** True while the connection is acquired. */
+    int in_use;
+    /** True while a replacement is being logged in. */
+    int refreshing;
+} pooled_connection_t;
+
+/**
+ *  @struct connection_pool
+ *  @brief A pool of logged-in iRODS connections. Connections older
+ *  than their maximum lifetime are replaced by a maintenance thread,
+ *  which logs in the replacement before retiring the old connection,
+ *  so that a caller never waits for authentication except when the
+ *  pool is first filled or a connection is found to be dead.
+ */
+typedef struct connection_pool {
+    /** The connection slots. */
+    pooled_connection_t *connections;
+    /** The number of connection slots. */
+    size_t size;
+    /** The maximum lifetime of a connection in seconds. */
+    unsigned long max_lifetime;
+    /** True while the maintenance thread should run. */
+    int running;
+    /** Mutex protecting all of the above. */
+    pthread_mutex_t lock;
+    /** Signalled when a connection is released or the pool stops. */
+    pthread_cond_t cond;
+    /** Signalled only when the pool stops. */
+    pthread_cond_t maintain_cond;
+    /** The maintenance thread. */
+    pthread_t maintainer;
+} connection_pool_t;
+
+/**
+ * Allocate a new connection pool and start its maintenance thread.
+ * Connections are logged in as they are first acquired.
+ *
+ * @param[in]  size           The maximum number of connections.
+ * @param[in]  max_lifetime   The maximum lifetime of a connection,
+ *                            in seconds.
+ * @param[out] error          An error report struct.
+ *
+ * @return A new pool on success, NULL on error.
+ */
+connection_pool_t *make_connection_pool(size_t size,
+                                        unsigned long max_lifetime,
+                                        baton_error_t *error);
+
+/**
+ * Acquire a logged-in connection from a pool, waiting if all are in
+ * use. An idle connection is probed for liveness before being handed
+ * out and is replaced if it has been closed by the server.
+ *
+ * @param[in]  pool           A connection pool.
+ * @param[out] error          An error report struct.
+ *
+ * @return A connection on success, NULL on error.
+ */
+pooled_connection_t *acquire_connection(connection_pool_t *pool,
+                                        baton_error_t *error);
+
+/**
+ * Return a connection to a pool.
+ *
+ * @param[in] pool            A connection pool.
+ * @param[in] pconn           A connection acquired from the pool.
+ * @param[in] healthy         False if the connection should be closed,
+ *                            e.g. because it failed with a network error.
+ */
+void release_connection(connection_pool_t *pool, pooled_connection_t *pconn,
+                        int healthy);
+
+/**
+ * Stop the maintenance thread, close all connections and free a pool.
+ * All connections must have been released.
+ *
+ * @param[in] pool            A connection pool.
+ */
+void free_connection_pool(connection_pool_t *pool);
+
+/**
+ * Test whether an iRODS connection appears to be open, without making
+ * a request to the server.
+ *
+ * @param[in] conn            An iRODS connection.
+ *
+ * @return 1 if the connection appears open, 0 otherwise.
+ */
+int is_connection_open(rcComm_t *conn);
+
+#endif // _BATON_CONNECTION_POOL_H
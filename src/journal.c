@@ -0,0 +1,286 @@
+/**
+ * Copyright (C) 2026 Genome Research Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @file journal.c
+ * @author Keith James <kdj@sanger.ac.uk>
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "journal.h"
+#include "log.h"
+
+#define JOURNAL_LINE_LEN 64
+
+static int compare_entries(const void *a, const void *b) {
+    const journal_entry_t *ea = a;
+    const journal_entry_t *eb = b;
+
+    return (ea->ordinal > eb->ordinal) - (ea->ordinal < eb->ordinal);
+}
+
+// Parse a journal line of the form "<ordinal> <offset>\n". Returns 0
+// if the line is incomplete or invalid.
+static int parse_entry(const char *line, journal_entry_t *entry) {
+    const size_t len = strlen(line);
+    if (len == 0 || line[len - 1] != '\n') return 0;
+
+    errno = 0;
+    char *end_ptr;
+    const unsigned long long ordinal = strtoull(line, &end_ptr, 10);
+    if (errno != 0 || end_ptr == line || *end_ptr != ' ') return 0;
+
+    const char *offset_str = end_ptr + 1;
+    const long offset = strtol(offset_str, &end_ptr, 10);
+    if (errno != 0 || end_ptr == offset_str || *end_ptr != '\n') return 0;
+
+    entry->ordinal = (size_t) ordinal;
+    entry->offset  = offset;
+
+    return 1;
+}
+
+// Read the entries of an existing journal file, finding where to
+// resume and which later items are complete
+static int read_journal(journal_t *journal, const char *path,
+                        int *partial, baton_error_t *error) {
+    journal_entry_t *entries = NULL;
+    size_t num_entries = 0;
+    size_t capacity    = 0;
+
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        if (errno == ENOENT) return 0;
+
+        set_baton_error(error, errno, "Failed to open journal '%s': "
+                        "error %d %s", path, errno, strerror(errno));
+        goto error;
+    }
+
+    char line[JOURNAL_LINE_LEN];
+    size_t line_num = 0;
+    while (fgets(line, sizeof line, file)) {
+        line_num++;
+
+        const size_t len = strlen(line);
+        *partial = len > 0 && line[len - 1] != '\n';
+
+        journal_entry_t entry;
+        if (!parse_entry(line, &entry)) {
+            logmsg(WARN, "Ignoring invalid entry at line %zu of journal "
+                   "'%s'", line_num, path);
+            continue;
+        }
+
+        if (num_entries == capacity) {
+            capacity = capacity > 0 ? capacity * 2 : 1024;
+            journal_entry_t *tmp = realloc(entries,
+                                           capacity * sizeof (journal_entry_t));
+            if (!tmp) {
+                set_baton_error(error, errno, "Failed to allocate memory: "
+                                "error %d %s", errno, strerror(errno));
+                goto error;
+            }
+            entries = tmp;
+        }
+        entries[num_entries++] = entry;
+    }
+
+    if (ferror(file)) {
+        set_baton_error(error, errno, "Failed to read journal '%s': "
+                        "error %d %s", path, errno, strerror(errno));
+        goto error;
+    }
+
+    fclose(file);
+    file = NULL;
+
+    qsort(entries, num_entries, sizeof (journal_entry_t), compare_entries);
+
+    // Items are resumed after the longest run of complete items from
+    // the start of the input
+    size_t i = 0;
+    while (i < num_entries && entries[i].ordinal <= journal->resume_ordinal) {
+        if (entries[i].ordinal == journal->resume_ordinal) {
+            journal->resume_offset = entries[i].offset;
+            journal->resume_ordinal++;
+        }
+        i++;
+    }
+
+    if (i < num_entries) {
+        journal->completed = calloc(num_entries - i, sizeof (size_t));
+        if (!journal->completed) {
+            set_baton_error(error, errno, "Failed to allocate memory: "
+                            "error %d %s", errno, strerror(errno));
+            goto error;
+        }
+
+        for (; i < num_entries; i++) {
+            const size_t n = journal->num_completed;
+            if (n > 0 && journal->completed[n - 1] == entries[i].ordinal) {
+                continue;
+            }
+            journal->completed[journal->num_completed++] = entries[i].ordinal;
+        }
+    }
+
+    free(entries);
+
+    return 0;
+
+error:
+    if (file)    fclose(file);
+    if (entries) free(entries);
+
+    return error->code;
+}
+
+int open_journal(journal_t *journal, const char *path, baton_error_t *error) {
+    init_baton_error(error);
+
+    memset(journal, 0, sizeof (journal_t));
+    journal->resume_offset = -1;
+    journal->last_sync     = time(NULL);
+
+    int partial = 0;
+    if (read_journal(journal, path, &partial, error) != 0) goto error;
+
+    journal->file = fopen(path, "a");
+    if (!journal->file) {
+        set_baton_error(error, errno, "Failed to open journal '%s': "
+                        "error %d %s", path, errno, strerror(errno));
+        goto error;
+    }
+
+    // Terminate any partial entry, so that it is not run together
+    // with the next
+    if (partial && fputc('\n', journal->file) == EOF) {
+        set_baton_error(error, errno, "Failed to write to journal '%s': "
+                        "error %d %s", path, errno, strerror(errno));
+        goto error;
+    }
+
+    if (journal->resume_ordinal > 0 || journal->num_completed > 0) {
+        logmsg(NOTICE, "Resuming from journal '%s': %zu items complete, "
+               "first incomplete item %zu", path,
+               journal->resume_ordinal + journal->num_completed,
+               journal->resume_ordinal);
+    }
+
+    return 0;
+
+error:
+    if (journal->file)      fclose(journal->file);
+    if (journal->completed) free(journal->completed);
+    journal->file      = NULL;
+    journal->completed = NULL;
+
+    return error->code;
+}
+
+int is_journalled(journal_t *journal, const size_t ordinal) {
+    if (ordinal < journal->resume_ordinal) return 1;
+
+    while (journal->next_completed < journal->num_completed &&
+           journal->completed[journal->next_completed] < ordinal) {
+        journal->next_completed++;
+    }
+
+    return journal->next_completed < journal->num_completed &&
+        journal->completed[journal->next_completed] == ordinal;
+}
+
+int stage_journal_entry(journal_t *journal, const journal_entry_t entry,
+                        baton_error_t *error) {
+    init_baton_error(error);
+
+    if (journal->num_staged == journal->staged_capacity) {
+        const size_t capacity = journal->staged_capacity > 0 ?
+            journal->staged_capacity * 2 : 256;
+        journal_entry_t *tmp = realloc(journal->staged,
+                                       capacity * sizeof (journal_entry_t));
+        if (!tmp) {
+            set_baton_error(error, errno, "Failed to allocate memory: "
+                            "error %d %s", errno, strerror(errno));
+            return error->code;
+        }
+
+        journal->staged          = tmp;
+        journal->staged_capacity = capacity;
+    }
+
+    journal->staged[journal->num_staged++] = entry;
+
+    return 0;
+}
+
+int commit_journal(journal_t *journal, const int sync, baton_error_t *error) {
+    init_baton_error(error);
+
+    for (size_t i = 0; i < journal->num_staged; i++) {
+        if (fprintf(journal->file, "%zu %ld\n", journal->staged[i].ordinal,
+                    journal->staged[i].offset) < 0) {
+            set_baton_error(error, errno, "Failed to write to journal: "
+                            "error %d %s", errno, strerror(errno));
+            goto error;
+        }
+    }
+    journal->num_staged = 0;
+
+    if (fflush(journal->file) != 0) {
+        set_baton_error(error, errno, "Failed to write to journal: "
+                        "error %d %s", errno, strerror(errno));
+        goto error;
+    }
+
+    const time_t now = time(NULL);
+    if (sync || now - journal->last_sync >= JOURNAL_SYNC_INTERVAL) {
+        if (fsync(fileno(journal->file)) != 0) {
+            set_baton_error(error, errno, "Failed to synchronise journal: "
+                            "error %d %s", errno, strerror(errno));
+            goto error;
+        }
+        journal->last_sync = now;
+    }
+
+    return 0;
+
+error:
+    journal->num_staged = 0;
+
+    return error->code;
+}
+
+void close_journal(journal_t *journal) {
+    if (journal->file) {
+        baton_error_t error;
+        if (commit_journal(journal, 1, &error) != 0) {
+            logmsg(ERROR, "%s", error.message);
+        }
+        fclose(journal->file);
+        journal->file = NULL;
+    }
+
+    if (journal->completed) free(journal->completed);
+    if (journal->staged)    free(journal->staged);
+    journal->completed = NULL;
+    journal->staged    = NULL;
+}
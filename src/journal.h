@@ -0,0 +1,139 @@
+/**
+ * Copyright (C) 2026 Genome Research Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @file journal.h
+ * @author Keith James <kdj@sanger.ac.uk>
+ */
+
+#ifndef _BATON_JOURNAL_H
+#define _BATON_JOURNAL_H
+
+#include <stdio.h>
+#include <time.h>
+
+#include "config.h"
+#include "error.h"
+
+/** The minimum interval in seconds between synchronising the journal
+    to disk. It is always synchronised when closed. */
+#define JOURNAL_SYNC_INTERVAL 1
+
+/**
+ *  @struct journal_entry
+ *  @brief A record of an input item whose output has been written.
+ */
+typedef struct journal_entry {
+    /** The position of the item in the input stream, counting from 0. */
+    size_t ordinal;
+    /** The offset in bytes of the end of the item in the input
+        stream, or -1 if the stream is not seekable. */
+    long offset;
+} journal_entry_t;
+
+/**
+ *  @struct journal
+ *  @brief An append-only record of the items in an input stream that
+ *  are complete, so that processing may be resumed after a failure.
+ *  Each line of the journal file is the ordinal and end offset of an
+ *  item, separated by a space.
+ *
+ *  The journal is read when opened and is then used by two threads:
+ *  one reading input, which calls is_journalled, and one writing
+ *  output, which records completed items. Neither changes state used
+ *  by the other, so no lock is needed.
+ */
+typedef struct journal {
+    /** The journal file, open for appending. */
+    FILE *file;
+    /** The ordinal of the first item not recorded as complete. */
+    size_t resume_ordinal;
+    /** The end offset of the item before resume_ordinal, or -1 if
+        unknown. */
+    long resume_offset;
+    /** The ordinals greater than resume_ordinal recorded as complete,
+        in ascending order. */
+    size_t *completed;
+    /** The number of completed ordinals. */
+    size_t num_completed;
+    /** The index of the next completed ordinal to be checked. */
+    size_t next_completed;
+    /** Entries staged to be written on the next commit. */
+    journal_entry_t *staged;
+    /** The number of staged entries. */
+    size_t num_staged;
+    /** The capacity of the staged entries. */
+    size_t staged_capacity;
+    /** When the journal was last synchronised to disk. */
+    time_t last_sync;
+} journal_t;
+
+/**
+ * Open a journal, reading any entries from an earlier run and then
+ * opening the file for appending. The file is created if it does not
+ * exist. A partial entry at the end of the file, written by a run
+ * that was interrupted, is ignored.
+ *
+ * @param[out] journal      The journal to open.
+ * @param[in]  path         The journal file path.
+ * @param[out] error        An error report struct.
+ *
+ * @return 0 on success, error code on failure.
+ */
+int open_journal(journal_t *journal, const char *path, baton_error_t *error);
+
+/**
+ * Return true if an item was recorded as complete by an earlier run.
+ * Must be called with ascending ordinals.
+ *
+ * @param[in,out] journal   An open journal.
+ * @param[in]     ordinal   The position of an item in the input stream.
+ *
+ * @return 1 if the item is complete, otherwise 0.
+ */
+int is_journalled(journal_t *journal, size_t ordinal);
+
+/**
+ * Stage an item to be recorded as complete on the next commit.
+ *
+ * @param[in,out] journal   An open journal.
+ * @param[in]     entry     The item's journal entry.
+ *
+ * @return 0 on success, error code on failure.
+ */
+int stage_journal_entry(journal_t *journal, journal_entry_t entry,
+                        baton_error_t *error);
+
+/**
+ * Append any staged entries to the journal file and flush it. The file
+ * is synchronised to disk at most once every JOURNAL_SYNC_INTERVAL
+ * seconds, unless sync is true.
+ *
+ * @param[in,out] journal   An open journal.
+ * @param[in]     sync      If true, always synchronise to disk.
+ * @param[out]    error     An error report struct.
+ *
+ * @return 0 on success, error code on failure.
+ */
+int commit_journal(journal_t *journal, int sync, baton_error_t *error);
+
+/**
+ * Commit any staged entries, synchronise and close a journal.
+ *
+ * @param[in,out] journal   An open journal.
+ */
+void close_journal(journal_t *journal);
+
+#endif // _BATON_JOURNAL_H
@@ -1,6 +1,6 @@
 /**
- * Copyright (C) 2013, 2014, 2015, 2017, 2019, 2021, 2024, 2025 Genome
- * Research Ltd. All rights reserved.
+ * Copyright (C) 2013, 2014, 2015, 2017, 2019, 2021, 2024, 2025, 2026
+ * Genome Research Ltd. All rights reserved.
  *
  * This program is free software: you can redistribute it and/or modify
  * it under the terms of the GNU General Public License as published by
@@ -31,6 +31,7 @@
 #include <rodsClient.h>
 
 #include "config.h"
+#include "arena.h"
 #include "json.h"
 #include "log.h"
 #include "utilities.h"
@@ -312,6 +313,26 @@ error:
     return NULL;
 }
 
+size_t get_query_limit(const json_t *object, baton_error_t *error) {
+    init_baton_error(error);
+
+    // A query without a limit returns all its results
+    if (!has_query_limit(object)) return 0;
+
+    const json_t *value = json_object_get(object, JSON_LIMIT_KEY);
+    if (!json_is_integer(value) || json_integer_value(value) < 1) {
+        set_baton_error(error, CAT_INVALID_ARGUMENT,
+                        "Invalid '%s' attribute: not a positive "
+                        "JSON integer", JSON_LIMIT_KEY);
+        goto error;
+    }
+
+    return (size_t) json_integer_value(value);
+
+error:
+    return 0;
+}
+
 json_t *get_timestamps(const json_t *object, baton_error_t *error) {
     init_baton_error(error);
 
@@ -573,6 +594,34 @@ error:
     return NULL;
 }
 
+json_t *get_operation_targets(const json_t *envelope, baton_error_t *error) {
+    init_baton_error(error);
+
+    json_t *targets = get_json_value(envelope, "operation targets",
+                                     JSON_TARGETS_KEY, NULL, error);
+    if (error->code != 0) goto error;
+    if (!json_is_array(targets)) {
+        set_baton_error(error, CAT_INVALID_ARGUMENT,
+                        "Invalid '%s' attribute: not a JSON array",
+                        JSON_TARGETS_KEY);
+        goto error;
+    }
+
+    for (size_t i = 0; i < json_array_size(targets); i++) {
+        if (!json_is_object(json_array_get(targets, i))) {
+            set_baton_error(error, CAT_INVALID_ARGUMENT,
+                            "Invalid '%s' attribute: element %zu is not "
+                            "a JSON object", JSON_TARGETS_KEY, i);
+            goto error;
+        }
+    }
+
+    return targets;
+
+error:
+    return NULL;
+}
+
 int has_operation(const json_t *object) {
     return has_json_str_value(object, JSON_OP_KEY, JSON_OP_SHORT_KEY);
 }
@@ -590,10 +639,27 @@ int has_operation_target(const json_t *envelope) {
     return json_object_get(envelope, JSON_TARGET_KEY) != NULL;
 }
 
+int has_operation_targets(const json_t *envelope) {
+    return json_object_get(envelope, JSON_TARGETS_KEY) != NULL;
+}
+
 int has_op_path(const json_t *operation_args) {
     return json_object_get(operation_args, JSON_OP_PATH) != NULL;
 }
 
+int has_op_page_size(const json_t *operation_args) {
+    return json_object_get(operation_args, JSON_OP_PAGE_SIZE) != NULL;
+}
+
+int op_aggregate_p(const json_t *operation_args) {
+    return json_is_true(json_object_get(operation_args, JSON_OP_AGGREGATE));
+}
+
+int op_server_aggregate_p(const json_t *operation_args) {
+    return json_is_true(json_object_get(operation_args,
+                                        JSON_OP_SERVER_AGGREGATE));
+}
+
 int op_acl_p(const json_t *operation_args) {
     return json_is_true(json_object_get(operation_args, JSON_OP_ACL));
 }
@@ -676,6 +742,34 @@ const char *get_op_path(const json_t *operation_args, baton_error_t *error) {
                             JSON_OP_PATH, NULL, error);
 }
 
+size_t get_op_page_size(const json_t *operation_args, baton_error_t *error) {
+    init_baton_error(error);
+
+    const json_t *value = get_json_value(operation_args, "operation page size",
+                                         JSON_OP_PAGE_SIZE, NULL, error);
+    if (error->code != 0) goto error;
+
+    if (!json_is_integer(value)) {
+        set_baton_error(error, CAT_INVALID_ARGUMENT,
+                        "Invalid operation page size: not a JSON integer");
+        goto error;
+    }
+
+    const json_int_t page_size = json_integer_value(value);
+    if (page_size < 1 || page_size > MAX_SQL_ROWS) {
+        set_baton_error(error, CAT_INVALID_ARGUMENT,
+                        "Invalid operation page size %lld: must be "
+                        "between 1 and %d", (long long) page_size,
+                        MAX_SQL_ROWS);
+        goto error;
+    }
+
+    return (size_t) page_size;
+
+error:
+    return 0;
+}
+
 int has_checksum(const json_t *object) {
     baton_error_t error;
 
@@ -698,6 +792,11 @@ int has_acl(const json_t *object) {
     return json_object_get(object, JSON_ACCESS_KEY) != NULL;
 }
 
+int has_query_limit(const json_t *object) {
+    return json_is_object(object) &&
+        json_object_get(object, JSON_LIMIT_KEY) != NULL;
+}
+
 int has_timestamps(const json_t *object) {
     baton_error_t error;
 
@@ -1031,6 +1130,38 @@ error:
     return error->code;
 }
 
+int add_correlation_id(json_t *object, const json_t *source, size_t seq,
+                       baton_error_t *error) {
+    init_baton_error(error);
+
+    if (!json_is_object(object)) {
+        set_baton_error(error, -1, "Failed to add correlation ID: "
+                        "target not a JSON object");
+        goto error;
+    }
+
+    json_t *id = json_object_get(source, JSON_ID_KEY);
+    if (id) {
+        if (object != source && json_object_set(object, JSON_ID_KEY, id) < 0) {
+            set_baton_error(error, -1, "Failed to copy correlation ID");
+            goto error;
+        }
+    }
+    else {
+        json_t *seq_id = json_integer((json_int_t) seq);
+        if (json_object_set_new(object, JSON_ID_KEY, seq_id) < 0) {
+            set_baton_error(error, -1, "Failed to add correlation ID %zu",
+                            seq);
+            goto error;
+        }
+    }
+
+    return 0;
+
+error:
+    return error->code;
+}
+
 json_t *checksum_to_json(char *checksum, baton_error_t *error) {
     json_t *chksum = NULL;
 
@@ -1243,11 +1374,70 @@ error:
     return NULL;
 }
 
+int init_json_buffer(json_buffer_t *buffer, size_t capacity) {
+    buffer->length   = 0;
+    buffer->capacity = capacity;
+    buffer->data     = malloc(capacity);
+
+    return buffer->data ? 0 : -1;
+}
+
+static int json_buffer_callback(const char *str, size_t size, void *data) {
+    json_buffer_t *buffer = data;
+
+    if (buffer->length + size > buffer->capacity) {
+        size_t capacity = buffer->capacity > 0 ? buffer->capacity * 2 : size;
+        while (capacity < buffer->length + size) capacity *= 2;
+
+        char *tmp = realloc(buffer->data, capacity);
+        if (!tmp) return -1;
+
+        buffer->data     = tmp;
+        buffer->capacity = capacity;
+    }
+
+    memcpy(buffer->data + buffer->length, str, size);
+    buffer->length += size;
+
+    return 0;
+}
+
+int append_json_buffer(json_buffer_t *buffer, const json_t *json) {
+    const size_t length = buffer->length;
+
+    if (json_dump_callback(json, json_buffer_callback, buffer,
+                           JSON_INDENT(0) | JSON_SORT_KEYS) != 0 ||
+        json_buffer_callback("\n", 1, buffer) != 0) {
+        buffer->length = length; // Discard any partial output
+        return -1;
+    }
+
+    return 0;
+}
+
+int write_json_buffer(json_buffer_t *buffer, FILE *stream) {
+    const size_t length = buffer->length;
+    buffer->length = 0;
+
+    if (length > 0 && fwrite(buffer->data, 1, length, stream) != length) {
+        return -1;
+    }
+
+    return 0;
+}
+
+void free_json_buffer(json_buffer_t *buffer) {
+    if (buffer->data) free(buffer->data);
+    buffer->data     = NULL;
+    buffer->length   = 0;
+    buffer->capacity = 0;
+}
+
 void print_json_stream(const json_t *json, FILE *stream) {
     char *json_str = json_dumps(json, JSON_INDENT(0) | JSON_SORT_KEYS);
     if (json_str) {
         fprintf(stream, "%s\n", json_str);
-        free(json_str);
+        free_json_string(json_str);
     }
 }
 
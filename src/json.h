@@ -1,6 +1,6 @@
 /**
- * Copyright (C) 2013, 2014, 2015, 2017, 2019, 2021, 2024, 2025 Genome
- * Research Ltd. All rights reserved.
+ * Copyright (C) 2013, 2014, 2015, 2017, 2019, 2021, 2024, 2025, 2026
+ * Genome Research Ltd. All rights reserved.
  *
  * This program is free software: you can redistribute it and/or modify
  * it under the terms of the GNU General Public License as published by
@@ -87,6 +87,15 @@
 #define JSON_ARGS_SHORT_KEY        "?"
 #define JSON_ARG_META_ADD          "add"
 #define JSON_ARG_META_REM          "rem"
+#define JSON_LIMIT_KEY             "limit"
+#define JSON_COUNT_KEY             "count"
+#define JSON_TOTAL_SIZE_KEY        "total_size"
+#define JSON_MIN_SIZE_KEY          "min_size"
+#define JSON_MAX_SIZE_KEY          "max_size"
+#define JSON_MATCH_COUNT_KEY       "match_count"
+#define JSON_MATCH_TOTAL_SIZE_KEY  "match_total_size"
+#define JSON_MATCH_MIN_SIZE_KEY    "match_min_size"
+#define JSON_MATCH_MAX_SIZE_KEY    "match_max_size"
 
 // SQL specific query operations
 #define JSON_SPECIFIC_KEY          "specific"
@@ -95,11 +104,13 @@
 
 // baton operations
 #define JSON_TARGET_KEY            "target"
+#define JSON_TARGETS_KEY           "targets"
 #define JSON_RESULT_KEY            "result"
 #define JSON_SINGLE_RESULT_KEY     "single"
 #define JSON_MULTIPLE_RESULT_KEY   "multiple"
 #define JSON_OP_KEY                "operation"
 #define JSON_OP_SHORT_KEY          "op"
+#define JSON_ID_KEY                "id"
 
 #define JSON_CHMOD_OP              "chmod"
 #define JSON_CHECKSUM_OP           "checksum"
@@ -134,10 +145,26 @@
 #define JSON_OP_SIZE               "size"
 #define JSON_OP_TIMESTAMP          "timestamp"
 #define JSON_OP_PATH               "path"
+#define JSON_OP_PAGE_SIZE          "page_size"
+#define JSON_OP_AGGREGATE          "aggregate"
+#define JSON_OP_SERVER_AGGREGATE   "server_aggregate"
 
 #define VALID_REPLICATE   "1"
 #define INVALID_REPLICATE "0"
 
+/**
+ *  @struct json_buffer
+ *  @brief A reusable buffer of serialised JSON documents, one per line.
+ */
+typedef struct json_buffer {
+    /** The serialised JSON. */
+    char *data;
+    /** The number of bytes used. */
+    size_t length;
+    /** The number of bytes allocated. */
+    size_t capacity;
+} json_buffer_t;
+
 /**
  * Add a new property containing error information to a JSON object.
  *
@@ -201,10 +228,14 @@ json_t *get_specific(const json_t *object, baton_error_t *error);
  */
 json_t *get_timestamps(const json_t *object, baton_error_t *error);
 
+size_t get_query_limit(const json_t *object, baton_error_t *error);
+
 const char* get_query_collection(const json_t *object, baton_error_t *error);
 
 const char *get_collection_value(const json_t *object, baton_error_t *error);
 
+const char *get_data_object_value(const json_t *object, baton_error_t *error);
+
 const char *get_created_timestamp(const json_t *object, baton_error_t *error);
 
 const char *get_modified_timestamp(const json_t *object, baton_error_t *error);
@@ -251,16 +282,28 @@ json_t *get_operation_args(const json_t *envelope, baton_error_t *error);
 
 json_t *get_operation_target(const json_t *envelope, baton_error_t *error);
 
+json_t *get_operation_targets(const json_t *envelope, baton_error_t *error);
+
 const char *get_op_path(const json_t *operation_args, baton_error_t *error);
 
+size_t get_op_page_size(const json_t *operation_args, baton_error_t *error);
+
 int has_operation(const json_t *object);
 
 int has_operation_args(const json_t *object);
 
 int has_operation_target(const json_t *envelope);
 
+int has_operation_targets(const json_t *envelope);
+
 int has_op_path(const json_t *operation_args);
 
+int has_op_page_size(const json_t *operation_args);
+
+int op_aggregate_p(const json_t *operation_args);
+
+int op_server_aggregate_p(const json_t *operation_args);
+
 int op_acl_p(const json_t *operation_args);
 
 int op_avu_p(const json_t *operation_args);
@@ -303,6 +346,8 @@ int has_acl(const json_t *object);
 
 int has_timestamps(const json_t *object);
 
+int has_query_limit(const json_t *object);
+
 int has_created_timestamp(const json_t *object);
 
 int has_modified_timestamp(const json_t *object);
@@ -345,6 +390,22 @@ int add_checksum(json_t *object, json_t *checksum, baton_error_t *error);
  */
 int add_result(json_t *object, json_t *result, baton_error_t *error);
 
+/**
+ * Modify a JSON object by adding a property identifying the input
+ * item from which it was derived. If the source JSON has an "id"
+ * property, its value is used, otherwise the sequence number of the
+ * item in the input stream is used.
+ *
+ * @param[in] object         A JSON object.
+ * @param[in] source         The input JSON object.
+ * @param[in] seq            The sequence number of the input JSON object.
+ * @param[out] error         An error report struct.
+ *
+ * @return 0 on success, error code on failure.
+ */
+int add_correlation_id(json_t *object, const json_t *source, size_t seq,
+                       baton_error_t *error);
+
 int add_error_report(json_t *target, baton_error_t *error);
 
 json_t *make_timestamp(const char* key, const char *value, const char *format,
@@ -373,6 +434,39 @@ char *json_to_local_path(const json_t *object, baton_error_t *error);
 
 char *make_in_op_value(const json_t *avu, baton_error_t *error);
 
+/**
+ * Initialise a JSON buffer.
+ *
+ * @param[out] buffer        A JSON buffer.
+ * @param[in]  capacity      The initial capacity in bytes.
+ *
+ * @return 0 on success, -1 on error.
+ */
+int init_json_buffer(json_buffer_t *buffer, size_t capacity);
+
+/**
+ * Serialise a JSON value to the end of a JSON buffer, in the same
+ * format as print_json. The buffer grows if required.
+ *
+ * @param[in,out] buffer     A JSON buffer.
+ * @param[in]     json       A JSON value.
+ *
+ * @return 0 on success, -1 on error.
+ */
+int append_json_buffer(json_buffer_t *buffer, const json_t *json);
+
+/**
+ * Write the contents of a JSON buffer to a stream and empty the buffer.
+ *
+ * @param[in,out] buffer     A JSON buffer.
+ * @param[in]     stream     A stream.
+ *
+ * @return 0 on success, -1 on error.
+ */
+int write_json_buffer(json_buffer_t *buffer, FILE *stream);
+
+void free_json_buffer(json_buffer_t *buffer);
+
 void print_json_stream(const json_t *json, FILE *stream);
 
 void print_json(const json_t *json);
@@ -1,6 +1,6 @@
 /**
- * Copyright (C) 2013, 2014, 2015, 2016, 2019, 2021, 2023, 2025 Genome
- * Research Ltd. All rights reserved.
+ * Copyright (C) 2013, 2014, 2015, 2016, 2019, 2021, 2023, 2025, 2026
+ * Genome Research Ltd. All rights reserved.
  *
  * This program is free software: you can redistribute it and/or modify
  * it under the terms of the GNU General Public License as published by
@@ -20,11 +20,16 @@
  * @author Joshua C. Randall <jcrandall@alum.mit.edu>
  */
 
+#include <errno.h>
+#include <pthread.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 
 #include <jansson.h>
 
 #include "config.h"
+#include "arena.h"
 #include "baton.h"
 #include "json.h"
 #include "json_query.h"
@@ -133,11 +138,20 @@ static const char *revmap_access_level(const char *icat_level) {
 }
 
 #if IRODS_VERSION_INTEGER && IRODS_VERSION_INTEGER >= 4001008
-static json_t *list_resource(rcComm_t *conn, const char *resc_name,
-                      const char* zone_name, baton_error_t *error) {
+// Resources by zone name, each zone having an expiry time and its
+// resources by name. Shared by all threads and guarded by the mutex.
+static json_t *resource_cache = NULL;
+static pthread_mutex_t resource_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+#define RESOURCE_CACHE_EXPIRES_KEY   "expires"
+#define RESOURCE_CACHE_RESOURCES_KEY "resources"
+
+// Return all the resources in a zone, by name
+static json_t *list_zone_resources(rcComm_t *conn, const char* zone_name,
+                                   baton_error_t *error) {
     genQueryInp_t *query_in = NULL;
     json_t *results         = NULL;
-    json_t *resource        = NULL;
+    json_t *resources       = NULL;
 
     query_format_in_t obj_format =
         { .num_columns = 3,
@@ -148,34 +162,139 @@ static json_t *list_resource(rcComm_t *conn, const char *resc_name,
 
     init_baton_error(error);
 
-    query_in = make_query_input(SEARCH_MAX_ROWS, obj_format.num_columns,
+    const query_cond_t zn = { .column   = COL_R_ZONE_NAME,
+                              .operator = SEARCH_OP_EQUALS,
+                              .value    = zone_name };
+
+    query_in = make_query_input(get_query_page_size(), obj_format.num_columns,
                                 obj_format.columns);
-    query_in = prepare_resc_list(query_in, resc_name, zone_name);
+    query_in = add_query_conds(query_in, 1, (query_cond_t []) { zn });
 
     addKeyVal(&query_in->condInput, ZONE_KW, zone_name);
     results = do_query(conn, query_in, obj_format.labels, error);
     if (error->code != 0) goto error;
 
-    if (json_array_size(results) != 1) {
-        set_baton_error(error, -1, "Expected 1 resource result but found %d",
-                        json_array_size(results));
+    resources = json_object();
+    if (!resources) {
+        set_baton_error(error, -1, "Failed to allocate a new JSON object");
         goto error;
     }
 
-    resource = json_incref(json_array_get(results, 0));
+    size_t index;
+    json_t *resource;
+    json_array_foreach(results, index, resource) {
+        const char *resc_name =
+            json_string_value(json_object_get(resource, JSON_RESOURCE_KEY));
+        if (resc_name) json_object_set(resources, resc_name, resource);
+    }
+
+    logmsg(DEBUG, "Listed %zu resources in zone '%s'",
+           json_object_size(resources), zone_name);
 
     free_query_input(query_in);
-    json_array_clear(results);
     json_decref(results);
 
+    return resources;
+
+error:
+    logmsg(ERROR, "Failed to list resources in zone '%s': error %d %s",
+           zone_name, error->code, error->message);
+
+    if (query_in)  free_query_input(query_in);
+    if (results)   json_decref(results);
+    if (resources) json_decref(resources);
+
+    return NULL;
+}
+
+// Return a copy of a cached resource, or NULL if it is not cached or
+// its zone has expired
+static json_t *get_cached_resource(const char *resc_name,
+                                   const char *zone_name,
+                                   const time_t now) {
+    json_t *resource = NULL;
+
+    pthread_mutex_lock(&resource_cache_mutex);
+
+    const json_t *zone = json_object_get(resource_cache, zone_name);
+    const json_t *expires = json_object_get(zone, RESOURCE_CACHE_EXPIRES_KEY);
+    if (zone && json_integer_value(expires) > now) {
+        const json_t *resources =
+            json_object_get(zone, RESOURCE_CACHE_RESOURCES_KEY);
+        json_t *cached = json_object_get(resources, resc_name);
+        if (cached) resource = json_deep_copy(cached);
+    }
+
+    pthread_mutex_unlock(&resource_cache_mutex);
+
+    return resource;
+}
+
+// Return a resource, listing all the resources in its zone and caching
+// them for RESOURCE_CACHE_TTL seconds if it is not already cached. A
+// zone has few resources, which are shared by many replicates. The
+// cache outlives any item's arena, so it is built with malloc.
+static json_t *list_resource(rcComm_t *conn, const char *resc_name,
+                             const char* zone_name, baton_error_t *error) {
+    json_t *resources = NULL;
+    json_t *zone      = NULL;
+    arena_t *previous = NULL;
+    struct timespec now;
+
+    init_baton_error(error);
+
+    if (!zone_name) {
+        set_baton_error(error, CAT_INVALID_ARGUMENT,
+                        "Failed to list resource '%s': no zone name",
+                        resc_name);
+        goto error;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    json_t *resource = get_cached_resource(resc_name, zone_name, now.tv_sec);
+    if (resource) return resource;
+
+    previous = set_thread_arena(NULL);
+    resources = list_zone_resources(conn, zone_name, error);
+    set_thread_arena(previous);
+    if (error->code != 0) goto error;
+
+    // The copy returned belongs to the caller, so it may use the arena
+    resource = json_object_get(resources, resc_name);
+    if (resource) resource = json_deep_copy(resource);
+
+    previous = set_thread_arena(NULL);
+    zone = json_pack("{s:I, s:o}",
+                     RESOURCE_CACHE_EXPIRES_KEY,
+                     (json_int_t) (now.tv_sec + RESOURCE_CACHE_TTL),
+                     RESOURCE_CACHE_RESOURCES_KEY, resources);
+    resources = NULL; // Stolen by the pack, even on failure
+    if (!zone) {
+        set_thread_arena(previous);
+        set_baton_error(error, -1, "Failed to pack resources of zone '%s' "
+                        "as JSON", zone_name);
+        goto error;
+    }
+
+    pthread_mutex_lock(&resource_cache_mutex);
+    if (!resource_cache) resource_cache = json_object();
+    json_object_set_new(resource_cache, zone_name, zone);
+    pthread_mutex_unlock(&resource_cache_mutex);
+    set_thread_arena(previous);
+
+    if (!resource) {
+        set_baton_error(error, -1, "Expected 1 resource result but found 0");
+        goto error;
+    }
+
     return resource;
 
 error:
     logmsg(ERROR, "Failed to list resource '%s': error %d %s",
            resc_name, error->code, error->message);
 
-    if (query_in) free_query_input(query_in);
-    if (results)  json_decref(results);
+    if (resources) json_decref(resources);
 
     return NULL;
 }
@@ -195,6 +314,15 @@ static const char *resource_hierarchy_leaf(const char *hierarchy) {
 }
 #endif
 
+void clear_resource_cache(void) {
+#if IRODS_VERSION_INTEGER && IRODS_VERSION_INTEGER >= 4001008
+    pthread_mutex_lock(&resource_cache_mutex);
+    if (resource_cache) json_decref(resource_cache);
+    resource_cache = NULL;
+    pthread_mutex_unlock(&resource_cache_mutex);
+#endif
+}
+
 void log_json_error(const log_level level, json_error_t *error) {
     logmsg(level, "JSON error: %s, line %d, column %d, position %d",
            error->text, error->line, error->column, error->position);
@@ -239,34 +367,125 @@ error:
     return NULL;
 }
 
-json_t *do_search(rcComm_t *conn, char *zone_name, const json_t *query,
-                  query_format_in_t *format,
-                  const prepare_avu_search_cb prepare_avu,
-                  const prepare_acl_search_cb prepare_acl,
-                  const prepare_tps_search_cb prepare_cre,
-                  const prepare_tps_search_cb prepare_mod,
-                  baton_error_t *error) {
+static int next_page_size(const int max_rows, const struct timespec *start) {
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    const double latency = (double) (end.tv_sec - start->tv_sec) +
+        (double) (end.tv_nsec - start->tv_nsec) / 1e9;
+    const size_t page_size = adapt_page_size((size_t) max_rows, latency);
+
+    if (page_size != (size_t) max_rows) {
+        logmsg(DEBUG, "Page fetched in %.3f s; changing page size "
+               "from %d to %zu rows", latency, max_rows, page_size);
+    }
+
+    return (int) page_size;
+}
+
+// Return the number of rows to request in the next page of a query,
+// so that no more than limit rows are fetched in total
+static int limit_page_size(const int max_rows, const size_t limit,
+                           const size_t num_rows) {
+    if (limit == 0 || limit - num_rows >= (size_t) max_rows) return max_rows;
+
+    return (int) (limit - num_rows);
+}
+
+// Remove any rows of a page beyond limit, given the number of rows
+// already visited. Returns true if the limit has been reached.
+static int limit_rows(json_t *rows, const size_t limit,
+                      const size_t num_rows) {
+    if (limit == 0) return 0;
+
+    while (json_array_size(rows) > 0 &&
+           num_rows + json_array_size(rows) > limit) {
+        json_array_remove(rows, json_array_size(rows) - 1);
+    }
+
+    return num_rows + json_array_size(rows) >= limit;
+}
+
+// Close the server-side statement of a query before all its results
+// have been fetched, by requesting a page of no rows
+static void close_query(rcComm_t *conn, genQueryInp_t *query_in) {
+    genQueryOut_t *query_out = NULL;
+
+    query_in->maxRows = 0;
+    const int status = rcGenQuery(conn, query_in, &query_out);
+    if (query_out) free_query_output(query_out);
+
+    if (status != 0 && status != CAT_NO_ROWS_FOUND) {
+        logmsg(WARN, "Failed to close query early: error %d", status);
+    }
+    else {
+        logmsg(DEBUG, "Closed query early");
+    }
+}
+
+static void close_squery(rcComm_t *conn, specificQueryInp_t *squery_in) {
+    genQueryOut_t *query_out = NULL;
+
+    squery_in->maxRows = 0;
+    const int status = rcSpecificQuery(conn, squery_in, &query_out);
+    if (query_out) free_query_output(query_out);
+
+    if (status != 0 && status != CAT_NO_ROWS_FOUND) {
+        logmsg(WARN, "Failed to close specific query early: error %d",
+               status);
+    }
+    else {
+        logmsg(DEBUG, "Closed specific query early");
+    }
+}
+
+int append_query_rows(json_t *rows, void *data, baton_error_t *error) {
+    json_t *results = data;
+
+    init_baton_error(error);
+
+    const int status = json_array_extend(results, rows);
+    if (status != 0) {
+        set_baton_error(error, status,
+                        "Failed to add JSON query result to total: "
+                        "error %d", status);
+    }
+
+    return error->code;
+}
+
+int visit_search(rcComm_t *conn, char *zone_name, const json_t *query,
+                 query_format_in_t *format,
+                 const prepare_avu_search_cb prepare_avu,
+                 const prepare_acl_search_cb prepare_acl,
+                 const prepare_tps_search_cb prepare_cre,
+                 const prepare_tps_search_cb prepare_mod,
+                 const size_t limit, const query_visitor visit, void *data,
+                 baton_error_t *error) {
     genQueryInp_t *query_in = NULL;
     char *zone_hint         = zone_name;
     char *root_path         = NULL;
-    json_t *items           = NULL;
 
     init_baton_error(error);
 
     if (represents_collection(query)) {
         root_path = json_to_path(query, error);
         logmsg(DEBUG, "Query represents a collection: '%s'", root_path);
-        if (error->code != 0) goto error;
+        if (error->code != 0) goto finally;
     }
 
-    query_in = make_query_input(SEARCH_MAX_ROWS, format->num_columns,
+    query_in = make_query_input(get_query_page_size(), format->num_columns,
                                 format->columns);
 
+    for (size_t i = 0; i < format->num_columns; i++) {
+        query_in->selectInp.value[i] = format->modifiers[i];
+    }
+
     if (root_path) {
         rodsPath_t rods_path;
 
         set_rods_path(conn, &rods_path, root_path, error);
-        if (error->code != 0) goto error;
+        if (error->code != 0) goto finally;
 
         if (str_starts_with(root_path, "/", MAX_STR_LEN)) {
             // Is search path just a zone hint? e.g. "/seq"
@@ -287,33 +506,38 @@ json_t *do_search(rcComm_t *conn, char *zone_name, const json_t *query,
 
     // AVUs are mandatory for searches
     const json_t *avus = get_avus(query, error);
-    if (error->code != 0) goto error;
+    if (error->code != 0) goto finally;
 
     query_in = prepare_json_avu_search(query_in, avus, prepare_avu, error);
-    if (error->code != 0) goto error;
+    if (error->code != 0) goto finally;
 
     // Report good replicates only
     if (format->good_repl) {
         query_in = limit_to_good_repl(query_in);
     }
 
+    // Report one replicate of each data object
+    if (format->first_repl) {
+        query_in = limit_to_first_repl(query_in);
+    }
+
     // ACL is optional
     if (has_acl(query)) {
         const json_t *acl = get_acl(query, error);
-        if (error->code != 0) goto error;
+        if (error->code != 0) goto finally;
 
         query_in = prepare_json_acl_search(query_in, acl, prepare_acl, error);
-        if (error->code != 0) goto error;
+        if (error->code != 0) goto finally;
     }
 
     // Timestamp is optional
     if (has_timestamps(query)) {
         const json_t *tps = get_timestamps(query, error);
-        if (error->code != 0) goto error;
+        if (error->code != 0) goto finally;
 
         query_in = prepare_json_tps_search(query_in, tps, prepare_cre,
                                            prepare_mod, error);
-        if (error->code != 0) goto error;
+        if (error->code != 0) goto finally;
     }
 
     if (zone_hint) {
@@ -321,19 +545,44 @@ json_t *do_search(rcComm_t *conn, char *zone_name, const json_t *query,
         addKeyVal(&query_in->condInput, ZONE_KW, zone_hint);
     }
 
-    items = do_query(conn, query_in, format->labels, error);
-    if (error->code != 0) goto error;
+    visit_query(conn, query_in, format->labels, limit, visit, data, error);
 
+finally:
     if (root_path) free(root_path);
-    free_query_input(query_in);
+    if (query_in)  free_query_input(query_in);
+
+    return error->code;
+}
+
+json_t *do_search(rcComm_t *conn, char *zone_name, const json_t *query,
+                  query_format_in_t *format,
+                  const prepare_avu_search_cb prepare_avu,
+                  const prepare_acl_search_cb prepare_acl,
+                  const prepare_tps_search_cb prepare_cre,
+                  const prepare_tps_search_cb prepare_mod,
+                  baton_error_t *error) {
+    init_baton_error(error);
+
+    json_t *items = json_array();
+    if (!items) {
+        set_baton_error(error, -1, "Failed to allocate a new JSON array");
+        goto error;
+    }
+
+    const size_t limit = get_query_limit(query, error);
+    if (error->code != 0) goto error;
+
+    visit_search(conn, zone_name, query, format, prepare_avu, prepare_acl,
+                 prepare_cre, prepare_mod, limit, append_query_rows, items,
+                 error);
+    if (error->code != 0) goto error;
+
     logmsg(TRACE, "Found %d matching items", json_array_size(items));
 
     return items;
 
 error:
-    if (root_path) free(root_path);
-    if (query_in)  free_query_input(query_in);
-    if (items)     json_decref(items);
+    if (items) json_decref(items);
 
     return NULL;
 }
@@ -364,7 +613,17 @@ json_t *do_specific(rcComm_t *conn, char *zone_name, const json_t *query,
         addKeyVal(&squery_in->condInput, ZONE_KW, zone_name);
     }
 
-    items = do_squery(conn, squery_in, format, error);
+    const size_t limit = get_query_limit(query, error);
+    if (error->code != 0) goto error;
+
+    items = json_array();
+    if (!items) {
+        set_baton_error(error, -1, "Failed to allocate a new JSON array");
+        goto error;
+    }
+
+    visit_squery(conn, squery_in, format, limit, append_query_rows, items,
+                 error);
     if (error->code != 0) goto error;
 
     free_squery_input(squery_in);
@@ -381,30 +640,36 @@ error:
     return NULL;
 }
 
-json_t *do_query(rcComm_t *conn, genQueryInp_t *query_in,
-                 const char *labels[], baton_error_t *error) {
+int visit_query(rcComm_t *conn, genQueryInp_t *query_in,
+                const char *labels[], const size_t limit,
+                const query_visitor visit, void *data, baton_error_t *error) {
     genQueryOut_t *query_out = NULL;
     size_t chunk_num  = 0;
+    size_t num_rows   = 0;
     int continue_flag = 0;
 
     init_baton_error(error);
 
-    json_t *results = json_array();
-    if (!results) {
-        set_baton_error(error, -1, "Failed to allocate a new JSON array");
-        goto error;
-    }
-
     logmsg(DEBUG, "Running query ...");
 
+    const int adaptive = is_adaptive_page_size();
+    struct timespec start;
+
     while (chunk_num == 0 || continue_flag > 0) {
         logmsg(DEBUG, "Attempting to get chunk %d of query", chunk_num);
 
+        query_in->maxRows = limit_page_size(query_in->maxRows, limit, num_rows);
+
+        if (adaptive) clock_gettime(CLOCK_MONOTONIC, &start);
         int status = rcGenQuery(conn, query_in, &query_out);
 
         if (status == 0) {
             logmsg(DEBUG, "Successfully fetched chunk %d of query", chunk_num);
 
+            if (adaptive) {
+                query_in->maxRows = next_page_size(query_in->maxRows, &start);
+            }
+
             if (!query_out) {
                 set_baton_error(error, -1,
                                 "Query result unexpectedly NULL "
@@ -430,17 +695,24 @@ json_t *do_query(rcComm_t *conn, genQueryInp_t *query_in,
                    chunk_num, json_array_size(chunk));
             chunk_num++;
 
-            status = json_array_extend(results, chunk);
+            const int limit_reached = limit_rows(chunk, limit, num_rows);
+            num_rows += json_array_size(chunk);
+
+            free_query_output(query_out);
+            query_out = NULL;
+
+            // The page is released before the next is fetched
+            visit(chunk, data, error);
             json_decref(chunk);
 
-            if (status != 0) {
-                set_baton_error(error, status,
-                                "Failed to add JSON query result to total: "
-                                "in chunk %d error %d", chunk_num, status);
-                goto error;
-            }
+            if (error->code != 0 || limit_reached) {
+                // Release the server's statement if results remain
+                if (continue_flag > 0) close_query(conn, query_in);
+                if (error->code != 0) goto error;
 
-            free_query_output(query_out);
+                logmsg(DEBUG, "Reached the limit of %zu results", limit);
+                break;
+            }
         }
         else if (status == CAT_NO_ROWS_FOUND && chunk_num > 0) {
             // Oddly CAT_NO_ROWS_FOUND is also returned at the end of a
@@ -464,10 +736,10 @@ json_t *do_query(rcComm_t *conn, genQueryInp_t *query_in,
         }
     }
 
-    logmsg(DEBUG, "Obtained a total of %d JSON results in %d chunks",
-           chunk_num, json_array_size(results));
+    logmsg(DEBUG, "Obtained a total of %zu JSON results in %zu chunks",
+           num_rows, chunk_num);
 
-    return results;
+    return error->code;
 
 error:
     if (conn->rError) {
@@ -479,35 +751,64 @@ error:
     }
 
     if (query_out) free_query_output(query_out);
-    if (results)   json_decref(results);
+
+    return error->code;
+}
+
+json_t *do_query(rcComm_t *conn, genQueryInp_t *query_in,
+                 const char *labels[], baton_error_t *error) {
+    init_baton_error(error);
+
+    json_t *results = json_array();
+    if (!results) {
+        set_baton_error(error, -1, "Failed to allocate a new JSON array");
+        goto error;
+    }
+
+    visit_query(conn, query_in, labels, 0, append_query_rows, results,
+                error);
+    if (error->code != 0) goto error;
+
+    return results;
+
+error:
+    if (results) json_decref(results);
 
     return NULL;
 }
 
-json_t *do_squery(rcComm_t *conn, specificQueryInp_t *squery_in,
-                  query_format_in_t *labels,
-                  baton_error_t *error) {
+int visit_squery(rcComm_t *conn, specificQueryInp_t *squery_in,
+                 query_format_in_t *labels, const size_t limit,
+                 const query_visitor visit, void *data,
+                 baton_error_t *error) {
     genQueryOut_t *query_out = NULL;
     size_t chunk_num  = 0;
+    size_t num_rows   = 0;
     int continue_flag = 0;
 
     char *err_subname;
 
-    json_t *results = json_array();
-    if (!results) {
-        set_baton_error(error, -1, "Failed to allocate a new JSON array");
-        goto error;
-    }
+    init_baton_error(error);
 
     logmsg(DEBUG, "Running specific query ...");
 
+    const int adaptive = is_adaptive_page_size();
+    struct timespec start;
+
     while (chunk_num == 0 || continue_flag > 0) {
         logmsg(DEBUG, "Attempting to get chunk %d of query", chunk_num);
 
+        squery_in->maxRows = limit_page_size(squery_in->maxRows, limit, num_rows);
+
+        if (adaptive) clock_gettime(CLOCK_MONOTONIC, &start);
         int status = rcSpecificQuery(conn, squery_in, &query_out);
         if (status == 0) {
             logmsg(DEBUG, "Successfully fetched chunk %d of query", chunk_num);
 
+            if (adaptive) {
+                squery_in->maxRows = next_page_size(squery_in->maxRows, &start);
+            }
+
             // Allows query_out to be freed
             continue_flag = query_out->continueInx;
 
@@ -526,17 +827,23 @@ json_t *do_squery(rcComm_t *conn, specificQueryInp_t *squery_in,
                    chunk_num, json_array_size(chunk));
             chunk_num++;
 
-            status = json_array_extend(results, chunk);
+            const int limit_reached = limit_rows(chunk, limit, num_rows);
+            num_rows += json_array_size(chunk);
+
+            free_query_output(query_out);
+            query_out = NULL;
+
+            visit(chunk, data, error);
             json_decref(chunk);
 
-            if (status != 0) {
-                set_baton_error(error, status,
-                                "Failed to add JSON query result to total: "
-                                "in chunk %d error %d", chunk_num, status);
-                goto error;
-            }
+            if (error->code != 0 || limit_reached) {
+                // Release the server's statement if results remain
+                if (continue_flag > 0) close_squery(conn, squery_in);
+                if (error->code != 0) goto error;
 
-            if (query_out) free_query_output(query_out);
+                logmsg(DEBUG, "Reached the limit of %zu results", limit);
+                break;
+            }
         }
         else if (status == CAT_NO_ROWS_FOUND && chunk_num > 0) {
             // Oddly CAT_NO_ROWS_FOUND is also returned at the end of a
@@ -560,10 +867,10 @@ json_t *do_squery(rcComm_t *conn, specificQueryInp_t *squery_in,
         }
     }
 
-    logmsg(DEBUG, "Obtained a total of %d JSON results in %d chunks",
-           chunk_num, json_array_size(results));
+    logmsg(DEBUG, "Obtained a total of %zu JSON results in %zu chunks",
+           num_rows, chunk_num);
 
-    return results;
+    return error->code;
 
 error:
     if (conn->rError) {
@@ -575,7 +882,29 @@ error:
     }
 
     if (query_out) free_query_output(query_out);
-    if (results)   json_decref(results);
+
+    return error->code;
+}
+
+json_t *do_squery(rcComm_t *conn, specificQueryInp_t *squery_in,
+                  query_format_in_t *labels,
+                  baton_error_t *error) {
+    init_baton_error(error);
+
+    json_t *results = json_array();
+    if (!results) {
+        set_baton_error(error, -1, "Failed to allocate a new JSON array");
+        goto error;
+    }
+
+    visit_squery(conn, squery_in, labels, 0, append_query_rows, results,
+                 error);
+    if (error->code != 0) goto error;
+
+    return results;
+
+error:
+    if (results) json_decref(results);
 
     return NULL;
 }
@@ -864,8 +1193,342 @@ error:
     return query_in;
 }
 
-json_t *add_checksum_json_object(rcComm_t *conn, json_t *object,
-                                 baton_error_t *error) {
+// Add to a query any conditions beyond collection and data object
+// name needed to enrich data objects
+typedef genQueryInp_t *(*enrich_prepare) (genQueryInp_t *query_in);
+
+// Add to a data object the rows found for it by an enrichment query.
+// The rows are shared by all the data objects of the same name and
+// must be copied if they are to be kept.
+typedef int (*enrich_join) (rcComm_t *conn, json_t *object, json_t *rows,
+                            baton_error_t *error);
+
+// Enrich a single data object, as a fallback. The data object is
+// trusted to exist, having been found by a query.
+typedef json_t *(*enrich_fallback) (rcComm_t *conn, json_t *object,
+                                    int trusted, baton_error_t *error);
+
+static genQueryInp_t *limit_to_access_namespace(genQueryInp_t *query_in) {
+    const query_cond_t tn = { .column   = COL_DATA_TOKEN_NAMESPACE,
+                              .operator = SEARCH_OP_EQUALS,
+                              .value    = ACCESS_NAMESPACE };
+
+    return add_query_conds(query_in, 1, (query_cond_t []) { tn });
+}
+
+// Query the rows for a batch of data objects in one collection and
+// hash join them to the data objects by name. The batch maps each data
+// object name to an array of the data objects having that name.
+static int enrich_batch(rcComm_t *conn, const char *coll_name, json_t *batch,
+                        query_format_in_t *format, enrich_prepare prepare,
+                        enrich_join join, baton_error_t *error) {
+    genQueryInp_t *query_in = NULL;
+    json_t *rows            = NULL;
+    json_t *matched         = NULL;
+    char *in_value          = NULL;
+    const char *names[MAX_LIST_BATCH_SIZE];
+    size_t num_names = 0;
+
+    init_baton_error(error);
+
+    const char *name;
+    json_t *objects;
+    json_object_foreach(batch, name, objects) {
+        names[num_names++] = name;
+    }
+
+    in_value = make_in_value(names, num_names);
+    if (!in_value) {
+        set_baton_error(error, errno, "Failed to allocate memory: "
+                        "error %d %s", errno, strerror(errno));
+        goto error;
+    }
+
+    const query_cond_t cn = { .column   = COL_COLL_NAME,
+                              .operator = SEARCH_OP_EQUALS,
+                              .value    = coll_name };
+    const query_cond_t dn = { .column   = COL_DATA_NAME,
+                              .operator = SEARCH_OP_IN,
+                              .value    = in_value };
+
+    query_in = make_query_input(get_query_page_size(), format->num_columns,
+                                format->columns);
+    query_in = add_query_conds(query_in, 2, (query_cond_t []) { cn, dn });
+    if (prepare) query_in = prepare(query_in);
+
+    addKeyVal(&query_in->condInput, ZONE_KW, coll_name);
+    logmsg(DEBUG, "Using zone hint '%s'", coll_name);
+
+    rows = do_query(conn, query_in, format->labels, error);
+    if (error->code != 0) goto error;
+
+    matched = json_object();
+    if (!matched) {
+        set_baton_error(error, -1, "Failed to allocate a new JSON object");
+        goto error;
+    }
+
+    size_t index;
+    json_t *row;
+    json_array_foreach(rows, index, row) {
+        const char *row_name =
+            json_string_value(json_object_get(row, JSON_DATA_OBJECT_KEY));
+        if (!row_name) continue;
+
+        json_t *name_rows = json_object_get(matched, row_name);
+        if (!name_rows) {
+            name_rows = json_array();
+            json_object_set_new(matched, row_name, name_rows);
+        }
+
+        json_array_append(name_rows, row);
+        json_object_del(row, JSON_DATA_OBJECT_KEY);
+    }
+
+    json_object_foreach(batch, name, objects) {
+        json_t *name_rows = json_object_get(matched, name);
+        if (!name_rows) {
+            name_rows = json_array();
+            json_object_set_new(matched, name, name_rows);
+        }
+
+        json_t *object;
+        json_array_foreach(objects, index, object) {
+            join(conn, object, name_rows, error);
+            if (error->code != 0) goto error;
+        }
+    }
+
+    logmsg(DEBUG, "Enriched %zu data objects in '%s' with one query",
+           num_names, coll_name);
+
+    free_query_input(query_in);
+    json_decref(rows);
+    json_decref(matched);
+    free(in_value);
+
+    return error->code;
+
+error:
+    logmsg(ERROR, "Failed to enrich data objects in '%s': error %d %s",
+           coll_name, error->code, error->message);
+
+    if (query_in) free_query_input(query_in);
+    if (rows)     json_decref(rows);
+    if (matched)  json_decref(matched);
+    if (in_value) free(in_value);
+
+    return error->code;
+}
+
+// Enrich the data objects in an array, grouping them by collection so
+// that each batch of up to MAX_LIST_BATCH_SIZE names in a collection
+// costs one query, rather than a path lookup and a query per data
+// object. Data objects whose paths cannot be quoted in a query
+// condition fall back to being enriched one at a time.
+static int enrich_data_objects(rcComm_t *conn, json_t *array,
+                               query_format_in_t *format,
+                               enrich_prepare prepare, enrich_join join,
+                               enrich_fallback fallback,
+                               baton_error_t *error) {
+    json_t *groups = NULL;
+    json_t *batch  = NULL;
+
+    init_baton_error(error);
+
+    groups = json_object();
+    if (!groups) {
+        set_baton_error(error, -1, "Failed to allocate a new JSON object");
+        goto error;
+    }
+
+    // Group by collection, then by data object name
+    size_t i;
+    json_t *item;
+    json_array_foreach(array, i, item) {
+        if (!represents_data_object(item)) continue;
+
+        const char *coll_name = get_collection_value(item, error);
+        if (error->code != 0) goto error;
+        const char *data_name = get_data_object_value(item, error);
+        if (error->code != 0) goto error;
+
+        if (strchr(coll_name, '\'') || strchr(data_name, '\'')) {
+            fallback(conn, item, 1, error);
+            if (error->code != 0) goto error;
+            continue;
+        }
+
+        json_t *group = json_object_get(groups, coll_name);
+        if (!group) {
+            group = json_object();
+            json_object_set_new(groups, coll_name, group);
+        }
+
+        json_t *objects = json_object_get(group, data_name);
+        if (!objects) {
+            objects = json_array();
+            json_object_set_new(group, data_name, objects);
+        }
+
+        json_array_append(objects, item);
+    }
+
+    const char *coll_name;
+    json_t *group;
+    json_object_foreach(groups, coll_name, group) {
+        const char *data_name;
+        json_t *objects;
+        json_object_foreach(group, data_name, objects) {
+            if (!batch) {
+                batch = json_object();
+                if (!batch) {
+                    set_baton_error(error, -1,
+                                    "Failed to allocate a new JSON object");
+                    goto error;
+                }
+            }
+
+            json_object_set(batch, data_name, objects);
+
+            if (json_object_size(batch) == MAX_LIST_BATCH_SIZE) {
+                enrich_batch(conn, coll_name, batch, format, prepare, join,
+                             error);
+                if (error->code != 0) goto error;
+
+                json_decref(batch);
+                batch = NULL;
+            }
+        }
+
+        if (batch) {
+            enrich_batch(conn, coll_name, batch, format, prepare, join,
+                         error);
+            if (error->code != 0) goto error;
+
+            json_decref(batch);
+            batch = NULL;
+        }
+    }
+
+    json_decref(groups);
+
+    return error->code;
+
+error:
+    if (groups) json_decref(groups);
+    if (batch)  json_decref(batch);
+
+    return error->code;
+}
+
+static int join_replicates(rcComm_t *conn, json_t *object, json_t *rows,
+                           baton_error_t *error) {
+    json_t *replicates = revmap_replicate_results(conn, rows, error);
+    if (error->code != 0) return error->code;
+
+    return add_replicates(object, replicates, error);
+}
+
+int add_replicate_timestamps(json_t *object, const json_t *raw_timestamps,
+                             baton_error_t *error) {
+    json_t *timestamps = json_array();
+
+    init_baton_error(error);
+
+    if (!timestamps) {
+        set_baton_error(error, -1, "Failed to allocate a new JSON array");
+        goto error;
+    }
+
+    // We report timestamps only on data objects. They exist on
+    // collections too, but we don't report them to be consistent with
+    // the 'ils' command.
+    if (represents_data_object(object)) {
+        size_t i;
+        json_t *item;
+        json_array_foreach(raw_timestamps, i, item) {
+            const char *repl_num = get_replicate_num(item, error);
+            if (error->code != 0) goto error;
+            const char *created = get_created_timestamp(item, error);
+            if (error->code != 0) goto error;
+            const char *modified = get_modified_timestamp(item, error);
+            if (error->code != 0) goto error;
+
+            json_t *iso_created =
+                make_timestamp(JSON_CREATED_KEY, created, RFC3339_FORMAT,
+                               repl_num, error);
+            if (error->code != 0) goto error;
+
+            json_t *iso_modified =
+                make_timestamp(JSON_MODIFIED_KEY, modified, RFC3339_FORMAT,
+                               repl_num, error);
+            if (error->code != 0) goto error;
+
+            json_array_append_new(timestamps, iso_created);
+            json_array_append_new(timestamps, iso_modified);
+
+            logmsg(DEBUG, "Adding timestamps from replicate %s", repl_num);
+        }
+    }
+
+    json_object_set_new(object, JSON_TIMESTAMPS_KEY, timestamps);
+
+    return error->code;
+
+error:
+    if (timestamps) json_decref(timestamps);
+
+    return error->code;
+}
+
+static int join_timestamps(rcComm_t *conn, json_t *object, json_t *rows,
+                           baton_error_t *error) {
+    conn = conn; // Silence unused parameter warning
+
+    return add_replicate_timestamps(object, rows, error);
+}
+
+static int join_avus(rcComm_t *conn, json_t *object, json_t *rows,
+                     baton_error_t *error) {
+    conn = conn; // Silence unused parameter warning
+
+    return add_metadata(object, json_deep_copy(rows), error);
+}
+
+static int join_acl(rcComm_t *conn, json_t *object, json_t *rows,
+                    baton_error_t *error) {
+    conn = conn; // Silence unused parameter warning
+
+    json_t *perms = json_deep_copy(rows);
+    revmap_access_result(perms, error);
+    if (error->code != 0) {
+        json_decref(perms);
+        return error->code;
+    }
+
+    return add_permissions(object, perms, error);
+}
+
+// Set the iRODS path of a JSON item. A trusted item, found by a
+// query, is not resolved on the server again.
+static int resolve_item_path(rcComm_t *conn, rodsPath_t *rods_path,
+                             const json_t *object, char *path,
+                             const int trusted, baton_error_t *error) {
+    if (trusted) {
+        const int obj_type =
+            represents_data_object(object) ? DATA_OBJ_T : COLL_OBJ_T;
+        set_trusted_rods_path(rods_path, path, obj_type, error);
+    }
+    else {
+        set_rods_path(conn, rods_path, path, error);
+    }
+
+    return error->code;
+}
+
+static json_t *add_checksum_json(rcComm_t *conn, json_t *object,
+                                 const int trusted, baton_error_t *error) {
     char *path = NULL;
     rodsPath_t rods_path;
 
@@ -880,7 +1543,7 @@ json_t *add_checksum_json_object(rcComm_t *conn, json_t *object,
     path = json_to_path(object, error);
     if (error->code != 0) goto error;
 
-    set_rods_path(conn, &rods_path, path, error);
+    resolve_item_path(conn, &rods_path, object, path, trusted, error);
     if (error->code != 0) goto error;
 
     json_t *checksum = list_checksum(conn, &rods_path, error);
@@ -901,6 +1564,25 @@ error:
     return NULL;
 }
 
+json_t *add_checksum_json_object(rcComm_t *conn, json_t *object,
+                                 baton_error_t *error) {
+    return add_checksum_json(conn, object, 0, error);
+}
+
+static int join_checksum(rcComm_t *conn, json_t *object, json_t *rows,
+                         baton_error_t *error) {
+    // Anything other than one row is reported by the single object
+    // query, e.g. good replicates with differing checksums
+    if (json_array_size(rows) != 1) {
+        add_checksum_json(conn, object, 1, error);
+        return error->code;
+    }
+
+    json_t *c = json_object_get(json_array_get(rows, 0), JSON_CHECKSUM_KEY);
+
+    return add_checksum(object, c ? json_incref(c) : json_null(), error);
+}
+
 json_t *add_checksum_json_array(rcComm_t *conn, json_t *array,
                                 baton_error_t *error) {
     if (!json_is_array(array)) {
@@ -909,14 +1591,14 @@ json_t *add_checksum_json_array(rcComm_t *conn, json_t *array,
         goto error;
     }
 
-    size_t i;
-    json_t *item;
-    json_array_foreach(array, i, item) {
-        if (represents_data_object(item)) {
-            add_checksum_json_object(conn, item, error);
-            if (error->code != 0) goto error;
-        }
-    }
+    query_format_in_t obj_format =
+        { .num_columns = 2,
+          .columns     = { COL_DATA_NAME, COL_D_DATA_CHECKSUM },
+          .labels      = { JSON_DATA_OBJECT_KEY, JSON_CHECKSUM_KEY } };
+
+    enrich_data_objects(conn, array, &obj_format, limit_to_good_repl,
+                        join_checksum, add_checksum_json, error);
+    if (error->code != 0) goto error;
 
     return array;
 
@@ -924,8 +1606,8 @@ error:
     return NULL;
 }
 
-json_t *add_repl_json_object(rcComm_t *conn, json_t *object,
-                             baton_error_t *error) {
+static json_t *add_repl_json(rcComm_t *conn, json_t *object,
+                             const int trusted, baton_error_t *error) {
     char *path = NULL;
     rodsPath_t rods_path;
 
@@ -940,7 +1622,7 @@ json_t *add_repl_json_object(rcComm_t *conn, json_t *object,
     path = json_to_path(object, error);
     if (error->code != 0) goto error;
 
-    set_rods_path(conn, &rods_path, path, error);
+    resolve_item_path(conn, &rods_path, object, path, trusted, error);
     if (error->code != 0) goto error;
 
     json_t *replicates = list_replicates(conn, &rods_path, error);
@@ -961,6 +1643,11 @@ error:
     return NULL;
 }
 
+json_t *add_repl_json_object(rcComm_t *conn, json_t *object,
+                             baton_error_t *error) {
+    return add_repl_json(conn, object, 0, error);
+}
+
 json_t *add_repl_json_array(rcComm_t *conn, json_t *array,
                             baton_error_t *error) {
     init_baton_error(error);
@@ -971,14 +1658,33 @@ json_t *add_repl_json_array(rcComm_t *conn, json_t *array,
         goto error;
     }
 
-    size_t i;
-    json_t *item;
-    json_array_foreach(array, i, item) {
-        if (represents_data_object(item)) {
-            add_repl_json_object(conn, item, error);
-            if (error->code != 0) goto error;
-        }
-    }
+#if IRODS_VERSION_INTEGER && IRODS_VERSION_INTEGER >= 4001008
+    query_format_in_t obj_format =
+        { .num_columns = 6,
+          .columns     = { COL_DATA_NAME, COL_D_REPL_STATUS,
+                           COL_DATA_REPL_NUM,
+                           COL_D_DATA_CHECKSUM,
+                           COL_COLL_NAME, COL_D_RESC_HIER },
+          .labels      = { JSON_DATA_OBJECT_KEY, JSON_REPLICATE_STATUS_KEY,
+                           JSON_REPLICATE_NUMBER_KEY,
+                           JSON_CHECKSUM_KEY,
+                           JSON_COLLECTION_KEY, JSON_RESOURCE_HIER_KEY } };
+#else
+    query_format_in_t obj_format =
+        { .num_columns = 6,
+          .columns     = { COL_DATA_NAME, COL_D_REPL_STATUS,
+                           COL_DATA_REPL_NUM,
+                           COL_D_DATA_CHECKSUM,
+                           COL_D_RESC_NAME, COL_R_LOC },
+          .labels      = { JSON_DATA_OBJECT_KEY, JSON_REPLICATE_STATUS_KEY,
+                           JSON_REPLICATE_NUMBER_KEY,
+                           JSON_CHECKSUM_KEY,
+                           JSON_RESOURCE_KEY, JSON_LOCATION_KEY } };
+#endif
+
+    enrich_data_objects(conn, array, &obj_format, NULL, join_replicates,
+                        add_repl_json, error);
+    if (error->code != 0) goto error;
 
     return array;
 
@@ -986,12 +1692,11 @@ error:
     return NULL;
 }
 
-json_t *add_tps_json_object(rcComm_t *conn, json_t *object,
-                            baton_error_t *error) {
+static json_t *add_tps_json(rcComm_t *conn, json_t *object,
+                            const int trusted, baton_error_t *error) {
     rodsPath_t rods_path;
     char *path             = NULL;
     json_t *raw_timestamps = NULL;
-    json_t *timestamps     = NULL;
 
     init_baton_error(error);
 
@@ -1004,51 +1709,14 @@ json_t *add_tps_json_object(rcComm_t *conn, json_t *object,
     path = json_to_path(object, error);
     if (error->code != 0) goto error;
 
-    set_rods_path(conn, &rods_path, path, error);
+    resolve_item_path(conn, &rods_path, object, path, trusted, error);
     if (error->code != 0) goto error;
 
     raw_timestamps = list_timestamps(conn, &rods_path, error);
     if (error->code != 0) goto error;
 
-    timestamps = json_array();
-    if (!timestamps) {
-        set_baton_error(error, -1, "Failed to allocate a new JSON array");
-        goto error;
-    }
-
-    // We report timestamps only on data objects. They exist on
-    // collections too, but we don't report them to be consistent with
-    // the 'ils' command.
-    if (represents_data_object(object)) {
-        size_t i;
-        json_t *item;
-        json_array_foreach(raw_timestamps, i, item) {
-            const char *repl_num = get_replicate_num(item, error);
-            if (error->code != 0) goto error;
-            const char *created = get_created_timestamp(item, error);
-            if (error->code != 0) goto error;
-            const char *modified = get_modified_timestamp(item, error);
-            if (error->code != 0) goto error;
-
-            json_t *iso_created =
-                make_timestamp(JSON_CREATED_KEY, created, RFC3339_FORMAT,
-                               repl_num, error);
-            if (error->code != 0) goto error;
-
-            json_t *iso_modified =
-                make_timestamp(JSON_MODIFIED_KEY, modified, RFC3339_FORMAT,
-                               repl_num, error);
-            if (error->code != 0) goto error;
-
-            json_array_append_new(timestamps, iso_created);
-            json_array_append_new(timestamps, iso_modified);
-
-            logmsg(DEBUG, "Adding timestamps from replicate %s of '%s'",
-                   repl_num, path);
-        }
-    }
-
-    json_object_set_new(object, JSON_TIMESTAMPS_KEY, timestamps);
+    logmsg(DEBUG, "Adding timestamps of '%s'", path);
+    add_replicate_timestamps(object, raw_timestamps, error);
     if (error->code != 0) goto error;
 
     if (path)                  free(path);
@@ -1062,11 +1730,15 @@ error:
     if (path)                  free(path);
     if (rods_path.rodsObjStat) free(rods_path.rodsObjStat);
     if (raw_timestamps)        json_decref(raw_timestamps);
-    if (timestamps)            json_decref(timestamps);
 
     return NULL;
 }
 
+json_t *add_tps_json_object(rcComm_t *conn, json_t *object,
+                            baton_error_t *error) {
+    return add_tps_json(conn, object, 0, error);
+}
+
 json_t *add_tps_json_array(rcComm_t *conn, json_t *array,
                            baton_error_t *error) {
     init_baton_error(error);
@@ -1077,14 +1749,16 @@ json_t *add_tps_json_array(rcComm_t *conn, json_t *array,
         goto error;
     }
 
-    size_t i;
-    json_t *item;
-    json_array_foreach(array, i, item) {
-        if (represents_data_object(item)) {
-            add_tps_json_object(conn, item, error);
-            if (error->code != 0) goto error;
-        }
-    }
+    query_format_in_t obj_format =
+        { .num_columns = 4,
+          .columns     = { COL_DATA_NAME, COL_D_CREATE_TIME,
+                           COL_D_MODIFY_TIME, COL_DATA_REPL_NUM },
+          .labels      = { JSON_DATA_OBJECT_KEY, JSON_CREATED_KEY,
+                           JSON_MODIFIED_KEY, JSON_REPLICATE_KEY } };
+
+    enrich_data_objects(conn, array, &obj_format, NULL, join_timestamps,
+                        add_tps_json, error);
+    if (error->code != 0) goto error;
 
     return array;
 
@@ -1092,8 +1766,8 @@ error:
     return NULL;
 }
 
-json_t *add_avus_json_object(rcComm_t *conn, json_t *object,
-                             baton_error_t *error) {
+static json_t *add_avus_json(rcComm_t *conn, json_t *object,
+                             const int trusted, baton_error_t *error) {
     char *path = NULL;
     rodsPath_t rods_path;
 
@@ -1108,7 +1782,7 @@ json_t *add_avus_json_object(rcComm_t *conn, json_t *object,
     path = json_to_path(object, error);
     if (error->code != 0) goto error;
 
-    set_rods_path(conn, &rods_path, path, error);
+    resolve_item_path(conn, &rods_path, object, path, trusted, error);
     if (error->code != 0) goto error;
 
     json_t *avus = list_metadata(conn, &rods_path, NULL, error);
@@ -1129,6 +1803,11 @@ error:
     return NULL;
 }
 
+json_t *add_avus_json_object(rcComm_t *conn, json_t *object,
+                             baton_error_t *error) {
+    return add_avus_json(conn, object, 0, error);
+}
+
 json_t *add_avus_json_array(rcComm_t *conn, json_t *array,
                             baton_error_t *error) {
     init_baton_error(error);
@@ -1139,21 +1818,36 @@ json_t *add_avus_json_array(rcComm_t *conn, json_t *array,
         goto error;
     }
 
+    // Collections are enriched one at a time
     size_t i;
     json_t *item;
     json_array_foreach(array, i, item) {
-        add_avus_json_object(conn, item, error);
-        if (error->code != 0) goto error;
+        if (!represents_data_object(item)) {
+            add_avus_json(conn, item, 1, error);
+            if (error->code != 0) goto error;
+        }
     }
 
+    query_format_in_t obj_format =
+        { .num_columns = 4,
+          .columns     = { COL_DATA_NAME, COL_META_DATA_ATTR_NAME,
+                           COL_META_DATA_ATTR_VALUE,
+                           COL_META_DATA_ATTR_UNITS },
+          .labels      = { JSON_DATA_OBJECT_KEY, JSON_ATTRIBUTE_KEY,
+                           JSON_VALUE_KEY, JSON_UNITS_KEY } };
+
+    enrich_data_objects(conn, array, &obj_format, NULL, join_avus,
+                        add_avus_json, error);
+    if (error->code != 0) goto error;
+
     return array;
 
 error:
     return NULL;
 }
 
-json_t *add_acl_json_object(rcComm_t *conn, json_t *object,
-                            baton_error_t *error) {
+static json_t *add_acl_json(rcComm_t *conn, json_t *object,
+                            const int trusted, baton_error_t *error) {
     char *path = NULL;
     rodsPath_t rods_path;
 
@@ -1168,7 +1862,10 @@ json_t *add_acl_json_object(rcComm_t *conn, json_t *object,
     path = json_to_path(object, error);
     if (error->code != 0) goto error;
 
-    set_rods_path(conn, &rods_path, path, error);
+    // The ACL of a data object is found by its ID, which is known only
+    // once the path is resolved
+    resolve_item_path(conn, &rods_path, object, path,
+                      trusted && !represents_data_object(object), error);
     if (error->code != 0) goto error;
 
     json_t *perms = list_permissions(conn, &rods_path, error);
@@ -1189,6 +1886,11 @@ error:
     return NULL;
 }
 
+json_t *add_acl_json_object(rcComm_t *conn, json_t *object,
+                            baton_error_t *error) {
+    return add_acl_json(conn, object, 0, error);
+}
+
 json_t *add_acl_json_array(rcComm_t *conn, json_t *array,
                            baton_error_t *error) {
     init_baton_error(error);
@@ -1199,13 +1901,28 @@ json_t *add_acl_json_array(rcComm_t *conn, json_t *array,
         goto error;
     }
 
+    // Collections are enriched one at a time
     size_t i;
     json_t *item;
     json_array_foreach(array, i, item) {
-        add_acl_json_object(conn, item, error);
-        if (error->code != 0) goto error;
+        if (!represents_data_object(item)) {
+            add_acl_json(conn, item, 1, error);
+            if (error->code != 0) goto error;
+        }
     }
 
+    // As for list_permissions, this reports groups unexpanded
+    query_format_in_t obj_format =
+        { .num_columns = 4,
+          .columns     = { COL_DATA_NAME, COL_USER_NAME, COL_USER_ZONE,
+                           COL_DATA_ACCESS_NAME },
+          .labels      = { JSON_DATA_OBJECT_KEY, JSON_OWNER_KEY,
+                           JSON_ZONE_KEY, JSON_LEVEL_KEY } };
+
+    enrich_data_objects(conn, array, &obj_format, limit_to_access_namespace,
+                        join_acl, add_acl_json, error);
+    if (error->code != 0) goto error;
+
     return array;
 
 error:
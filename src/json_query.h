@@ -1,6 +1,6 @@
 /**
- * Copyright (C) 2013, 2014, 2015, 2016, 2025 Genome Research Ltd. All
- * rights reserved.
+ * Copyright (C) 2013, 2014, 2015, 2016, 2025, 2026 Genome Research Ltd.
+ * All rights reserved.
  *
  * This program is free software: you can redistribute it and/or modify
  * it under the terms of the GNU General Public License as published by
@@ -30,6 +30,35 @@
 #include "query.h"
 #include "utilities.h"
 
+/** The number of seconds for which the resources of a zone are cached
+    after being listed to map replicates to their locations */
+#define RESOURCE_CACHE_TTL 300
+
+/**
+ * A function called with each page of rows fetched by a query, while
+ * the query continues.
+ *
+ * @param[in]     rows   A JSON array of objects, one per row. The visitor
+ *                       may modify the objects or take references to them,
+ *                       but must not free the array.
+ * @param[in]     data   Data passed through from the caller of the query.
+ * @param[out]    error  An error report struct.
+ *
+ * @return 0 on success, error code on failure, which stops the query.
+ */
+typedef int (*query_visitor) (json_t *rows, void *data, baton_error_t *error);
+
+/**
+ * A query visitor that appends each page of rows to a JSON array.
+ *
+ * @param[in]     rows   A JSON array of objects, one per row.
+ * @param[in,out] data   The JSON array to extend.
+ * @param[out]    error  An error report struct.
+ *
+ * @return 0 on success, error code on failure.
+ */
+int append_query_rows(json_t *rows, void *data, baton_error_t *error);
+
 /**
  * Log the current JSON error state through the underlying logging
  * mechanism.
@@ -80,6 +109,40 @@ json_t *do_search(rcComm_t *conn, char *zone_name, const json_t *query,
                   prepare_tps_search_cb prepare_mod,
                   baton_error_t *error);
 
+/**
+ * Execute a general query as for @ref do_search, passing each page of
+ * results to a visitor as it is fetched, rather than accumulating them.
+ *
+ * @param[in]  conn          An open iRODS connection.
+ * @param[in]  zone_name     The zone in which to search.
+ * @param[in]  query         The search query formulated as JSON.
+ * @param[in]  format        Query format parameters indicating which columns
+ *                           to return.
+ * @param[in]  prepare_avu   Callback to add any AVU-fetching clauses to the
+ *                           query.
+ * @param[in]  prepare_acl   Callback to add any ACL-fetching clauses to the
+ *                           query.
+ * @param[in]  prepare_cre   Callback to add any creation timestamp clauses
+ *                           to the query.
+ * @param[in]  prepare_mod   Callback to add any modification timestamp clauses
+ *                           to the query.
+ * @param[in]  limit         The maximum number of results to visit, or 0
+ *                           for no limit.
+ * @param[in]  visit         The visitor.
+ * @param[in]  data          Data to pass to the visitor.
+ * @param[in,out] error      An error report struct.
+ *
+ * @return 0 on success, error code on failure.
+ */
+int visit_search(rcComm_t *conn, char *zone_name, const json_t *query,
+                 query_format_in_t *format,
+                 prepare_avu_search_cb prepare_avu,
+                 prepare_acl_search_cb prepare_acl,
+                 prepare_tps_search_cb prepare_cre,
+                 prepare_tps_search_cb prepare_mod,
+                 size_t limit, query_visitor visit, void *data,
+                 baton_error_t *error);
+
 /**
  * Execute a specific query and obtain results as a JSON array of objects.
  * Columns in the query are mapped to JSON object properties specified
@@ -120,6 +183,30 @@ json_t *do_specific(rcComm_t *conn, char *zone_name, const json_t *query,
 json_t *do_query(rcComm_t *conn, genQueryInp_t *query_in,
                  const char *labels[], baton_error_t *error);
 
+/**
+ * Execute a general query, passing each page of results to a visitor
+ * as a JSON array of objects. Each page is freed once it has been
+ * visited, so that memory use is bounded by the page size rather than
+ * the number of results. If a limit is given, no more than that many
+ * results are fetched and the query is closed on the server once they
+ * have been visited.
+ *
+ * @param[in]  conn          An open iRODS connection.
+ * @param[in]  query_in      A populated query input.
+ * @param[in]  labels        An array of as many labels as there were columns
+ *                           selected in the query.
+ * @param[in]  limit         The maximum number of results to visit, or 0
+ *                           for no limit.
+ * @param[in]  visit         The visitor.
+ * @param[in]  data          Data to pass to the visitor.
+ * @param[in,out] error      An error report struct.
+ *
+ * @return 0 on success, error code on failure.
+ */
+int visit_query(rcComm_t *conn, genQueryInp_t *query_in,
+                const char *labels[], size_t limit, query_visitor visit,
+                void *data, baton_error_t *error);
+
 /**
  * Execute a specific query and obtain results as a JSON array of objects.
  * Columns in the query are mapped to JSON object properties specified
@@ -138,6 +225,26 @@ json_t *do_squery(rcComm_t *conn, specificQueryInp_t *squery_in,
                   query_format_in_t *labels,
                   baton_error_t *error);
 
+/**
+ * Execute a specific query, passing each page of results to a visitor
+ * as for @ref visit_query.
+ *
+ * @param[in]  conn          An open iRODS connection.
+ * @param[in]  squery_in     A populated query input.
+ * @param[in]  labels        An array of as many labels as there were columns
+ *                           selected in the query.
+ * @param[in]  limit         The maximum number of results to visit, or 0
+ *                           for no limit.
+ * @param[in]  visit         The visitor.
+ * @param[in]  data          Data to pass to the visitor.
+ * @param[in,out] error      An error report struct.
+ *
+ * @return 0 on success, error code on failure.
+ */
+int visit_squery(rcComm_t *conn, specificQueryInp_t *squery_in,
+                 query_format_in_t *labels, size_t limit,
+                 query_visitor visit, void *data, baton_error_t *error);
+
 /**
  * Construct a JSON array of objects from a query output. Columns in the
  * query are mapped to JSON object properties specified by the labels
@@ -261,6 +368,21 @@ json_t *add_tps_json_array(rcComm_t *conn, json_t *array,
 json_t *add_tps_json_object(rcComm_t *conn, json_t *object,
                             baton_error_t *error);
 
+/**
+ * Add created and modified timestamps to a data object, one pair per
+ * replicate, formatted as for @ref add_tps_json_object.
+ *
+ * @param[in,out] object          The data object.
+ * @param[in]     raw_timestamps  A JSON array of objects, each having
+ *                                created, modified and replicate number
+ *                                values as found in the iRODS database.
+ * @param[out]    error           An error report struct.
+ *
+ * @return 0 on success, error code on failure.
+ */
+int add_replicate_timestamps(json_t *object, const json_t *raw_timestamps,
+                             baton_error_t *error);
+
 json_t *add_checksum_json_array(rcComm_t *conn, json_t *array,
                                 baton_error_t *error);
 
@@ -274,4 +396,10 @@ json_t *revmap_access_result(json_t *acl, baton_error_t *error);
 json_t *revmap_replicate_results(rcComm_t *conn, const json_t *results,
                                  baton_error_t *error);
 
+/**
+ * Discard the cached resources used by @ref revmap_replicate_results,
+ * so that they are listed again on next use.
+ */
+void clear_resource_cache(void);
+
 #endif  // _BATON_JSON_QUERY_H
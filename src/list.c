@@ -1,6 +1,6 @@
 /**
  * Copyright (C) 2013, 2014, 2015, 2016, 2017, 2019, 2021, 2023, 2024,
- * 2025 Genome Research Ltd. All rights reserved.
+ * 2025, 2026 Genome Research Ltd. All rights reserved.
  *
  * This program is free software: you can redistribute it and/or modify
  * it under the terms of the GNU General Public License as published by
@@ -47,7 +47,7 @@ static json_t *list_data_object(rcComm_t *conn, rodsPath_t *rods_path,
         obj_format = &obj_format_simple;
     }
 
-    query_in = make_query_input(SEARCH_MAX_ROWS, obj_format->num_columns,
+    query_in = make_query_input(get_query_page_size(), obj_format->num_columns,
                                 obj_format->columns);
     query_in = prepare_obj_list(query_in, rods_path, NULL);
     query_in = limit_to_good_repl(query_in);
@@ -85,6 +85,207 @@ error:
     return NULL;
 }
 
+// Return a string value from a query result row, or NULL if absent
+static const char *row_value(const json_t *row, const char *key) {
+    return json_string_value(json_object_get(row, key));
+}
+
+// Return true if two optional strings are equal
+static int same_value(const char *x, const char *y) {
+    if (!x || !y) return x == y;
+
+    return str_equals(x, y, MAX_STR_LEN);
+}
+
+// Describe a data object with its checksum, timestamps and replicates,
+// as list_data_object followed by add_checksum_json_object,
+// add_tps_json_object and add_repl_json_object would, using a single
+// query for one row per replicate. ACLs and AVUs each add one further
+// query. The path is not resolved again.
+static json_t *describe_data_object(rcComm_t *conn, rodsPath_t *rods_path,
+                                    const option_flags flags,
+                                    baton_error_t *error) {
+    genQueryInp_t *query_in = NULL;
+    json_t *rows            = NULL;
+    json_t *data_object     = NULL;
+    json_t *raw_timestamps  = NULL;
+
+#if IRODS_VERSION_INTEGER && IRODS_VERSION_INTEGER >= 4001008
+    query_format_in_t obj_format =
+        { .num_columns = 9,
+          .columns     = { COL_COLL_NAME, COL_DATA_NAME, COL_DATA_SIZE,
+                           COL_DATA_REPL_NUM, COL_D_REPL_STATUS,
+                           COL_D_DATA_CHECKSUM,
+                           COL_D_CREATE_TIME, COL_D_MODIFY_TIME,
+                           COL_D_RESC_HIER },
+          .labels      = { JSON_COLLECTION_KEY, JSON_DATA_OBJECT_KEY,
+                           JSON_SIZE_KEY,
+                           JSON_REPLICATE_NUMBER_KEY,
+                           JSON_REPLICATE_STATUS_KEY,
+                           JSON_CHECKSUM_KEY,
+                           JSON_CREATED_KEY, JSON_MODIFIED_KEY,
+                           JSON_RESOURCE_HIER_KEY } };
+#else
+    query_format_in_t obj_format =
+        { .num_columns = 10,
+          .columns     = { COL_COLL_NAME, COL_DATA_NAME, COL_DATA_SIZE,
+                           COL_DATA_REPL_NUM, COL_D_REPL_STATUS,
+                           COL_D_DATA_CHECKSUM,
+                           COL_D_CREATE_TIME, COL_D_MODIFY_TIME,
+                           COL_D_RESC_NAME, COL_R_LOC },
+          .labels      = { JSON_COLLECTION_KEY, JSON_DATA_OBJECT_KEY,
+                           JSON_SIZE_KEY,
+                           JSON_REPLICATE_NUMBER_KEY,
+                           JSON_REPLICATE_STATUS_KEY,
+                           JSON_CHECKSUM_KEY,
+                           JSON_CREATED_KEY, JSON_MODIFIED_KEY,
+                           JSON_RESOURCE_KEY, JSON_LOCATION_KEY } };
+#endif
+
+    init_baton_error(error);
+
+    query_in = make_query_input(get_query_page_size(), obj_format.num_columns,
+                                obj_format.columns);
+    query_in = prepare_obj_list(query_in, rods_path, NULL);
+
+    addKeyVal(&query_in->condInput, ZONE_KW, rods_path->outPath);
+    logmsg(DEBUG, "Using zone hint '%s'", rods_path->outPath);
+    rows = do_query(conn, query_in, obj_format.labels, error);
+    if (error->code != 0) goto error;
+
+    // The size and checksum reported are those of the good replicates,
+    // which must agree
+    const json_t *good   = NULL;
+    int size_differs     = 0;
+    int checksum_differs = 0;
+
+    size_t index;
+    json_t *row;
+    json_array_foreach(rows, index, row) {
+        const char *status = row_value(row, JSON_REPLICATE_STATUS_KEY);
+        if (!status || atoi(status) != good_repl_status()) continue;
+
+        if (!good) {
+            good = row;
+            continue;
+        }
+
+        if (!same_value(row_value(good, JSON_SIZE_KEY),
+                        row_value(row, JSON_SIZE_KEY))) {
+            size_differs = 1;
+        }
+        if (!same_value(row_value(good, JSON_CHECKSUM_KEY),
+                        row_value(row, JSON_CHECKSUM_KEY))) {
+            checksum_differs = 1;
+        }
+    }
+
+    if (!good) {
+        set_baton_error(error, -1, "Expected 1 data object result but "
+                        "found 0. This occurs when the object has no good "
+                        "replicates in the iRODS database");
+        goto error;
+    }
+    if ((flags & PRINT_SIZE) && size_differs) {
+        set_baton_error(error, -1, "Expected 1 data object result but "
+                        "found more. This occurs when the object replicates "
+                        "have different sizes in the iRODS database.");
+        goto error;
+    }
+    if ((flags & PRINT_CHECKSUM) && checksum_differs) {
+        set_baton_error(error, -1, "Expected 1 data object result but "
+                        "found more. This occurs when the object replicates "
+                        "have different checksum values in the iRODS database");
+        goto error;
+    }
+
+    data_object = json_pack("{s:s, s:s}",
+                            JSON_COLLECTION_KEY,
+                            row_value(good, JSON_COLLECTION_KEY),
+                            JSON_DATA_OBJECT_KEY,
+                            row_value(good, JSON_DATA_OBJECT_KEY));
+    if (!data_object) {
+        set_baton_error(error, -1, "Failed to pack data object '%s' as JSON",
+                        rods_path->outPath);
+        goto error;
+    }
+
+    if (flags & PRINT_SIZE) {
+        const char *size = row_value(good, JSON_SIZE_KEY);
+        json_object_set_new(data_object, JSON_SIZE_KEY,
+                            json_integer(size ? atol(size) : 0));
+    }
+    if (flags & PRINT_ACL) {
+        json_t *perms = list_permissions(conn, rods_path, error);
+        if (error->code != 0) goto error;
+
+        add_permissions(data_object, perms, error);
+        if (error->code != 0) goto error;
+    }
+    if (flags & PRINT_AVU) {
+        json_t *avus = list_metadata(conn, rods_path, NULL, error);
+        if (error->code != 0) goto error;
+
+        add_metadata(data_object, avus, error);
+        if (error->code != 0) goto error;
+    }
+    if (flags & PRINT_CHECKSUM) {
+        json_t *checksum = json_object_get(good, JSON_CHECKSUM_KEY);
+        add_checksum(data_object,
+                     checksum ? json_incref(checksum) : json_null(), error);
+        if (error->code != 0) goto error;
+    }
+    if (flags & PRINT_TIMESTAMP) {
+        raw_timestamps = json_array();
+        if (!raw_timestamps) {
+            set_baton_error(error, -1, "Failed to allocate a new JSON array");
+            goto error;
+        }
+
+        json_array_foreach(rows, index, row) {
+            json_t *timestamp =
+                json_pack("{s:O, s:O, s:O}",
+                          JSON_CREATED_KEY,
+                          json_object_get(row, JSON_CREATED_KEY),
+                          JSON_MODIFIED_KEY,
+                          json_object_get(row, JSON_MODIFIED_KEY),
+                          JSON_REPLICATE_KEY,
+                          json_object_get(row, JSON_REPLICATE_NUMBER_KEY));
+            if (!timestamp) {
+                set_baton_error(error, -1, "Failed to pack timestamps of "
+                                "'%s' as JSON", rods_path->outPath);
+                goto error;
+            }
+
+            json_array_append_new(raw_timestamps, timestamp);
+        }
+
+        add_replicate_timestamps(data_object, raw_timestamps, error);
+        if (error->code != 0) goto error;
+    }
+    if (flags & PRINT_REPLICATE) {
+        json_t *replicates = revmap_replicate_results(conn, rows, error);
+        if (error->code != 0) goto error;
+
+        add_replicates(data_object, replicates, error);
+        if (error->code != 0) goto error;
+    }
+
+    free_query_input(query_in);
+    json_decref(rows);
+    if (raw_timestamps) json_decref(raw_timestamps);
+
+    return data_object;
+
+error:
+    if (query_in)       free_query_input(query_in);
+    if (rows)           json_decref(rows);
+    if (data_object)    json_decref(data_object);
+    if (raw_timestamps) json_decref(raw_timestamps);
+
+    return NULL;
+}
+
 static json_t *list_collection(rcComm_t *conn, rodsPath_t *rods_path,
                                const option_flags flags, baton_error_t *error) {
     json_t *results = NULL;
@@ -209,7 +410,7 @@ json_t *list_checksum(rcComm_t *conn, rodsPath_t *rods_path,
           .labels      = { JSON_COLLECTION_KEY, JSON_DATA_OBJECT_KEY,
                            JSON_CHECKSUM_KEY } };
 
-    query_in = make_query_input(SEARCH_MAX_ROWS, obj_format.num_columns,
+    query_in = make_query_input(get_query_page_size(), obj_format.num_columns,
                                 obj_format.columns);
     query_in = prepare_obj_list(query_in, rods_path, NULL);
     query_in = limit_to_good_repl(query_in);
@@ -271,6 +472,12 @@ json_t *list_path(rcComm_t *conn, rodsPath_t *rods_path, const option_flags flag
                        rods_path->outPath);
             }
 
+            if (flags & (PRINT_CHECKSUM | PRINT_TIMESTAMP | PRINT_REPLICATE)) {
+                result = describe_data_object(conn, rods_path, flags, error);
+                if (error->code != 0) goto error;
+                break;
+            }
+
             result = list_data_object(conn, rods_path, flags, error);
             if (error->code != 0) goto error;
 
@@ -282,18 +489,6 @@ json_t *list_path(rcComm_t *conn, rodsPath_t *rods_path, const option_flags flag
                 result = add_avus_json_object(conn, result, error);
                 if (error->code != 0) goto error;
             }
-            if (flags & PRINT_CHECKSUM) {
-                result = add_checksum_json_object(conn, result, error);
-                if (error->code != 0) goto error;
-            }
-            if (flags & PRINT_TIMESTAMP) {
-                result = add_tps_json_object(conn, result, error);
-                if (error->code != 0) goto error;
-            }
-            if (flags & PRINT_REPLICATE) {
-              result = add_repl_json_object(conn, result, error);
-              if (error->code != 0) goto error;
-            }
 
             break;
 
@@ -366,6 +561,211 @@ error:
     return NULL;
 }
 
+// Return the index of a name in names, or num_names if absent
+static size_t find_name(const char *names[], const size_t num_names,
+                        const char *name) {
+    for (size_t i = 0; i < num_names; i++) {
+        if (names[i] && str_equals(names[i], name, MAX_STR_LEN)) return i;
+    }
+
+    return num_names;
+}
+
+int list_data_objects(rcComm_t *conn, const char *coll_name,
+                      const char *data_names[], const size_t num_names,
+                      const option_flags flags, json_t *results[],
+                      baton_error_t *error) {
+    genQueryInp_t *query_in = NULL;
+    json_t *rows            = NULL;
+    char *in_value          = NULL;
+    const char *names[MAX_LIST_BATCH_SIZE];
+    size_t num_queried = 0;
+
+    init_baton_error(error);
+
+    for (size_t i = 0; i < num_names; i++) results[i] = NULL;
+
+    if (num_names > MAX_LIST_BATCH_SIZE) {
+        set_baton_error(error, CAT_INVALID_ARGUMENT,
+                        "Failed to list %zu data objects in '%s': at most "
+                        "%d may be listed together", num_names, coll_name,
+                        MAX_LIST_BATCH_SIZE);
+        goto error;
+    }
+
+    // Names are queried in positions matching data_names, with NULL
+    // for any that cannot be quoted in a query condition
+    for (size_t i = 0; i < num_names; i++) {
+        if (strchr(data_names[i], '\'')) {
+            names[i] = NULL;
+        }
+        else {
+            names[i] = data_names[i];
+            num_queried++;
+        }
+    }
+    if (num_queried == 0) return 0;
+
+    const char *queried[MAX_LIST_BATCH_SIZE];
+    for (size_t i = 0, j = 0; i < num_names; i++) {
+        if (names[i]) queried[j++] = names[i];
+    }
+
+    in_value = make_in_value(queried, num_queried);
+    if (!in_value) {
+        set_baton_error(error, errno, "Failed to allocate memory: "
+                        "error %d %s", errno, strerror(errno));
+        goto error;
+    }
+
+    const query_cond_t cn = { .column   = COL_COLL_NAME,
+                              .operator = SEARCH_OP_EQUALS,
+                              .value    = coll_name };
+    const query_cond_t dn = { .column   = COL_DATA_NAME,
+                              .operator = SEARCH_OP_IN,
+                              .value    = in_value };
+
+    query_format_in_t obj_format =
+        { .num_columns = 4,
+          .columns     = { COL_COLL_NAME, COL_DATA_NAME,
+                           COL_DATA_SIZE, COL_D_DATA_CHECKSUM },
+          .labels      = { JSON_COLLECTION_KEY, JSON_DATA_OBJECT_KEY,
+                           JSON_SIZE_KEY, JSON_CHECKSUM_KEY } };
+
+    // Size and checksum are selected only if requested, so that
+    // replicates differing in the other do not cause duplicate rows
+    size_t num_columns = 2;
+    if (flags & PRINT_SIZE) num_columns = 3;
+    if (flags & PRINT_CHECKSUM) num_columns = 4;
+
+    query_in = make_query_input(get_query_page_size(), num_columns,
+                                obj_format.columns);
+    query_in = add_query_conds(query_in, 2, (query_cond_t []) { cn, dn });
+    query_in = limit_to_good_repl(query_in);
+
+    addKeyVal(&query_in->condInput, ZONE_KW, coll_name);
+    rows = do_query(conn, query_in, obj_format.labels, error);
+    if (error->code != 0) goto error;
+
+    free_query_input(query_in);
+    query_in = NULL;
+
+    // Names matching more than one row have replicates that differ
+    int duplicate[MAX_LIST_BATCH_SIZE] = { 0 };
+
+    size_t index;
+    json_t *row;
+    json_array_foreach(rows, index, row) {
+        const char *name =
+            json_string_value(json_object_get(row, JSON_DATA_OBJECT_KEY));
+        if (!name) continue;
+
+        const size_t i = find_name(names, num_names, name);
+        if (i == num_names) continue;
+
+        if (results[i]) {
+            duplicate[i] = 1;
+            continue;
+        }
+
+        json_t *obj = json_pack("{s:s, s:s}",
+                                JSON_COLLECTION_KEY,  coll_name,
+                                JSON_DATA_OBJECT_KEY, name);
+        if (!obj) {
+            set_baton_error(error, -1, "Failed to pack data object '%s/%s' "
+                            "as JSON", coll_name, name);
+            goto error;
+        }
+
+        if (flags & PRINT_SIZE) {
+            const char *size =
+                json_string_value(json_object_get(row, JSON_SIZE_KEY));
+            json_object_set_new(obj, JSON_SIZE_KEY,
+                                json_integer(size ? atol(size) : 0));
+        }
+        if (flags & PRINT_CHECKSUM) {
+            json_t *checksum = json_object_get(row, JSON_CHECKSUM_KEY);
+            add_checksum(obj, checksum ? json_incref(checksum) : json_null(),
+                         error);
+            if (error->code != 0) goto error;
+        }
+
+        results[i] = obj;
+    }
+
+    json_decref(rows);
+    rows = NULL;
+
+    for (size_t i = 0; i < num_names; i++) {
+        if (duplicate[i]) {
+            json_decref(results[i]);
+            results[i] = NULL;
+            names[i]   = NULL;
+        }
+    }
+
+    if (flags & PRINT_AVU) {
+        query_format_in_t avu_format =
+            { .num_columns = 4,
+              .columns     = { COL_DATA_NAME, COL_META_DATA_ATTR_NAME,
+                               COL_META_DATA_ATTR_VALUE,
+                               COL_META_DATA_ATTR_UNITS },
+              .labels      = { JSON_DATA_OBJECT_KEY, JSON_ATTRIBUTE_KEY,
+                               JSON_VALUE_KEY, JSON_UNITS_KEY } };
+
+        query_in = make_query_input(get_query_page_size(),
+                                    avu_format.num_columns,
+                                    avu_format.columns);
+        query_in = add_query_conds(query_in, 2, (query_cond_t []) { cn, dn });
+
+        addKeyVal(&query_in->condInput, ZONE_KW, coll_name);
+        rows = do_query(conn, query_in, avu_format.labels, error);
+        if (error->code != 0) goto error;
+
+        for (size_t i = 0; i < num_names; i++) {
+            if (!results[i]) continue;
+
+            add_metadata(results[i], json_array(), error);
+            if (error->code != 0) goto error;
+        }
+
+        json_array_foreach(rows, index, row) {
+            const char *name =
+                json_string_value(json_object_get(row, JSON_DATA_OBJECT_KEY));
+            if (!name) continue;
+
+            const size_t i = find_name(names, num_names, name);
+            if (i == num_names || !results[i]) continue;
+
+            json_object_del(row, JSON_DATA_OBJECT_KEY);
+            json_array_append(json_object_get(results[i], JSON_AVUS_KEY),
+                              row);
+        }
+
+        free_query_input(query_in);
+        json_decref(rows);
+    }
+
+    free(in_value);
+
+    return error->code;
+
+error:
+    logmsg(ERROR, "Failed to list data objects in '%s': error %d %s",
+           coll_name, error->code, error->message);
+
+    if (query_in) free_query_input(query_in);
+    if (rows)     json_decref(rows);
+    if (in_value) free(in_value);
+
+    for (size_t i = 0; i < num_names; i++) {
+        json_decref(results[i]);
+        results[i] = NULL;
+    }
+
+    return error->code;
+}
+
 json_t *list_permissions(rcComm_t *conn, rodsPath_t *rods_path,
                          baton_error_t *error) {
     genQueryInp_t *query_in = NULL;
@@ -411,7 +811,8 @@ json_t *list_permissions(rcComm_t *conn, rodsPath_t *rods_path,
                   .labels      = { JSON_OWNER_KEY, JSON_ZONE_KEY,
                                    JSON_LEVEL_KEY }};
 
-            query_in = make_query_input(SEARCH_MAX_ROWS, obj_format.num_columns,
+            query_in = make_query_input(get_query_page_size(),
+                                        obj_format.num_columns,
                                         obj_format.columns);
             query_in = prepare_obj_acl_list(query_in, rods_path);
 
@@ -536,7 +937,8 @@ json_t *list_replicates(rcComm_t *conn, rodsPath_t *rods_path,
         case DATA_OBJ_T:
             logmsg(TRACE, "Identified '%s' as a data object",
                    rods_path->outPath);
-            query_in = make_query_input(SEARCH_MAX_ROWS, obj_format.num_columns,
+            query_in = make_query_input(get_query_page_size(),
+                                        obj_format.num_columns,
                                         obj_format.columns);
             query_in = prepare_obj_repl_list(query_in, rods_path);
             break;
@@ -610,7 +1012,8 @@ json_t *list_timestamps(rcComm_t *conn, rodsPath_t *rods_path,
         case DATA_OBJ_T:
             logmsg(TRACE, "Identified '%s' as a data object",
                    rods_path->outPath);
-            query_in = make_query_input(SEARCH_MAX_ROWS, obj_format.num_columns,
+            query_in = make_query_input(get_query_page_size(),
+                                        obj_format.num_columns,
                                         obj_format.columns);
             query_in = prepare_obj_list(query_in, rods_path, NULL);
             break;
@@ -618,7 +1021,8 @@ json_t *list_timestamps(rcComm_t *conn, rodsPath_t *rods_path,
         case COLL_OBJ_T:
             logmsg(TRACE, "Identified '%s' as a collection",
                    rods_path->outPath);
-            query_in = make_query_input(SEARCH_MAX_ROWS, col_format.num_columns,
+            query_in = make_query_input(get_query_page_size(),
+                                        col_format.num_columns,
                                         col_format.columns);
             query_in = prepare_col_tps_list(query_in, rods_path);
             break;
@@ -688,7 +1092,8 @@ json_t *list_metadata(rcComm_t *conn, rodsPath_t *rods_path, const char *attr_na
         case DATA_OBJ_T:
             logmsg(TRACE, "Identified '%s' as a data object",
                    rods_path->outPath);
-            query_in = make_query_input(SEARCH_MAX_ROWS, obj_format.num_columns,
+            query_in = make_query_input(get_query_page_size(),
+                                        obj_format.num_columns,
                                         obj_format.columns);
             query_in = prepare_obj_list(query_in, rods_path, attr_name);
             break;
@@ -696,7 +1101,8 @@ json_t *list_metadata(rcComm_t *conn, rodsPath_t *rods_path, const char *attr_na
         case COLL_OBJ_T:
             logmsg(TRACE, "Identified '%s' as a collection",
                    rods_path->outPath);
-            query_in = make_query_input(SEARCH_MAX_ROWS, col_format.num_columns,
+            query_in = make_query_input(get_query_page_size(),
+                                        col_format.num_columns,
                                         col_format.columns);
             query_in = prepare_col_list(query_in, rods_path, attr_name);
             break;
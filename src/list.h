@@ -1,6 +1,6 @@
 /**
- * Copyright (C) 2013, 2014, 2015, 2016, 2017, 2025 Genome Research Ltd. All
- * rights reserved.
+ * Copyright (C) 2013, 2014, 2015, 2016, 2017, 2025, 2026 Genome
+ * Research Ltd. All rights reserved.
  *
  * This program is free software: you can redistribute it and/or modify
  * it under the terms of the GNU General Public License as published by
@@ -33,6 +33,18 @@
 #include "operations.h"
 #include "query.h"
 
+/** The maximum number of data objects listed by one list_data_objects
+    call */
+#define MAX_LIST_BATCH_SIZE 32
+
+/** The print options that add details to listed paths */
+#define LIST_PRINT_FLAGS (PRINT_ACL | PRINT_AVU | PRINT_CHECKSUM |      \
+                          PRINT_CONTENTS | PRINT_REPLICATE |            \
+                          PRINT_SIZE | PRINT_TIMESTAMP)
+
+/** The print options supported by list_data_objects */
+#define LIST_BATCH_FLAGS (PRINT_SIZE | PRINT_CHECKSUM | PRINT_AVU)
+
 json_t *list_checksum(rcComm_t *conn, rodsPath_t *rods_path,
                       baton_error_t *error);
 
@@ -54,6 +66,34 @@ json_t *list_checksum(rcComm_t *conn, rodsPath_t *rods_path,
 json_t *list_path(rcComm_t *conn, rodsPath_t *rods_path, option_flags flags,
                   baton_error_t *error);
 
+/**
+ * List several data objects in one collection, as list_path would,
+ * using one query for the data objects and, if AVUs are requested,
+ * one for their AVUs. Only the PRINT_SIZE, PRINT_CHECKSUM and
+ * PRINT_AVU flags are supported.
+ *
+ * A data object is not listed if it is not found, has replicates with
+ * differing sizes or checksums, or has a name containing a quote. The
+ * caller should list these with list_path, to report the error.
+ *
+ * @param[in]  conn         An open iRODS connection.
+ * @param[in]  coll_name    An absolute, normalised collection path.
+ * @param[in]  data_names   The data object names.
+ * @param[in]  num_names    The number of names, at most
+ *                          MAX_LIST_BATCH_SIZE.
+ * @param[in]  flags        Result print options.
+ * @param[out] results      On success, for each name, a new JSON
+ *                          object which must be freed by the caller,
+ *                          or NULL if it was not listed.
+ * @param[out] error        An error report struct.
+ *
+ * @return 0 on success, error code on failure.
+ */
+int list_data_objects(rcComm_t *conn, const char *coll_name,
+                      const char *data_names[], size_t num_names,
+                      option_flags flags, json_t *results[],
+                      baton_error_t *error);
+
 /**
  * Return a JSON representation of the access control list of a
  * resolved iRODS path (data object or collection).
@@ -1,6 +1,6 @@
 /**
- * Copyright (C) 2017, 2018, 2019, 2020, 2021, 2022, 2024, 2025 Genome
- * Research Ltd. All rights reserved.
+ * Copyright (C) 2017, 2018, 2019, 2020, 2021, 2022, 2024, 2025, 2026
+ * Genome Research Ltd. All rights reserved.
  *
  * This program is free software: you can redistribute it and/or modify
  * it under the terms of the GNU General Public License as published by
@@ -19,174 +19,1550 @@
  * @author Keith James <kdj@sanger.ac.uk>, Rob Davies <rmd@sanger.ac.uk>
  */
 
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <unistd.h>
+
 #include "config.h"
 #include "time.h"
 
-#include "baton.h"
-#include "operations.h"
+#include "arena.h"
+#include "baton.h"
+#include "concurrency.h"
+#include "connection_pool.h"
+#include "journal.h"
+#include "operations.h"
+#include "retry.h"
+
+// Return a new reference to the JSON to be printed for an item, given
+// the result of its operation. Increments error_count on error.
+static json_t *make_output(json_t *item, json_t *result, baton_error_t *error,
+                           const size_t ordinal, int *error_count) {
+    json_t *output = NULL;
+
+    const int envelope = has_operation(item) &&
+        (has_operation_target(item) || has_operation_targets(item));
+
+    if (error->code != 0) {
+        // On error, add an error report to the input JSON as a
+        // property and print the input JSON. A NULL result should
+        // always be an error, except for an operation on an array of
+        // targets, where the result reports each target.
+        (*error_count)++;
+        add_error_value(item, error);
+        if (result && envelope) {
+            baton_error_t rerror;
+            add_result(item, result, &rerror);
+        }
+        else {
+            json_decref(result);
+        }
+        output = json_incref(item);
+    }
+    else {
+        if (envelope) {
+            // It's an envelope, so we add the result to the input
+            // JSON as a property and print the input JSON, The
+            // result will be freed as part of the input JSON.
+            baton_error_t rerror;
+            init_baton_error(&rerror);
+
+            // Streamed results have already been printed, so the
+            // envelope is printed without them to mark their end
+            if (result) add_result(item, result, &rerror);
+            if (rerror.code != 0) {
+                logmsg(ERROR, "Failed to add error report to item %zu "
+                       "in stream. Error code %d: %s", ordinal,
+                       rerror.code, rerror.message);
+                (*error_count)++;
+            }
+            output = json_incref(item);
+        }
+        else {
+            // There is no envelope and there is some result JSON,
+            // so we print the result JSON. The result is not
+            // freed as part of the input JSON, so the caller frees it.
+            output = result;
+        }
+    }
+
+    return output;
+}
+
+// Add the correlation ID of an item to its output, if the output is a
+// JSON object. Array results, which are only printed bare when the
+// input is not an envelope, cannot carry an ID.
+static void add_output_id(json_t *output, const json_t *item,
+                          const size_t ordinal) {
+    if (!json_is_object(output)) return;
+
+    baton_error_t error;
+    add_correlation_id(output, item, ordinal, &error);
+    if (error.code != 0) {
+        logmsg(ERROR, "Failed to add an ID to item %zu in stream. "
+               "Error code %d: %s", ordinal, error.code, error.message);
+    }
+}
+
+// Return true if a collection path is absolute and normalised, so
+// that it may be used in a query without being resolved
+static int is_normalised_collection(const char *path) {
+    const size_t len = strlen(path);
+
+    if (len == 0 || path[0] != '/') return 0;
+    if (len > 1 && path[len - 1] == '/') return 0;
+    if (strstr(path, "//") || strstr(path, "/./") || strstr(path, "/../")) {
+        return 0;
+    }
+    if (str_ends_with(path, "/.", MAX_STR_LEN) ||
+        str_ends_with(path, "/..", MAX_STR_LEN)) {
+        return 0;
+    }
+
+    return 1;
+}
+
+// Return true if the target of a list operation may be listed together
+// with others in the same collection by list_data_objects
+static int is_batchable_target(const json_t *target, const option_flags flags) {
+    if ((flags & LIST_PRINT_FLAGS) & ~LIST_BATCH_FLAGS) return 0;
+
+    if (!represents_data_object(target)) return 0;
+
+    baton_error_t error;
+    const char *coll_name = get_collection_value(target, &error);
+    if (error.code != 0 || !coll_name) return 0;
+
+    const char *data_name = get_data_object_value(target, &error);
+    if (error.code != 0 || !data_name) return 0;
+
+    return is_normalised_collection(coll_name) && !strchr(data_name, '/');
+}
+
+// An item read from the input stream. Items are stored in a ring
+// indexed by their sequence number in the input stream. The sequence
+// number is the same as the item's ordinal, unless processing was
+// resumed from a journal and items already complete were skipped.
+// Items waiting to be executed form the prefetch queue and, in ordered
+// mode, completed items waiting to be printed form the reorder buffer.
+typedef struct work_item {
+    // The input JSON
+    json_t *item;
+    // The JSON to print when the item is complete
+    json_t *output;
+    // True if the item is an envelope validated for dispatch
+    int prepared;
+    // The validated envelope
+    prepared_op_t op;
+    // Any error from validating the item
+    baton_error_t error;
+    // True when the item is complete and the output may be printed
+    int done;
+    // The sequence number of the item
+    size_t seq;
+    // The position of the item in the input stream
+    size_t ordinal;
+    // The offset of the end of the item in the input stream, or -1
+    long offset;
+    // The arena from which the item's JSON is allocated, or NULL
+    arena_t *arena;
+    // The lane in which the item waits to be executed
+    int lane;
+} work_item_t;
+
+// Lanes of items waiting to be executed. Items in the control lane
+// are taken before those in the bulk lane, which are executed by a
+// limited number of threads, so that the others remain free for
+// control operations while bulk transfers are in progress.
+enum { CONTROL_LANE = 0, BULK_LANE = 1, NUM_LANES = 2 };
+
+typedef struct lane {
+    // A ring of the sequence numbers of the items waiting, with the
+    // same capacity as the ring of items
+    size_t *seqs;
+    // The number of items taken from the lane
+    size_t head;
+    // The number of items added to the lane
+    size_t tail;
+} lane_t;
+
+typedef struct work_pool {
+    FILE *input;
+    baton_json_op fn;
+    operation_args_t *args;
+    // The ring of items
+    work_item_t *items;
+    // The capacity of the ring
+    size_t window;
+    // The maximum number of items read, but not yet taken for execution
+    size_t depth;
+    // Sequence number of the next item to be read from input
+    size_t next_read;
+    // The items waiting to be executed
+    lane_t lanes[NUM_LANES];
+    // The maximum number of bulk items executing at once, or 0 if all
+    // items are in the control lane
+    size_t bulk_limit;
+    // The number of bulk items executing
+    size_t num_bulk;
+    // The number of items queued for output. In ordered mode, this is
+    // also the sequence number of the next item to be queued
+    size_t next_print;
+    // The number of outputs queued, including the rows streamed by
+    // items still executing
+    size_t next_output;
+    // The number of outputs written
+    size_t next_write;
+    // The number of items whose output has been written
+    size_t num_written;
+    // The ring of output JSON waiting to be written, in output order
+    json_t **outputs;
+    // The capacity of the ring of outputs. It has room for the output
+    // of every item in the ring of items and as many streamed rows.
+    size_t output_window;
+    // True for each output that completes an item, false for a row
+    // streamed by one
+    int *item_outputs;
+    // The journal entries for the items of the outputs
+    journal_entry_t *entries;
+    // The journal of completed items, or NULL
+    journal_t *journal;
+    // The arenas for the items' JSON, or NULL if JSON is allocated
+    // with malloc. There is one for each slot in the ring, and one
+    // for the item being read.
+    arena_t *arenas;
+    // The arenas not in use
+    arena_t **free_arenas;
+    size_t num_free_arenas;
+    // The arenas of the items of the outputs
+    arena_t **output_arenas;
+    // True when there are no more items to read
+    int input_done;
+    // True when there are no more outputs to queue
+    int output_done;
+    // True when all the output written has been passed to stdout,
+    // rather than held in the writer's buffer
+    int output_flushed;
+    // The number of items waiting to write raw data to stdout
+    int raw_waiting;
+    // True while an item is writing raw data to stdout
+    int raw_active;
+    // Non-zero when processing must stop
+    int status;
+    int *item_count;
+    int *error_count;
+    // The iRODS connections used to execute items
+    connection_pool_t *connections;
+    // Adaptive limit on the number of items executing, or NULL
+    concurrency_controller_t *controller;
+    // Mutex protecting all of the above
+    pthread_mutex_t lock;
+    // Signalled when an item is available for execution
+    pthread_cond_t work_cond;
+    // Signalled when there is space to read another item
+    pthread_cond_t space_cond;
+    // Signalled when output is queued
+    pthread_cond_t output_cond;
+    // Held while writing to stdout, by the writer or by an item
+    // writing raw data. Taken without the pool lock held.
+    pthread_mutex_t stdout_lock;
+} work_pool_t;
+
+// Stop all processing. Must be called with the pool lock held.
+static void abort_pool(work_pool_t *pool, const int status) {
+    if (pool->status == 0) pool->status = status;
+    pthread_cond_broadcast(&pool->work_cond);
+    pthread_cond_broadcast(&pool->space_cond);
+}
+
+// Wait on a pool condition variable. The wait is limited so that a
+// signal delivered to another thread is noticed promptly. Must be
+// called with the pool lock held.
+static void wait_for_pool(work_pool_t *pool, pthread_cond_t *cond) {
+    struct timespec abs_timeout;
+    clock_gettime(CLOCK_REALTIME, &abs_timeout);
+    abs_timeout.tv_sec += 1;
+
+    pthread_cond_timedwait(cond, &pool->lock, &abs_timeout);
+
+    if (exit_flag) abort_pool(pool, exit_flag);
+}
+
+static void free_work_item(work_item_t *witem) {
+    if (witem->prepared) free_prepared_op(&witem->op);
+    json_decref(witem->output);
+    json_decref(witem->item);
+    memset(witem, 0, sizeof (work_item_t));
+}
+
+// Return true if an item is a bulk data transfer
+static int is_bulk_item(const work_item_t *witem) {
+    if (!witem->prepared) return 0;
+
+    const char *op = witem->op.name;
+
+    return str_equals(op, JSON_GET_OP, MAX_STR_LEN) ||
+        str_equals(op, JSON_PUT_OP, MAX_STR_LEN) ||
+        (str_equals(op, JSON_CHECKSUM_OP, MAX_STR_LEN) &&
+         (witem->op.args.flags & CALCULATE_CHECKSUM));
+}
+
+// Return the number of items waiting to be executed. Must be called
+// with the pool lock held.
+static size_t num_queued(const work_pool_t *pool) {
+    size_t n = 0;
+    for (int i = 0; i < NUM_LANES; i++) {
+        n += pool->lanes[i].tail - pool->lanes[i].head;
+    }
+
+    return n;
+}
+
+// Return the lane from which the next item should be taken, or -1 if
+// no item may be taken. Must be called with the pool lock held.
+static int next_lane(const work_pool_t *pool) {
+    const lane_t *control = &pool->lanes[CONTROL_LANE];
+    const lane_t *bulk    = &pool->lanes[BULK_LANE];
+
+    if (control->head < control->tail) return CONTROL_LANE;
+    if (bulk->head < bulk->tail && pool->num_bulk < pool->bulk_limit) {
+        return BULK_LANE;
+    }
+
+    return -1;
+}
+
+// Take an arena for the next item read, waiting until one is free.
+// Returns NULL if processing must stop.
+static arena_t *take_arena(work_pool_t *pool) {
+    arena_t *arena = NULL;
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->status == 0 && pool->num_free_arenas == 0) {
+        wait_for_pool(pool, &pool->space_cond);
+    }
+    if (pool->status == 0) {
+        arena = pool->free_arenas[--pool->num_free_arenas];
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return arena;
+}
+
+// Return true if processing must stop.
+static int is_pool_stopped(work_pool_t *pool) {
+    pthread_mutex_lock(&pool->lock);
+    const int stopped = pool->status != 0;
+    pthread_mutex_unlock(&pool->lock);
+
+    return stopped || exit_flag;
+}
+
+// The size of the buffer in which the reader thread reads input
+#define INPUT_BUFFER_SIZE (64 * 1024)
+
+// The state of the input stream of the reader thread. The stream's
+// descriptor is read directly, through a buffer, so that waiting for
+// input may be interrupted without changing the descriptor's flags,
+// which are shared with other processes.
+typedef struct input_reader {
+    work_pool_t *pool;
+    int fd;
+    char buffer[INPUT_BUFFER_SIZE];
+    // The unread bytes in the buffer
+    size_t start;
+    size_t end;
+    // The offset in the input of the next unread byte, or -1 if the
+    // input is not seekable
+    long offset;
+    // True at end of input, or after an error
+    int eof;
+} input_reader_t;
+
+// Wait up to a second for a descriptor to become readable. Returns 0
+// on timeout, as poll.
+static int poll_input(const int fd) {
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+    return poll(&pfd, 1, 1000);
+}
+
+// A Jansson load callback that returns the input one byte at a time,
+// so that nothing beyond the end of an item is consumed, as with
+// json_loadf. The input is read only once poll reports it readable,
+// so that while waiting for input the reader notices when processing
+// must stop and abandons the item, allowing Jansson to free its
+// partial parse.
+static size_t read_input_byte(void *buffer, const size_t buflen,
+                              void *data) {
+    input_reader_t *reader = data;
+
+    if (buflen == 0) return 0;
+
+    while (reader->start == reader->end) {
+        if (reader->eof) return 0;
+
+        const int ready = poll_input(reader->fd);
+        if (ready == 0 || (ready < 0 && errno == EINTR)) {
+            if (is_pool_stopped(reader->pool)) return (size_t) -1;
+            continue;
+        }
+
+        const ssize_t n = ready < 0 ? -1 :
+            read(reader->fd, reader->buffer, sizeof reader->buffer);
+        if (n < 0 && (errno == EINTR || errno == EAGAIN)) continue;
+        if (n < 0) {
+            logmsg(ERROR, "Failed to read input: error %d %s",
+                   errno, strerror(errno));
+            reader->eof = 1;
+            return (size_t) -1;
+        }
+        if (n == 0) {
+            reader->eof = 1;
+            return 0;
+        }
+
+        reader->start = 0;
+        reader->end   = (size_t) n;
+    }
+
+    *(char *) buffer = reader->buffer[reader->start++];
+    if (reader->offset >= 0) reader->offset++;
+
+    return 1;
+}
+
+// Read items from the input stream into the ring, validating any
+// envelopes to be dispatched. Runs in its own thread, so that parsing
+// overlaps with execution.
+static void *read_items(void *arg) {
+    work_pool_t *pool = arg;
+
+    // Too large for the stack of a thread
+    input_reader_t *reader = calloc(1, sizeof (input_reader_t));
+    if (!reader) {
+        logmsg(ERROR, "Failed to allocate memory: error %d %s",
+               errno, strerror(errno));
+        pthread_mutex_lock(&pool->lock);
+        abort_pool(pool, 1);
+        pool->input_done = 1;
+        pthread_cond_broadcast(&pool->work_cond);
+        pthread_mutex_unlock(&pool->lock);
+        return NULL;
+    }
+    reader->pool = pool;
+    reader->fd   = fileno(pool->input);
+
+    // Items recorded in the journal are skipped. Where possible, the
+    // input is positioned after the run of them at its start, rather
+    // than reading and parsing them again.
+    size_t ordinal = 0;
+    journal_t *journal = pool->journal;
+    if (journal && journal->resume_offset >= 0) {
+        if (fseek(pool->input, journal->resume_offset, SEEK_SET) == 0) {
+            ordinal = journal->resume_ordinal;
+        }
+        else {
+            logmsg(WARN, "Failed to seek to item %zu in input; reading "
+                   "past completed items instead: error %d %s",
+                   journal->resume_ordinal, errno, strerror(errno));
+        }
+    }
+    reader->offset = ftell(pool->input);
+
+    // The arena of the item being read, kept for the next one if the
+    // item is skipped
+    arena_t *arena = NULL;
+
+    while (!reader->eof && !is_pool_stopped(pool)) {
+        const size_t jflags = JSON_DISABLE_EOF_CHECK | JSON_REJECT_DUPLICATES;
+        json_error_t load_error;
+
+        if (pool->arenas) {
+            if (arena) reset_arena(arena);
+            else       arena = take_arena(pool);
+            if (!arena) break;
+
+            set_thread_arena(arena);
+        }
+
+        json_t *item = json_load_callback(read_input_byte, reader, jflags,
+                                          &load_error); // JSON alloc
+        const long offset = journal ? reader->offset : -1;
+
+        if (!item) {
+            if (!reader->eof && !is_pool_stopped(pool)) {
+                logmsg(ERROR, "JSON error at line %d, column %d: %s",
+                       load_error.line, load_error.column, load_error.text);
+            }
+            continue;
+        }
+
+        if (!json_is_object(item)) {
+            pthread_mutex_lock(&pool->lock);
+            logmsg(ERROR, "Item %zu in stream was not a JSON object; "
+                   "skipping", pool->next_read);
+            (*pool->error_count)++;
+            pthread_mutex_unlock(&pool->lock);
+            json_decref(item);
+            continue;
+        }
+
+        const size_t item_ordinal = ordinal++;
+        if (journal && is_journalled(journal, item_ordinal)) {
+            json_decref(item);
+            continue;
+        }
+
+        work_item_t witem = { .item    = item,
+                              .ordinal = item_ordinal,
+                              .offset  = offset,
+                              .arena   = arena };
+        init_baton_error(&witem.error);
+
+        if (pool->fn == baton_json_dispatch_op) {
+            baton_json_prepare_op(item, pool->args, &witem.op, &witem.error);
+            witem.prepared = (witem.error.code == 0);
+        }
+
+        witem.lane = (pool->bulk_limit > 0 && is_bulk_item(&witem)) ?
+            BULK_LANE : CONTROL_LANE;
+
+        // Items may be taken out of order from different lanes, so an
+        // older item may still occupy the slot
+        pthread_mutex_lock(&pool->lock);
+        while (pool->status == 0 &&
+               (pool->next_read - pool->num_written >= pool->window ||
+                num_queued(pool) >= pool->depth ||
+                pool->items[pool->next_read % pool->window].item)) {
+            wait_for_pool(pool, &pool->space_cond);
+        }
+
+        if (pool->status != 0) {
+            pthread_mutex_unlock(&pool->lock);
+            free_work_item(&witem);
+            break;
+        }
+
+        lane_t *lane = &pool->lanes[witem.lane];
+        lane->seqs[lane->tail++ % pool->window] = pool->next_read;
+
+        witem.seq = pool->next_read;
+        pool->items[pool->next_read % pool->window] = witem;
+        pool->next_read++;
+        pthread_cond_signal(&pool->work_cond);
+        pthread_mutex_unlock(&pool->lock);
+
+        arena = NULL;
+    } // while
+
+    set_thread_arena(NULL);
+
+    // Leave the stream after the last item read, as json_loadf would
+    if (reader->offset >= 0) fseek(pool->input, reader->offset, SEEK_SET);
+    free(reader);
+
+    pthread_mutex_lock(&pool->lock);
+    if (arena) {
+        reset_arena(arena);
+        pool->free_arenas[pool->num_free_arenas++] = arena;
+    }
+    pool->input_done = 1;
+    pthread_cond_broadcast(&pool->work_cond);
+    pthread_mutex_unlock(&pool->lock);
+
+    return NULL;
+}
+
+// Take ownership of the next item to execute, waiting until one is
+// available. Returns 0 when there are no more items to execute.
+static int take_item(work_pool_t *pool, work_item_t *witem, size_t *seq) {
+    int taken = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    if (exit_flag) abort_pool(pool, exit_flag);
+
+    int lane = -1;
+    while (pool->status == 0) {
+        lane = next_lane(pool);
+        if (lane >= 0 || (pool->input_done && num_queued(pool) == 0)) break;
+
+        wait_for_pool(pool, &pool->work_cond);
+    }
+
+    if (pool->status == 0 && lane >= 0) {
+        *seq = pool->lanes[lane].seqs[pool->lanes[lane].head++ % pool->window];
+        if (lane == BULK_LANE) pool->num_bulk++;
+
+        work_item_t *slot = &pool->items[*seq % pool->window];
+        *witem = *slot;
+        memset(slot, 0, sizeof (work_item_t));
+        taken = 1;
+
+        pthread_cond_broadcast(&pool->space_cond);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return taken;
+}
+
+// Add JSON to the ring of outputs to be written. Must be called with
+// the pool lock held.
+static void push_output(work_pool_t *pool, const work_item_t *witem,
+                        json_t *output, const int is_item) {
+    const size_t index = pool->next_output % pool->output_window;
+    pool->outputs[index]      = output;
+    pool->item_outputs[index] = is_item;
+    pool->entries[index] = (journal_entry_t) { .ordinal = witem->ordinal,
+                                               .offset  = witem->offset };
+    if (pool->output_arenas) {
+        pool->output_arenas[index] = is_item ? witem->arena : NULL;
+    }
+    pool->next_output++;
+
+    pthread_cond_signal(&pool->output_cond);
+}
+
+// Queue the output of an item to be written. There is always room for
+// it, because the ring of outputs has a slot for every item in the
+// ring of items. Must be called with the pool lock held.
+static void queue_output(work_pool_t *pool, const work_item_t *witem,
+                         json_t *output) {
+    push_output(pool, witem, output, 1);
+    pool->next_print++;
+    (*pool->item_count)++;
+
+    // An item streaming rows may be waiting for its turn
+    pthread_cond_broadcast(&pool->space_cond);
+}
+
+// The item whose rows are being streamed
+typedef struct row_stream {
+    work_pool_t *pool;
+    const work_item_t *witem;
+} row_stream_t;
+
+// A query visitor that queues each row of a page to be written,
+// tagged with the "id" of the item or, if it has none, the item's
+// position in the input. In ordered mode, the rows are not queued
+// until the output of every earlier item has been. Waits while the
+// streamed rows fill their half of the ring of outputs.
+static int queue_rows(json_t *rows, void *data, baton_error_t *error) {
+    const row_stream_t *stream = data;
+    work_pool_t *pool = stream->pool;
+    const work_item_t *witem = stream->witem;
+    const int ordered = !(pool->args->flags & UNORDERED);
+    const json_t *id = json_object_get(witem->item, JSON_ID_KEY);
+
+    init_baton_error(error);
+
+    size_t i;
+    json_t *row;
+    json_array_foreach(rows, i, row) {
+        // A copy, so that the writer thread shares no references with
+        // the page
+        json_t *output = json_deep_copy(row);
+        json_t *row_id = id ? json_deep_copy(id) :
+            json_integer((json_int_t) witem->ordinal);
+        if (!output || !row_id) {
+            json_decref(output);
+            json_decref(row_id);
+            set_baton_error(error, -1, "Failed to allocate memory: "
+                            "error %d %s", errno, strerror(errno));
+            break;
+        }
+        json_object_set_new(output, JSON_ID_KEY, row_id);
+
+        pthread_mutex_lock(&pool->lock);
+        while (pool->status == 0 &&
+               ((ordered && pool->next_print != witem->seq) ||
+                (pool->next_output - pool->next_write) -
+                (pool->next_print - pool->num_written) >= pool->window)) {
+            wait_for_pool(pool, &pool->space_cond);
+        }
+
+        const int queued = (pool->status == 0);
+        if (queued) push_output(pool, witem, output, 0);
+        pthread_mutex_unlock(&pool->lock);
+
+        if (!queued) {
+            json_decref(output);
+            set_baton_error(error, -1, "Failed to print the rows of item "
+                            "%zu: processing stopped", witem->ordinal);
+            break;
+        }
+    }
+
+    return error->code;
+}
+
+// Wait until an item may write raw data to stdout: until the output
+// of every earlier item (in ordered mode) and everything queued has
+// been passed to stdout, and no other item is writing raw data. The
+// writer is then kept from stdout until end_raw_output.
+static int begin_raw_output(void *data, baton_error_t *error) {
+    const row_stream_t *stream = data;
+    work_pool_t *pool = stream->pool;
+    const work_item_t *witem = stream->witem;
+    const int ordered = !(pool->args->flags & UNORDERED);
+
+    init_baton_error(error);
+
+    pthread_mutex_lock(&pool->lock);
+    pool->raw_waiting++;
+    pthread_cond_signal(&pool->output_cond);
+    while (pool->status == 0 &&
+           ((ordered && pool->next_print != witem->seq) ||
+            pool->next_output > pool->next_write ||
+            !pool->output_flushed || pool->raw_active)) {
+        wait_for_pool(pool, &pool->space_cond);
+    }
+    pool->raw_waiting--;
+
+    const int started = (pool->status == 0);
+    if (started) pool->raw_active = 1;
+    pthread_mutex_unlock(&pool->lock);
+
+    if (!started) {
+        set_baton_error(error, -1, "Failed to write the data of item %zu: "
+                        "processing stopped", witem->ordinal);
+        return error->code;
+    }
+
+    pthread_mutex_lock(&pool->stdout_lock);
+
+    return error->code;
+}
+
+// Release stdout after an item has written raw data to it
+static void end_raw_output(void *data) {
+    const row_stream_t *stream = data;
+    work_pool_t *pool = stream->pool;
+
+    pthread_mutex_unlock(&pool->stdout_lock);
+
+    pthread_mutex_lock(&pool->lock);
+    pool->raw_active = 0;
+    pthread_cond_broadcast(&pool->space_cond);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+// Execute an item, using the validated envelope where there is one.
+// The rows of queries whose results are streamed are queued to be
+// written and raw data is written in turn with other output.
+static json_t *execute_item(rodsEnv *env, rcComm_t *conn, work_pool_t *pool,
+                            work_item_t *witem, baton_error_t *error) {
+    if (witem->error.code != 0) {
+        *error = witem->error;
+        return NULL;
+    }
+
+    row_stream_t stream = { .pool = pool, .witem = witem };
+
+    if (witem->prepared) {
+        witem->op.args.stream_rows = queue_rows;
+        witem->op.args.begin_raw   = begin_raw_output;
+        witem->op.args.end_raw     = end_raw_output;
+        witem->op.args.stream_data = &stream;
+        json_t *result = baton_json_execute_op(env, conn, &witem->op, error);
+        witem->op.args.stream_data = NULL;
+
+        return result;
+    }
+
+    operation_args_t args = *pool->args;
+    args.stream_rows = queue_rows;
+    args.begin_raw   = begin_raw_output;
+    args.end_raw     = end_raw_output;
+    args.stream_data = &stream;
+
+    set_query_page_size(args.page_size, args.flags & ADAPTIVE_PAGE_SIZE);
+
+    return pool->fn(env, conn, witem->item, &args, error);
+}
+
+// Queue the output of any completed items at the head of the ring, in
+// input order. Must be called with the pool lock held.
+static void queue_completed_items(work_pool_t *pool) {
+    while (pool->next_print < pool->next_read) {
+        work_item_t *witem = &pool->items[pool->next_print % pool->window];
+        if (!witem->done) break;
+
+        queue_output(pool, witem, witem->output);
+        witem->output = NULL;
+        free_work_item(witem);
+    }
+}
+
+// Complete an item taken for execution, queueing its output in the
+// order required
+static void complete_item(work_pool_t *pool, work_item_t *witem,
+                          const size_t seq, json_t *result,
+                          baton_error_t *error) {
+    pthread_mutex_lock(&pool->lock);
+
+    // A thread is free for another bulk item
+    if (witem->lane == BULK_LANE) {
+        pool->num_bulk--;
+        pthread_cond_broadcast(&pool->work_cond);
+    }
+
+    arena_t *previous = set_thread_arena(witem->arena);
+    json_t *output = make_output(witem->item, result, error, witem->ordinal,
+                                 pool->error_count);
+
+    if (pool->args->flags & UNORDERED) {
+        add_output_id(output, witem->item, witem->ordinal);
+    }
+    set_thread_arena(previous);
+
+    if (pool->args->flags & UNORDERED) {
+        queue_output(pool, witem, output);
+        free_work_item(witem);
+    }
+    else {
+        // The slot for this item is not reused until it is written
+        work_item_t *slot = &pool->items[seq % pool->window];
+        *slot = *witem;
+        slot->output = output;
+        slot->done   = 1;
+        queue_completed_items(pool);
+    }
+
+    pthread_mutex_unlock(&pool->lock);
+}
+
+// Serialise queued output into a buffer and write it in batches. Runs
+// in its own thread, so that serialisation is off the worker threads.
+// If the FLUSH flag is set, output is written and flushed whenever
+// there is no more queued, so latency stays low when items are
+// sparse. If a flush interval is set, buffered output is never held
+// for longer than that.
+static void *write_outputs(void *arg) {
+    work_pool_t *pool = arg;
+    const int flush = pool->args->flags & FLUSH;
+    const unsigned long interval = pool->args->flush_interval;
+
+    json_buffer_t buffer;
+    if (init_json_buffer(&buffer, OUTPUT_BUFFER_SIZE) != 0) {
+        logmsg(ERROR, "Failed to allocate memory: error %d %s",
+               errno, strerror(errno));
+        pthread_mutex_lock(&pool->lock);
+        abort_pool(pool, 1);
+        pthread_mutex_unlock(&pool->lock);
+        return NULL;
+    }
+
+    // The time by which buffered output must be written
+    struct timespec deadline = { 0, 0 };
+
+    pthread_mutex_lock(&pool->lock);
+    while (1) {
+        int pending = pool->next_output > pool->next_write;
+        int due     = 0;
+
+        while (!pending && !pool->output_done) {
+            if (buffer.length > 0 && (flush || pool->raw_waiting)) break;
+
+            struct timespec abs_timeout;
+            clock_gettime(CLOCK_REALTIME, &abs_timeout);
+            abs_timeout.tv_sec += 1;
+            if (buffer.length > 0 && interval > 0) abs_timeout = deadline;
+
+            const int status = pthread_cond_timedwait(&pool->output_cond,
+                                                      &pool->lock,
+                                                      &abs_timeout);
+            pending = pool->next_output > pool->next_write;
+            if (status == ETIMEDOUT && buffer.length > 0 && interval > 0) {
+                due = 1;
+                break;
+            }
+        }
+
+        const size_t first = pool->next_write;
+        const size_t last  = pool->next_output;
+        const int done     = pool->output_done && !pending;
+        // An item waiting to write raw data needs everything before it
+        // passed to stdout
+        const int raw      = pool->raw_waiting > 0;
+        pthread_mutex_unlock(&pool->lock);
+
+        // The producers do not reuse these slots until next_write has
+        // been advanced past them
+        size_t num_items = 0;
+        for (size_t i = first; i < last; i++) {
+            const size_t index = i % pool->output_window;
+            json_t **output = &pool->outputs[index];
+            if (buffer.length == 0 && interval > 0) {
+                clock_gettime(CLOCK_REALTIME, &deadline);
+                deadline.tv_sec  += interval / 1000;
+                deadline.tv_nsec += (interval % 1000) * 1000000;
+                if (deadline.tv_nsec >= 1000000000) {
+                    deadline.tv_sec++;
+                    deadline.tv_nsec -= 1000000000;
+                }
+            }
+
+            if (*output && append_json_buffer(&buffer, *output) != 0) {
+                logmsg(ERROR, "Failed to serialise output for item %zu",
+                       pool->entries[index].ordinal);
+            }
+            json_decref(*output);
+            *output = NULL;
+
+            // Streamed rows precede the output of their item
+            if (!pool->item_outputs[index]) continue;
+            num_items++;
+
+            // Nothing refers to the item's JSON once its output has
+            // been serialised
+            if (pool->output_arenas && pool->output_arenas[index]) {
+                reset_arena(pool->output_arenas[index]);
+            }
+
+            // Items are journalled once their output has been written
+            if (pool->journal) {
+                baton_error_t error;
+                stage_journal_entry(pool->journal, pool->entries[index],
+                                    &error);
+                if (error.code != 0) logmsg(ERROR, "%s", error.message);
+            }
+        }
+
+        if (buffer.length > 0 && interval > 0 && !due) {
+            struct timespec now;
+            clock_gettime(CLOCK_REALTIME, &now);
+            due = now.tv_sec > deadline.tv_sec ||
+                (now.tv_sec == deadline.tv_sec &&
+                 now.tv_nsec >= deadline.tv_nsec);
+        }
+
+        if (buffer.length >= OUTPUT_BUFFER_SIZE || due || done || raw ||
+            (flush && last == first)) {
+            int written = 1;
+            pthread_mutex_lock(&pool->stdout_lock);
+            if (write_json_buffer(&buffer, stdout) != 0) {
+                logmsg(ERROR, "Failed to write output: error %d %s",
+                       errno, strerror(errno));
+                written = 0;
+            }
+            if (flush || interval > 0 || pool->journal) {
+                if (fflush(stdout) != 0) written = 0;
+            }
+            pthread_mutex_unlock(&pool->stdout_lock);
+
+            if (pool->journal && written) {
+                baton_error_t error;
+                if (commit_journal(pool->journal, done, &error) != 0) {
+                    logmsg(ERROR, "%s", error.message);
+                }
+            }
+        }
+
+        pthread_mutex_lock(&pool->lock);
+        for (size_t i = first; pool->output_arenas && i < last; i++) {
+            arena_t **arena = &pool->output_arenas[i % pool->output_window];
+            if (*arena) pool->free_arenas[pool->num_free_arenas++] = *arena;
+            *arena = NULL;
+        }
+
+        pool->output_flushed = (buffer.length == 0);
+        if (last > first || (raw && pool->output_flushed)) {
+            pool->next_write   = last;
+            pool->num_written += num_items;
+            pthread_cond_broadcast(&pool->space_cond);
+        }
+
+        if (done) break;
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    free_json_buffer(&buffer);
+
+    return NULL;
+}
+
+// Execute an item, acquiring a connection from the pool for each
+// attempt. A connection that fails with a network error is closed, so
+// that the next attempt logs in afresh. Idempotent operations that fail
+// with a transient error are retried after a delay, up to
+// args->max_retries times. Failures to acquire a connection are
+// retried in the same way for any operation, because the operation has
+// not started; if they persist, the error is reported for the item. If
+// have_token is true, the item already holds a rate limit token for its
+// first attempt. Returns 0 if no connection could be acquired for any
+// other reason, otherwise 1.
+static int attempt_item(work_pool_t *pool, work_item_t *witem,
+                        const int have_token, unsigned *seed,
+                        json_t **result, baton_error_t *error) {
+    const char *op_name = witem->prepared ? witem->op.name : NULL;
+
+    // Retrying a query whose results are streamed would print them twice
+    const int retryable = is_idempotent_op(op_name) &&
+        !(witem->op.args.flags & STREAM_RESULTS);
+
+    for (unsigned attempt = 1; ; attempt++) {
+        // Wait for the rate limit before starting the operation, so
+        // that the wait is not counted as latency
+        if (witem->prepared && witem->op.args.rate_limits &&
+            !(have_token && attempt == 1)) {
+            wait_for_rate_limit(witem->op.args.rate_limits, op_name);
+        }
+
+        if (pool->controller) start_operation(pool->controller);
+
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        pooled_connection_t *pconn = acquire_connection(pool->connections,
+                                                        error);
+        if (!pconn) {
+            if (pool->controller) {
+                finish_operation(pool->controller, NULL, 0, error->code);
+            }
+            if (!is_connection_error(error->code)) return 0;
+        }
+        else {
+            arena_t *previous = set_thread_arena(witem->arena);
+            *result = execute_item(&pconn->env, pconn->conn, pool, witem,
+                                   error);
+            set_thread_arena(previous);
+            release_connection(pool->connections, pconn,
+                               !is_connection_error(error->code));
+
+            if (pool->controller) {
+                struct timespec end;
+                clock_gettime(CLOCK_MONOTONIC, &end);
+                const double latency = (double) (end.tv_sec - start.tv_sec) +
+                    (double) (end.tv_nsec - start.tv_nsec) / 1e9;
+
+                finish_operation(pool->controller, op_name, latency,
+                                 error->code);
+            }
+        }
+
+        if (error->code == 0 || !(pconn ? retryable : witem->prepared) ||
+            !is_transient_error(error->code) ||
+            attempt > pool->args->max_retries || exit_flag) {
+            break;
+        }
+
+        const double delay = retry_delay(attempt, seed);
+        logmsg(WARN, "Retrying operation '%s' on item %zu in %.1f seconds "
+               "(attempt %u of %u) after error code %d: %s", op_name,
+               witem->ordinal,
+               delay, attempt + 1, pool->args->max_retries + 1,
+               error->code, error->message);
+
+        json_decref(*result);
+        *result = NULL;
+        sleep_unless_signalled(delay);
+    }
+
+    return 1;
+}
+
+// Return true if an item is a list operation that may be listed
+// together with others in the same collection
+static int is_batchable_item(const work_item_t *witem) {
+    return witem->prepared && witem->error.code == 0 && witem->op.target &&
+        str_equals(witem->op.name, JSON_LIST_OP, MAX_STR_LEN) &&
+        is_batchable_target(witem->op.target, witem->op.args.flags);
+}
+
+// Return true if two batchable items may be listed together
+static int is_same_batch(const work_item_t *a, const work_item_t *b) {
+    baton_error_t error;
+    const char *coll_a = get_collection_value(a->op.target, &error);
+    const char *coll_b = get_collection_value(b->op.target, &error);
+
+    return a->op.args.flags == b->op.args.flags &&
+        a->op.args.page_size == b->op.args.page_size &&
+        str_equals(coll_a, coll_b, MAX_STR_LEN);
+}
+
+// Take the items that immediately follow the first item of a batch
+// and may be listed together with it, waiting up to the coalescing
+// window for them to be read. Returns the number of items in the
+// batch, including the first.
+static size_t take_batch(work_pool_t *pool, work_item_t batch[],
+                         size_t seqs[]) {
+    const unsigned long window = pool->args->coalesce_window;
+    size_t num_items = 1;
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec  += window / 1000;
+    deadline.tv_nsec += (window % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+
+    // List operations are always in the control lane
+    lane_t *lane = &pool->lanes[CONTROL_LANE];
+
+    pthread_mutex_lock(&pool->lock);
+    while (num_items < MAX_LIST_BATCH_SIZE && pool->status == 0) {
+        if (lane->head < lane->tail) {
+            const size_t seq = lane->seqs[lane->head % pool->window];
+            work_item_t *slot = &pool->items[seq % pool->window];
+            if (!is_batchable_item(slot) || !is_same_batch(&batch[0], slot)) {
+                break;
+            }
+
+            lane->head++;
+            seqs[num_items]  = seq;
+            batch[num_items] = *slot;
+            memset(slot, 0, sizeof (work_item_t));
+            num_items++;
+
+            pthread_cond_broadcast(&pool->space_cond);
+            continue;
+        }
+
+        if (pool->input_done) break;
+
+        const int status = pthread_cond_timedwait(&pool->work_cond,
+                                                  &pool->lock, &deadline);
+        if (status == ETIMEDOUT) break;
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return num_items;
+}
+
+// Execute a batch of list operations on data objects in one
+// collection with a single query. Each item takes a rate limit token
+// for the query. Items that the query does not answer, or all of them
+// if it fails, are executed one by one using that token.
+// Returns 0 if no connection could be acquired, otherwise 1.
+static int attempt_batch(work_pool_t *pool, work_item_t batch[],
+                         const size_t seqs[], const size_t num_items,
+                         unsigned *seed, baton_error_t *error) {
+    const char *data_names[MAX_LIST_BATCH_SIZE];
+    json_t *results[MAX_LIST_BATCH_SIZE] = { NULL };
+
+    baton_error_t coll_error;
+    const char *coll_name = get_collection_value(batch[0].op.target,
+                                                 &coll_error);
+    for (size_t i = 0; i < num_items; i++) {
+        data_names[i] = get_data_object_value(batch[i].op.target,
+                                              &coll_error);
+        if (batch[i].op.args.rate_limits) {
+            wait_for_rate_limit(batch[i].op.args.rate_limits,
+                                batch[i].op.name);
+        }
+    }
+
+    if (pool->controller) start_operation(pool->controller);
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    // If no connection can be acquired, the items are attempted one by
+    // one, so that the failure is retried for each of them
+    pooled_connection_t *pconn = acquire_connection(pool->connections, error);
+    if (!pconn) {
+        if (pool->controller) {
+            finish_operation(pool->controller, NULL, 0, error->code);
+        }
+        if (!is_connection_error(error->code)) {
+            for (size_t i = 0; i < num_items; i++) free_work_item(&batch[i]);
+
+            return 0;
+        }
+    }
+    else {
+        logmsg(DEBUG, "Listing %zu data objects in '%s' together",
+               num_items, coll_name);
+
+        set_query_page_size(batch[0].op.args.page_size,
+                            batch[0].op.args.flags & ADAPTIVE_PAGE_SIZE);
+
+        baton_error_t list_error;
+        list_data_objects(pconn->conn, coll_name, data_names, num_items,
+                          batch[0].op.args.flags, results, &list_error);
+        release_connection(pool->connections, pconn,
+                           !is_connection_error(list_error.code));
+
+        if (pool->controller) {
+            struct timespec end;
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            const double latency = (double) (end.tv_sec - start.tv_sec) +
+                (double) (end.tv_nsec - start.tv_nsec) / 1e9;
+
+            // The latency is shared between the items, so that it is
+            // comparable with that of items listed one by one
+            finish_operation(pool->controller, batch[0].op.name,
+                             latency / num_items, list_error.code);
+        }
+    }
+
+    for (size_t i = 0; i < num_items; i++) {
+        json_t *result = results[i];
+        baton_error_t item_error;
+        init_baton_error(&item_error);
+
+        if (!result) {
+            // The item took a rate limit token for the batch query
+            if (!attempt_item(pool, &batch[i], 1, seed, &result,
+                              &item_error)) {
+                *error = item_error;
+                for (size_t j = i; j < num_items; j++) {
+                    free_work_item(&batch[j]);
+                }
+                return 0;
+            }
+        }
+
+        complete_item(pool, &batch[i], seqs[i], result, &item_error);
+    }
+
+    return 1;
+}
 
-// Mutex protecting the connection and the run_timeout_thread flag
-pthread_mutex_t conn_mutex = PTHREAD_MUTEX_INITIALIZER;
-// The connection used by iterate_json and connection_timeout
-rcComm_t *connection;
-// While true, the client will continue to run the timeout thread
-int run_timeout_thread = 1;
-// Condition variable to exit the timeout thread when work is complete
-pthread_cond_t watchdog_cond = PTHREAD_COND_INITIALIZER;
+// Execute items until there are no more. Runs in each worker thread.
+static void *execute_items(void *arg) {
+    work_pool_t *pool = arg;
 
-// Refresh the connection every timeout seconds
-void *connection_timeout(void *timeout) {
-    int tsec = *((int *) timeout);
+    // Each thread has its own random state for retry delays
+    unsigned seed = (unsigned) time(NULL) ^ (unsigned) (uintptr_t) &seed;
 
-    struct timespec abs_timeout;
+    work_item_t batch[MAX_LIST_BATCH_SIZE];
+    size_t seqs[MAX_LIST_BATCH_SIZE];
+    baton_error_t error;
 
-    pthread_mutex_lock(&conn_mutex);
-    while (run_timeout_thread) {
-        clock_gettime(CLOCK_REALTIME, &abs_timeout);
-        abs_timeout.tv_sec += tsec;
-
-        int status;
-        do {
-            status = pthread_cond_timedwait(&watchdog_cond, &conn_mutex,
-                                            &abs_timeout);
-        } while (status == EINTR);
-        
-        if (status == ETIMEDOUT) {
-            if (connection) {
-                rcDisconnect(connection);
-                connection = NULL;
-                logmsg(NOTICE, "Closed the iRODS connection after a timeout "
-                       "of %d seconds", tsec);
+    while (take_item(pool, &batch[0], &seqs[0])) {
+        int executed;
+
+        if (pool->args->coalesce_window > 0 && is_batchable_item(&batch[0])) {
+            const size_t num_items = take_batch(pool, batch, seqs);
+            if (num_items > 1) {
+                executed = attempt_batch(pool, batch, seqs, num_items, &seed,
+                                         &error);
+                if (!executed) goto abort;
+                continue;
             }
         }
+
+        json_t *result = NULL;
+        executed = attempt_item(pool, &batch[0], 0, &seed, &result, &error);
+        if (!executed) {
+            free_work_item(&batch[0]);
+            goto abort;
+        }
+
+        complete_item(pool, &batch[0], seqs[0], result, &error);
+    } // while
+
+    return NULL;
+
+abort:
+    logmsg(ERROR, "%s", error.message);
+
+    pthread_mutex_lock(&pool->lock);
+    abort_pool(pool, 1);
+    pthread_mutex_unlock(&pool->lock);
+
+    return NULL;
+}
+
+static int run_workers(work_pool_t *pool, const unsigned num_threads) {
+    int status = 0;
+
+    pthread_t *tids = calloc(num_threads, sizeof (pthread_t));
+    if (!tids) {
+        logmsg(ERROR, "Failed to allocate memory: error %d %s",
+               errno, strerror(errno));
+        return 1;
+    }
+
+    unsigned num_started = 0;
+    for (unsigned i = 0; i < num_threads; i++) {
+        const int thread_status = pthread_create(&tids[i], NULL,
+                                                 &execute_items, pool);
+        if (thread_status != 0) {
+            logmsg(ERROR, "Failed to start worker thread: %s",
+                   strerror(thread_status));
+            status = 1;
+            break;
+        }
+        num_started++;
+    }
+
+    logmsg(DEBUG, "Started %u worker threads", num_started);
+
+    if (status != 0) {
+        pthread_mutex_lock(&pool->lock);
+        abort_pool(pool, status);
+        pthread_mutex_unlock(&pool->lock);
+    }
+
+    for (unsigned i = 0; i < num_started; i++) {
+        const int join_status = pthread_join(tids[i], NULL);
+        if (join_status != 0) {
+            logmsg(ERROR, "Worker thread failed to join: %s",
+                   strerror(join_status));
+        }
     }
-    pthread_mutex_unlock(&conn_mutex);
 
-    return 0;
+    free(tids);
+
+    return status;
 }
 
-static int iterate_json(FILE *input, rodsEnv *env, const baton_json_op fn,
+static int iterate_json(FILE *input, const baton_json_op fn,
                         operation_args_t *args,
                         int *item_count, int *error_count) {
-    int status  = 0;
-    int timeout = args->max_connect_time;
-    pthread_t tid;
-    int thread_status = -1;
-
-    if (timeout < 10) {
+    int status = 0;
+    const unsigned num_threads = args->num_threads > 1 ? args->num_threads : 1;
+    const size_t depth = args->prefetch_depth > 0 ? args->prefetch_depth :
+        DEFAULT_PREFETCH_DEPTH;
+
+    pthread_t reader_tid;
+    int reader_status = -1;
+    pthread_t writer_tid;
+    int writer_status = -1;
+
+    work_pool_t pool = { .input       = input,
+                         .fn          = fn,
+                         .args        = args,
+                         .items       = NULL,
+                         .window      = num_threads * ITEMS_PER_THREAD + depth,
+                         .depth       = depth,
+                         .next_read   = 0,
+                         .lanes       = { { NULL, 0, 0 } },
+                         .bulk_limit  = 0,
+                         .num_bulk    = 0,
+                         .next_print  = 0,
+                         .next_output = 0,
+                         .next_write  = 0,
+                         .num_written = 0,
+                         .outputs     = NULL,
+                         .output_window = 0,
+                         .item_outputs  = NULL,
+                         .entries     = NULL,
+                         .journal     = NULL,
+                         .arenas      = NULL,
+                         .free_arenas = NULL,
+                         .num_free_arenas = 0,
+                         .output_arenas   = NULL,
+                         .input_done  = 0,
+                         .output_done = 0,
+                         .output_flushed = 1,
+                         .raw_waiting = 0,
+                         .raw_active  = 0,
+                         .status      = 0,
+                         .item_count  = item_count,
+                         .error_count = error_count,
+                         .connections = NULL,
+                         .controller  = NULL };
+    concurrency_controller_t controller;
+    journal_t journal;
+
+    if (args->max_connect_time < 10) {
         logmsg(ERROR, "The connection timeout (--connect-time argument) "
                "must be >=10 seconds");
+        return 1;
+    }
+
+    if (num_threads > MAX_NUM_THREADS) {
+        logmsg(ERROR, "The number of threads (--threads argument) "
+               "must be <=%d", MAX_NUM_THREADS);
+        return 1;
+    }
+
+    // An item streaming rows in ordered mode waits for every earlier
+    // item, so items are taken in input order; otherwise all the
+    // threads could wait on a bulk item that none of them is free to
+    // take
+    const int ordered_stream = (args->flags & STREAM_RESULTS) &&
+        !(args->flags & UNORDERED);
+    if (args->bulk_threads > 0 && ordered_stream) {
+        logmsg(WARN, "Ignoring the bulk thread limit because results are "
+               "streamed in input order");
+    }
+    else if (args->bulk_threads > 0) {
+        pool.bulk_limit = args->bulk_threads < num_threads ?
+            args->bulk_threads : num_threads;
+        logmsg(DEBUG, "Executing bulk transfers in at most %zu of %u "
+               "threads", pool.bulk_limit, num_threads);
+    }
+
+    pthread_mutex_init(&pool.lock, NULL);
+    pthread_cond_init(&pool.work_cond, NULL);
+    pthread_cond_init(&pool.space_cond, NULL);
+    pthread_cond_init(&pool.output_cond, NULL);
+    pthread_mutex_init(&pool.stdout_lock, NULL);
+
+    pool.output_window = pool.window * 2;
+    pool.items        = calloc(pool.window, sizeof (work_item_t));
+    pool.outputs      = calloc(pool.output_window, sizeof (json_t *));
+    pool.item_outputs = calloc(pool.output_window, sizeof (int));
+    pool.entries      = calloc(pool.output_window, sizeof (journal_entry_t));
+    for (int i = 0; i < NUM_LANES; i++) {
+        pool.lanes[i].seqs = calloc(pool.window, sizeof (size_t));
+    }
+    if (!pool.items || !pool.outputs || !pool.item_outputs || !pool.entries ||
+        !pool.lanes[CONTROL_LANE].seqs || !pool.lanes[BULK_LANE].seqs) {
+        logmsg(ERROR, "Failed to allocate memory: error %d %s",
+               errno, strerror(errno));
         status = 1;
         goto finally;
     }
 
-    thread_status = pthread_create(&tid, NULL, &connection_timeout, &timeout);
-    if (thread_status != 0) {
-        logmsg(ERROR, "Failed to start connection management thread: %d", thread_status);
+    baton_error_t error;
+    pool.connections = make_connection_pool(num_threads,
+                                            args->max_connect_time, &error);
+    if (error.code != 0) {
+        logmsg(ERROR, "%s", error.message);
+        status = 1;
         goto finally;
     }
 
-    while (!exit_flag && !feof(input)) {
-        const size_t jflags = JSON_DISABLE_EOF_CHECK | JSON_REJECT_DUPLICATES;
-        json_error_t load_error;
-        json_t *item = json_loadf(input, jflags, &load_error); // JSON alloc
+    if (args->flags & ADAPTIVE_CONCURRENCY) {
+        init_concurrency_controller(&controller, 1, num_threads, 1);
+        pool.controller = &controller;
+    }
 
-        if (!item) {
-            if (!feof(input)) {
-                logmsg(ERROR, "JSON error at line %d, column %d: %s",
-                       load_error.line, load_error.column, load_error.text);
-            }
-            continue;
+    if (args->flags & ARENA_ALLOC) {
+        if (!arena_allocator_installed()) {
+            logmsg(ERROR, "Failed to allocate JSON from arenas: the arena "
+                   "allocator is not installed");
+            status = 1;
+            goto finally;
         }
 
-        if (!json_is_object(item)) {
-            logmsg(ERROR, "Item %d in stream was not a JSON object; skipping",
-                   item_count);
-            (*error_count)++;
-            json_decref(item);
-            continue;
+        const size_t num_arenas = pool.window + 1;
+        pool.arenas        = calloc(num_arenas, sizeof (arena_t));
+        pool.free_arenas   = calloc(num_arenas, sizeof (arena_t *));
+        pool.output_arenas = calloc(pool.output_window, sizeof (arena_t *));
+        if (!pool.arenas || !pool.free_arenas || !pool.output_arenas) {
+            logmsg(ERROR, "Failed to allocate memory: error %d %s",
+                   errno, strerror(errno));
+            status = 1;
+            goto finally;
         }
 
-        pthread_mutex_lock(&conn_mutex); // Lock before connecting and executing a job
-        logmsg(DEBUG, "Work to do, lock obtained");
-        if (!connection) {
-            logmsg(NOTICE, "Opening a new iRODS connection");
-            connection = rods_login(env);
-            if (!connection) {
-                status = 1;
-                pthread_mutex_unlock(&conn_mutex);
-                goto finally;
-            }
+        for (size_t i = 0; i < num_arenas; i++) {
+            init_arena(&pool.arenas[i], DEFAULT_ARENA_BLOCK_SIZE);
+            pool.free_arenas[pool.num_free_arenas++] = &pool.arenas[i];
         }
+    }
 
-        baton_error_t error;
-        json_t *result = fn(env, connection, item, args, &error);
-        pthread_mutex_unlock(&conn_mutex); // Unlock before processing the result
-        logmsg(DEBUG, "Work done, lock released");
-
-        if (error.code != 0) {
-            // On error, add an error report to the input JSON as a
-            // property and print the input JSON. A NULL result should
-            // always be an error.
-            (*error_count)++;
-            add_error_value(item, &error);
-            print_json(item);
-        }
-        else {
-            if (has_operation(item) && has_operation_target(item)) {
-                // It's an envelope, so we add the result to the input
-                // JSON as a property and print the input JSON, The
-                // result will be freed as part of the input JSON.
-                baton_error_t rerror;
-                add_result(item, result, &rerror);
-                if (rerror.code != 0) {
-                    logmsg(ERROR, "Failed to add error report to item %d "
-                           "in stream. Error code %d: %s", item_count,
-                           rerror.code, rerror.message);
-                    (*error_count)++;
-                }
-                print_json(item);
-            }
-            else {
-                // There is no envelope and there is some result JSON,
-                // so we print the result JSON. The result is not
-                // freed as part of the input JSON, so we free it here.
-                print_json(result);
-                json_decref(result);
-            }
+    if (args->journal_path) {
+        if (open_journal(&journal, args->journal_path, &error) != 0) {
+            logmsg(ERROR, "%s", error.message);
+            status = 1;
+            goto finally;
         }
+        pool.journal = &journal;
+    }
+
+    reader_status = pthread_create(&reader_tid, NULL, &read_items, &pool);
+    if (reader_status != 0) {
+        logmsg(ERROR, "Failed to start input reader thread: %s",
+               strerror(reader_status));
+        status = 1;
+        goto finally;
+    }
 
-        if (args->flags & FLUSH) fflush(stdout);
+    writer_status = pthread_create(&writer_tid, NULL, &write_outputs, &pool);
+    if (writer_status != 0) {
+        logmsg(ERROR, "Failed to start output writer thread: %s",
+               strerror(writer_status));
+        status = 1;
+        goto finally;
+    }
 
-        (*item_count)++;
+    status = run_workers(&pool, num_threads);
 
-        json_decref(item); // JSON free
-    } // while
+    pthread_mutex_lock(&pool.lock);
+    if (status != 0) abort_pool(&pool, status);
+    status = pool.status;
+    pthread_mutex_unlock(&pool.lock);
 
     if (exit_flag) {
-      status = exit_flag;
-      logmsg(WARN, "Exiting on signal with code %d", exit_flag);
-      goto finally;
+        status = exit_flag;
+        logmsg(WARN, "Exiting on signal with code %d", exit_flag);
     }
 
 finally:
-    pthread_mutex_lock(&conn_mutex);
-    run_timeout_thread = 0;
-    pthread_cond_signal(&watchdog_cond); // Unblock the thread waiting on cond
+    if (reader_status == 0) {
+        // On error the reader may be waiting for input that will never
+        // arrive; stopping the pool makes it abandon the read
+        if (status != 0) {
+            pthread_mutex_lock(&pool.lock);
+            abort_pool(&pool, status);
+            pthread_mutex_unlock(&pool.lock);
+        }
 
-    if (connection) {
-        rcDisconnect(connection);
-        connection = NULL;
-        logmsg(NOTICE, "Closed the connection on exit")
+        const int join_status = pthread_join(reader_tid, NULL);
+        if (join_status != 0) {
+            logmsg(ERROR, "Input reader thread failed to join: %s",
+                   strerror(join_status));
+        }
     }
-    pthread_mutex_unlock(&conn_mutex);
 
-    if (thread_status == 0) {
-        status = pthread_join(tid, NULL);
-        if (status != 0) {
-            logmsg(ERROR, "Timeout thread failed to join: %s", strerror(status));
+    if (writer_status == 0) {
+        pthread_mutex_lock(&pool.lock);
+        pool.output_done = 1;
+        pthread_cond_signal(&pool.output_cond);
+        pthread_mutex_unlock(&pool.lock);
+
+        const int join_status = pthread_join(writer_tid, NULL);
+        if (join_status != 0) {
+            logmsg(ERROR, "Output writer thread failed to join: %s",
+                   strerror(join_status));
+        }
+    }
+
+    free_connection_pool(pool.connections);
+
+    // Closed after the writer has committed the last of the entries
+    if (pool.journal) close_journal(pool.journal);
+
+    if (pool.controller) {
+        logmsg(DEBUG, "Finished with concurrency %u",
+               get_concurrency_limit(pool.controller));
+        free_concurrency_controller(pool.controller);
+    }
+
+    // Free any items abandoned on error or signal
+    if (pool.items) {
+        for (size_t i = 0; i < pool.window; i++) {
+            free_work_item(&pool.items[i]);
         }
+        free(pool.items);
     }
+    if (pool.outputs) {
+        for (size_t i = 0; i < pool.output_window; i++) {
+            json_decref(pool.outputs[i]);
+        }
+        free(pool.outputs);
+    }
+    if (pool.item_outputs) free(pool.item_outputs);
+    if (pool.entries) free(pool.entries);
+    for (int i = 0; i < NUM_LANES; i++) {
+        if (pool.lanes[i].seqs) free(pool.lanes[i].seqs);
+    }
+
+    // Freed after all of the items' JSON
+    if (pool.arenas) {
+        for (size_t i = 0; i < pool.window + 1; i++) {
+            free_arena(&pool.arenas[i]);
+        }
+        free(pool.arenas);
+    }
+    if (pool.free_arenas)   free(pool.free_arenas);
+    if (pool.output_arenas) free(pool.output_arenas);
+
+    pthread_cond_destroy(&pool.output_cond);
+    pthread_cond_destroy(&pool.space_cond);
+    pthread_cond_destroy(&pool.work_cond);
+    pthread_mutex_destroy(&pool.stdout_lock);
+    pthread_mutex_destroy(&pool.lock);
 
     return status;
 }
@@ -195,15 +1571,13 @@ int do_operation(FILE *input, const baton_json_op fn, operation_args_t *args) {
     int item_count  = 0;
     int error_count = 0;
     int status      = 0;
-    
-    rodsEnv env;
 
     if (!input) {
       status = 1;
       goto error;
     }
 
-    status = iterate_json(input, &env, fn, args, &item_count, &error_count);
+    status = iterate_json(input, fn, args, &item_count, &error_count);
     if (status != 0) goto error;
 
     if (error_count > 0) {
@@ -225,32 +1599,47 @@ error:
     return status;
 }
 
-json_t *baton_json_dispatch_op(rodsEnv *env, rcComm_t *conn, json_t *envelope,
-                               const operation_args_t *args, baton_error_t *error) {
-    json_t *result = NULL;
+int baton_json_prepare_op(json_t *envelope, const operation_args_t *args,
+                          prepared_op_t *prepared, baton_error_t *error) {
+    operation_args_t args_copy = *args;
+    args_copy.path = NULL;
 
-    operation_args_t args_copy = { .flags       = args->flags,
-                                   .buffer_size = args->buffer_size,
-                                   .zone_name   = args->zone_name,
-                                   .path        = NULL };
+    init_baton_error(error);
 
     const char *op = get_operation(envelope, error);
-    if (error->code != 0) goto finally;
+    if (error->code != 0) goto error;
 
     if (!op) {
         set_baton_error(error, -1, "No baton operation given");
-        goto finally;
+        goto error;
     }
 
-    json_t *target = get_operation_target(envelope, error);
-    if (error->code != 0) goto finally;
+    json_t *target  = NULL;
+    json_t *targets = NULL;
+    if (has_operation_targets(envelope)) {
+        if (has_operation_target(envelope)) {
+            set_baton_error(error, CAT_INVALID_ARGUMENT,
+                            "Invalid envelope: both '%s' and '%s' given",
+                            JSON_TARGET_KEY, JSON_TARGETS_KEY);
+            goto error;
+        }
+
+        targets = get_operation_targets(envelope, error);
+        if (error->code != 0) goto error;
+    }
+    else {
+        target = get_operation_target(envelope, error);
+        if (error->code != 0) goto error;
+    }
 
     if (has_operation(envelope)) {
         const json_t *jargs = get_operation_args(envelope, error);
-        if (error->code != 0)  goto finally;
+        if (error->code != 0)  goto error;
 
         option_flags flags = args_copy.flags;
         if (op_acl_p(jargs))                 flags = flags | PRINT_ACL;
+        if (op_aggregate_p(jargs))           flags = flags | AGGREGATE_RESULTS;
+        if (op_server_aggregate_p(jargs))    flags = flags | AGGREGATE_RESULTS | SERVER_AGGREGATE;
         if (op_avu_p(jargs))                 flags = flags | PRINT_AVU;
         if (op_print_checksum_p(jargs))      flags = flags | PRINT_CHECKSUM;
         if (op_calculate_checksum_p(jargs))  flags = flags | CALCULATE_CHECKSUM | PRINT_CHECKSUM;
@@ -270,7 +1659,7 @@ json_t *baton_json_dispatch_op(rodsEnv *env, rcComm_t *conn, json_t *envelope,
 
         if (has_operation(jargs)) {
             const char *arg = get_operation(jargs, error);
-            if (error->code != 0) goto finally;
+            if (error->code != 0) goto error;
 
             logmsg(DEBUG, "Detected operation '%s'", op);
             if (str_equals(arg, JSON_ARG_META_ADD, MAX_STR_LEN)) {
@@ -282,88 +1671,379 @@ json_t *baton_json_dispatch_op(rodsEnv *env, rcComm_t *conn, json_t *envelope,
             else {
                 set_baton_error(error, -1,
                                 "Invalid baton operation argument '%s'", arg);
-              goto finally;
+              goto error;
             }
         }
 
         if (has_op_path(jargs)) {
             const char *path = get_op_path(jargs, error);
-            if (error->code != 0) goto finally;
+            if (error->code != 0) goto error;
 
             char *tmp = copy_str(path, MAX_STR_LEN);
             if (!tmp) {
                 set_baton_error(error, errno, "Failed to copy string '%s'",
                                 path);
-                goto finally;
+                goto error;
             }
 
             args_copy.path = tmp;
         }
+
+        if (has_op_page_size(jargs)) {
+            args_copy.page_size = get_op_page_size(jargs, error);
+            if (error->code != 0) goto error;
+        }
     }
 
+    prepared->name    = op;
+    prepared->target  = target;
+    prepared->targets = targets;
+    prepared->args    = args_copy;
+
+    return error->code;
+
+error:
+    if (args_copy.path) free(args_copy.path);
+
+    return error->code;
+}
+
+static json_t *execute_target(rodsEnv *env, rcComm_t *conn, const char *op,
+                              json_t *target, const operation_args_t *op_args,
+                              baton_error_t *error) {
+    json_t *result = NULL;
+
+    init_baton_error(error);
+
     logmsg(DEBUG, "Dispatching to operation '%s'", op);
 
     if (str_equals(op, JSON_CHMOD_OP, MAX_STR_LEN)) {
-        result = baton_json_chmod_op(env, conn, target, &args_copy, error);
+        result = baton_json_chmod_op(env, conn, target, op_args, error);
     }
     else if (str_equals(op, JSON_CHECKSUM_OP, MAX_STR_LEN)) {
-        result = baton_json_checksum_op(env, conn, target, &args_copy, error);
+        result = baton_json_checksum_op(env, conn, target, op_args, error);
         if (error->code != 0) goto finally;
 
-        if (args_copy.flags & PRINT_CHECKSUM) {
-            result = add_checksum_json_object(conn, result, error);
-            if (error->code != 0) goto finally;
+        if (op_args->flags & PRINT_CHECKSUM) {
+            // The result is a copy of the target
+            json_t *checksummed = add_checksum_json_object(conn, result,
+                                                           error);
+            if (error->code != 0) {
+                json_decref(result);
+                result = NULL;
+                goto finally;
+            }
+            result = checksummed;
         }
     }
     else if (str_equals(op, JSON_LIST_OP, MAX_STR_LEN)) {
-        result = baton_json_list_op(env, conn, target, &args_copy, error);
+        result = baton_json_list_op(env, conn, target, op_args, error);
         if (error->code != 0) goto finally;
     }
     else if (str_equals(op, JSON_METAMOD_OP, MAX_STR_LEN)) {
-        result = baton_json_metamod_op(env, conn, target, &args_copy, error);
+        result = baton_json_metamod_op(env, conn, target, op_args, error);
     }
     else if (str_equals(op, JSON_METAQUERY_OP, MAX_STR_LEN)) {
-        result = baton_json_metaquery_op(env, conn, target, &args_copy, error);
+        result = baton_json_metaquery_op(env, conn, target, op_args, error);
     }
     else if (str_equals(op, JSON_GET_OP, MAX_STR_LEN)) {
-        result = baton_json_get_op(env, conn, target, &args_copy, error);
+        result = baton_json_get_op(env, conn, target, op_args, error);
     }
     else if (str_equals(op, JSON_PUT_OP, MAX_STR_LEN)) {
-        if (args_copy.flags & SINGLE_SERVER) {
+        if (op_args->flags & SINGLE_SERVER) {
             logmsg(DEBUG, "Single-server mode, falling back "
                    "to operation 'write'");
-            result = baton_json_write_op(env, conn, target, &args_copy, error);
+            result = baton_json_write_op(env, conn, target, op_args, error);
         }
         else {
-            result = baton_json_put_op(env, conn, target, &args_copy, error);
+            result = baton_json_put_op(env, conn, target, op_args, error);
         }
         if (error->code != 0) goto finally;
 
-        if (args_copy.flags & PRINT_CHECKSUM) {
-            result = add_checksum_json_object(conn, result, error);
-            if (error->code != 0) goto finally;
+        if (op_args->flags & PRINT_CHECKSUM) {
+            // The result may be the target itself, which must not change
+            json_t *copy = json_copy(result);
+            json_decref(result);
+            result = NULL;
+            if (!copy) {
+                set_baton_error(error, -1, "Failed to allocate memory: "
+                                "error %d %s", errno, strerror(errno));
+                goto finally;
+            }
+
+            result = add_checksum_json_object(conn, copy, error);
+            if (error->code != 0) {
+                json_decref(copy);
+                result = NULL;
+                goto finally;
+            }
         }
     }
     else if (str_equals(op, JSON_MOVE_OP, MAX_STR_LEN)) {
-        result = baton_json_move_op(env, conn, target, &args_copy, error);
+        result = baton_json_move_op(env, conn, target, op_args, error);
     }
     else if (str_equals(op, JSON_RM_OP, MAX_STR_LEN)) {
-        result = baton_json_rm_op(env, conn, target, &args_copy, error);
+        result = baton_json_rm_op(env, conn, target, op_args, error);
     }
     else if (str_equals(op, JSON_MKCOLL_OP, MAX_STR_LEN)) {
-        result = baton_json_mkcoll_op(env, conn, target, &args_copy, error);
+        result = baton_json_mkcoll_op(env, conn, target, op_args, error);
     }
     else if (str_equals(op, JSON_RMCOLL_OP, MAX_STR_LEN)) {
-        result = baton_json_rmcoll_op(env, conn, target, &args_copy, error);
+        result = baton_json_rmcoll_op(env, conn, target, op_args, error);
     }
     else {
         set_baton_error(error, -1, "Invalid baton operation '%s'", op);
     }
 
 finally:
-    if (args_copy.path) free(args_copy.path);
+    return result;
+}
+
+// A target of a batch operation, with its position in the batch and
+// the collection by which it is grouped
+typedef struct batch_target {
+    size_t index;
+    char *parent;
+} batch_target_t;
+
+static int compare_batch_targets(const void *a, const void *b) {
+    const batch_target_t *ta = a;
+    const batch_target_t *tb = b;
+
+    const int cmp = strcmp(ta->parent, tb->parent);
+    if (cmp != 0) return cmp;
+
+    return (ta->index > tb->index) - (ta->index < tb->index);
+}
+
+// Return a newly allocated copy of the path of the collection
+// containing a target, or an empty string if the target has no valid
+// path. Such a target fails when executed, so needs no group.
+static char *target_parent(const json_t *target) {
+    baton_error_t error;
+    char *path = json_to_path(target, &error);
+    if (error.code != 0 || !path) {
+        if (path) free(path);
+        return copy_str("", 1);
+    }
+
+    char *slash = strrchr(path, '/');
+    if (slash == path)  slash[1] = '\0';
+    else if (slash)     slash[0] = '\0';
+    else                path[0]  = '\0';
+
+    return path;
+}
+
+// List together the data objects among a group of targets in one
+// collection, setting their results. Targets that are not listed are
+// left to be executed one by one.
+static void list_targets_together(rcComm_t *conn, json_t *targets,
+                                  const batch_target_t group[],
+                                  const size_t num_group,
+                                  const operation_args_t *op_args,
+                                  json_t *results) {
+    const char *data_names[MAX_LIST_BATCH_SIZE];
+    size_t indices[MAX_LIST_BATCH_SIZE];
+    const char *coll_name = NULL;
+    size_t num_names = 0;
+
+    for (size_t i = 0; i < num_group; i++) {
+        json_t *target = json_array_get(targets, group[i].index);
+        if (is_batchable_target(target, op_args->flags)) {
+            baton_error_t error;
+            coll_name = get_collection_value(target, &error);
+            data_names[num_names] = get_data_object_value(target, &error);
+            indices[num_names]    = group[i].index;
+            num_names++;
+        }
+
+        if (num_names > 1 &&
+            (num_names == MAX_LIST_BATCH_SIZE || i == num_group - 1)) {
+            json_t *listed[MAX_LIST_BATCH_SIZE] = { NULL };
+            baton_error_t error;
+
+            list_data_objects(conn, coll_name, data_names, num_names,
+                              op_args->flags, listed, &error);
+            for (size_t j = 0; j < num_names; j++) {
+                if (listed[j]) {
+                    json_array_set_new(results, indices[j], listed[j]);
+                }
+            }
+        }
+
+        if (num_names == MAX_LIST_BATCH_SIZE) num_names = 0;
+    }
+}
+
+static json_t *execute_targets(rodsEnv *env, rcComm_t *conn, const char *op,
+                               json_t *targets,
+                               const operation_args_t *op_args,
+                               baton_error_t *error) {
+    const size_t num_targets = json_array_size(targets);
+    batch_target_t *batch = NULL;
+    json_t *results = NULL;
+    size_t num_failed = 0;
+
+    init_baton_error(error);
+
+    batch = calloc(num_targets > 0 ? num_targets : 1,
+                   sizeof (batch_target_t));
+    if (!batch) {
+        set_baton_error(error, errno, "Failed to allocate memory: "
+                        "error %d %s", errno, strerror(errno));
+        goto error;
+    }
+
+    results = json_array();
+    if (!results) {
+        set_baton_error(error, -1, "Failed to allocate a new JSON array");
+        goto error;
+    }
+
+    for (size_t i = 0; i < num_targets; i++) {
+        batch[i].index  = i;
+        batch[i].parent = target_parent(json_array_get(targets, i));
+        if (!batch[i].parent) {
+            set_baton_error(error, errno, "Failed to allocate memory: "
+                            "error %d %s", errno, strerror(errno));
+            goto error;
+        }
+        json_array_append_new(results, json_null());
+    }
+
+    // Targets in the same collection are executed together, so that
+    // the catalog sees a run of queries on one collection
+    qsort(batch, num_targets, sizeof (batch_target_t),
+          compare_batch_targets);
+
+    baton_error_t first_error;
+    init_baton_error(&first_error);
+
+    for (size_t i = 0; i < num_targets; i++) {
+        if (exit_flag) {
+            set_baton_error(error, exit_flag, "Interrupted after %zu of "
+                            "%zu targets", i, num_targets);
+            goto error;
+        }
+
+        if (i == 0 || strcmp(batch[i].parent, batch[i - 1].parent) != 0) {
+            logmsg(DEBUG, "Executing operation '%s' on targets in '%s'",
+                   op, batch[i].parent);
+
+            if (str_equals(op, JSON_LIST_OP, MAX_STR_LEN)) {
+                size_t num_group = 1;
+                while (i + num_group < num_targets &&
+                       strcmp(batch[i].parent,
+                              batch[i + num_group].parent) == 0) {
+                    num_group++;
+                }
+
+                list_targets_together(conn, targets, &batch[i], num_group,
+                                      op_args, results);
+            }
+        }
+
+        // The rate limit for the first target was applied on dispatch
+        if (i > 0 && op_args->rate_limits) {
+            wait_for_rate_limit(op_args->rate_limits, op);
+        }
+
+        // Targets listed together already have their results
+        if (!json_is_null(json_array_get(results, batch[i].index))) continue;
+
+        json_t *target = json_array_get(targets, batch[i].index);
+        baton_error_t target_error;
+        json_t *result = execute_target(env, conn, op, target, op_args,
+                                        &target_error);
+
+        if (target_error.code != 0) {
+            json_decref(result);
+            result = json_copy(target);
+            if (result) {
+                add_error_value(result, &target_error);
+            }
+            else {
+                logmsg(ERROR, "Failed to allocate memory for the error of "
+                       "target %zu: error %d %s", batch[i].index, errno,
+                       strerror(errno));
+            }
+
+            if (num_failed == 0) first_error = target_error;
+            num_failed++;
+        }
+        else if (!result) {
+            // An operation with no result reports its target
+            result = json_incref(target);
+        }
+
+        // A failed target whose error could not be recorded stays null
+        if (result) json_array_set_new(results, batch[i].index, result);
+    }
+
+    if (num_failed > 0) {
+        set_baton_error(error, first_error.code,
+                        "Operation '%s' failed on %zu of %zu targets, "
+                        "the first with error: %s", op, num_failed,
+                        num_targets, first_error.message);
+    }
+
+    for (size_t i = 0; i < num_targets; i++) free(batch[i].parent);
+    free(batch);
+
+    return results;
+
+error:
+    if (batch) {
+        for (size_t i = 0; i < num_targets; i++) {
+            if (batch[i].parent) free(batch[i].parent);
+        }
+        free(batch);
+    }
+    json_decref(results);
+
+    return NULL;
+}
+
+json_t *baton_json_execute_op(rodsEnv *env, rcComm_t *conn,
+                              prepared_op_t *prepared, baton_error_t *error) {
+    // Queries made by the operation use the page size from its arguments
+    set_query_page_size(prepared->args.page_size,
+                        prepared->args.flags & ADAPTIVE_PAGE_SIZE);
+
+    if (prepared->targets) {
+        return execute_targets(env, conn, prepared->name, prepared->targets,
+                               &prepared->args, error);
+    }
+
+    return execute_target(env, conn, prepared->name, prepared->target,
+                          &prepared->args, error);
+}
+
+void free_prepared_op(prepared_op_t *prepared) {
+    if (prepared->args.path) free(prepared->args.path);
+    prepared->args.path = NULL;
+}
+
+json_t *baton_json_dispatch_op(rodsEnv *env, rcComm_t *conn, json_t *envelope,
+                               const operation_args_t *args, baton_error_t *error) {
+    json_t *result = NULL;
+    prepared_op_t prepared;
+
+    baton_json_prepare_op(envelope, args, &prepared, error);
+    if (error->code != 0) goto error;
+
+    if (prepared.args.rate_limits) {
+        wait_for_rate_limit(prepared.args.rate_limits, prepared.name);
+    }
+
+    result = baton_json_execute_op(env, conn, &prepared, error);
+    free_prepared_op(&prepared);
 
     return result;
+
+error:
+    return NULL;
 }
 
 json_t *baton_json_list_op(rodsEnv *env, rcComm_t *conn, json_t *target,
@@ -414,11 +2094,7 @@ json_t *baton_json_chmod_op(rodsEnv *env, rcComm_t *conn, json_t *target,
         if (error->code != 0) goto finally;
     }
 
-    result = json_deep_copy(target);
-    if (!result) {
-        set_baton_error(error, -1, "Internal error: failed to deep-copy "
-                        "result for %s", path);
-    }
+    result = json_incref(target);
 
 finally:
     if (path) free(path);
@@ -453,17 +2129,22 @@ json_t *baton_json_checksum_op(rodsEnv *env, rcComm_t *conn, json_t *target,
     jchecksum = checksum_to_json(checksum, error);
     if (error->code != 0) goto finally;
 
-    add_checksum(target, jchecksum, error);
-    if (error->code != 0) {
-        // Only free this on error. On success, it becomes owned by target
+    // The target is shared with the envelope, so it does not change
+    result = json_copy(target);
+    if (!result) {
+        set_baton_error(error, -1, "Failed to allocate memory: error %d %s",
+                        errno, strerror(errno));
         json_decref(jchecksum);
         goto finally;
     }
 
-    result = json_deep_copy(target);
-    if (!result) {
-        set_baton_error(error, -1, "Internal error: failed to deep-copy "
-                        "result for %s", path);
+    add_checksum(result, jchecksum, error);
+    if (error->code != 0) {
+        // Only free this on error. On success, it becomes owned by result
+        json_decref(jchecksum);
+        json_decref(result);
+        result = NULL;
+        goto finally;
     }
 
 finally:
@@ -474,6 +2155,24 @@ finally:
     return result;
 }
 
+// A query visitor that prints each row of a page on its own line, for
+// queries executed outside a work pool
+static int print_rows(json_t *rows, void *data, baton_error_t *error) {
+    const option_flags *flags = data;
+
+    init_baton_error(error);
+
+    size_t i;
+    json_t *row;
+    json_array_foreach(rows, i, row) {
+        print_json(row);
+    }
+
+    if (*flags & FLUSH) fflush(stdout);
+
+    return error->code;
+}
+
 json_t *baton_json_metaquery_op(rodsEnv *env, rcComm_t *conn, json_t *target,
                                 const operation_args_t *args, baton_error_t *error) {
     json_t *result = NULL;
@@ -486,6 +2185,23 @@ json_t *baton_json_metaquery_op(rodsEnv *env, rcComm_t *conn, json_t *target,
     char *zone_name = args->zone_name;
     logmsg(DEBUG, "Metadata query in zone '%s'", zone_name);
 
+    if (args->flags & STREAM_RESULTS) {
+        // Rows are freed as soon as they are written, so they are not
+        // allocated from the item's arena, which is only reset once
+        // the item's output has been written
+        arena_t *previous = set_thread_arena(NULL);
+        if (args->stream_rows) {
+            visit_metadata(conn, target, zone_name, args->flags,
+                           args->stream_rows, args->stream_data, error);
+        }
+        else {
+            visit_metadata(conn, target, zone_name, args->flags, print_rows,
+                           (void *) &args->flags, error);
+        }
+        set_thread_arena(previous);
+        goto finally;
+    }
+
     result = search_metadata(conn, target, zone_name, args->flags, error);
 
 finally:
@@ -529,11 +2245,7 @@ json_t *baton_json_metamod_op(rodsEnv *env, rcComm_t *conn, json_t *target,
         if (error->code != 0) goto finally;
     }
 
-    result = json_deep_copy(target);
-    if (!result) {
-        set_baton_error(error, -1, "Internal error: failed to deep-copy "
-                        "result for %s", path);
-    }
+    result = json_incref(target);
 
 finally:
     if (path) free(path);
@@ -561,23 +2273,26 @@ json_t *baton_json_get_op(rodsEnv *env, rcComm_t *conn, json_t *target,
     logmsg(DEBUG, "Using a 'get' buffer size of %zu bytes", bsize);
 
     if (args->flags & SAVE_FILES) {
-        result = json_deep_copy(target);
-        if (!result) {
-            set_baton_error(error, errno,
-                            "Failed to allocate memory for result");
-            goto finally;
-        }
+        result = json_incref(target);
         get_data_obj_file(conn, &rods_path, file, bsize, error);
         if (error->code != 0) goto finally;
     }
     else if (args->flags & PRINT_RAW) {
-        result = json_deep_copy(target);
-        if (!result) {
-            set_baton_error(error, errno,
-                            "Failed to allocate memory for result");
+        if (args->flags & NO_RAW_OUTPUT) {
+            set_baton_error(error, -1, "Cannot print the raw contents of "
+                            "'%s': raw output is not supported here", path);
             goto finally;
         }
+
+        if (args->begin_raw) {
+            args->begin_raw(args->stream_data, error);
+            if (error->code != 0) goto finally;
+        }
+
+        result = json_incref(target);
         get_data_obj_stream(conn, &rods_path, stdout, bsize, error);
+
+        if (args->end_raw) args->end_raw(args->stream_data);
         if (error->code != 0) goto finally;
     }
     else {
@@ -679,11 +2394,7 @@ json_t *baton_json_put_op(rodsEnv *env, rcComm_t *conn, json_t *target,
         goto finally;
     }
 
-    result = json_deep_copy(target);
-    if (!result) {
-        set_baton_error(error, -1, "Internal error: failed to deep-copy "
-                        "result for %s", path);
-    }
+    result = json_incref(target);
 
 finally:
     if (checksum) free(checksum);
@@ -711,11 +2422,7 @@ json_t *baton_json_move_op(rodsEnv *env, rcComm_t *conn, json_t *target,
     move_rods_path(conn, &rods_path, new_path, error);
     if (error->code != 0) goto finally;
 
-    result = json_deep_copy(target);
-    if (!result) {
-        set_baton_error(error, -1, "Internal error: failed to deep-copy "
-                        "result for %s", path);
-    }
+    result = json_incref(target);
 
 finally:
     if (path) free(path);
@@ -746,11 +2453,7 @@ json_t *baton_json_rm_op(rodsEnv *env, rcComm_t *conn,
     remove_data_object(conn, &rods_path, args->flags, error);
     if (error->code != 0) goto finally;
 
-    result = json_deep_copy(target);
-    if (!result) {
-        set_baton_error(error, -1, "Internal error: failed to deep-copy "
-                        "result for %s", path);
-    }
+    result = json_incref(target);
 
 finally:
     if (path) free(path);
@@ -781,11 +2484,7 @@ json_t *baton_json_mkcoll_op(rodsEnv *env, rcComm_t *conn,
     create_collection(conn, &rods_path, args->flags, error);
     if (error->code != 0) goto finally;
 
-    result = json_deep_copy(target);
-    if (!result) {
-        set_baton_error(error, -1, "Internal error: failed to deep-copy "
-                        "result for %s", path);
-    }
+    result = json_incref(target);
 
 finally:
     if (path) free(path);
@@ -816,11 +2515,7 @@ json_t *baton_json_rmcoll_op(rodsEnv *env, rcComm_t *conn,
     remove_collection(conn, &rods_path, args->flags, error);
     if (error->code != 0) goto finally;
 
-    result = json_deep_copy(target);
-    if (!result) {
-        set_baton_error(error, -1, "Internal error: failed to deep-copy "
-                        "result for %s", path);
-    }
+    result = json_incref(target);
 
 finally:
     if (path) free(path);
@@ -1,6 +1,6 @@
 /**
  * Copyright (C) 2013, 2014, 2015, 2016, 2017, 2018, 2019, 2021, 2022,
- * 2025 Genome Research Ltd. All rights reserved.
+ * 2025, 2026 Genome Research Ltd. All rights reserved.
  *
  * This program is free software: you can redistribute it and/or modify
  * it under the terms of the GNU General Public License as published by
@@ -28,8 +28,22 @@
 #include <jansson.h>
 
 #include "config.h"
+#include "json_query.h"
+#include "rate_limit.h"
 #include "signal_handler.h"
 
+/** The maximum number of worker threads, each with its own connection */
+#define MAX_NUM_THREADS 64
+
+/** The number of items per worker thread that may be in flight */
+#define ITEMS_PER_THREAD 16
+
+/** The default number of input items parsed ahead of execution */
+#define DEFAULT_PREFETCH_DEPTH 64
+
+/** The size of output buffer at which buffered output is written */
+#define OUTPUT_BUFFER_SIZE (1024 * 1024)
+
 /**
  *  @enum metadata_op
  *  @brief AVU metadata operations.
@@ -92,17 +106,81 @@ typedef enum {
     /** Avoid any operations that contact servers other than rodshost */
     SINGLE_SERVER      = 1 << 20,
     /** Use advisory write lock on server */
-    WRITE_LOCK         = 1 << 21
+    WRITE_LOCK         = 1 << 21,
+    /** Print results in completion order, with correlation IDs */
+    UNORDERED          = 1 << 22,
+    /** Adapt the number of concurrent operations to server load */
+    ADAPTIVE_CONCURRENCY = 1 << 23,
+    /** Allocate the JSON of each item from an arena */
+    ARENA_ALLOC        = 1 << 24,
+    /** Adapt the query page size to the latency of each page */
+    ADAPTIVE_PAGE_SIZE = 1 << 25,
+    /** Print query results as they are fetched, one per line */
+    STREAM_RESULTS     = 1 << 26,
+    /** Report the number and size of query results, not the results */
+    AGGREGATE_RESULTS  = 1 << 27,
+    /** Aggregate on the server, over the first replicate of each
+        data object */
+    SERVER_AGGREGATE   = 1 << 28,
+    /** Reject raw output, which cannot be merged with other output */
+    NO_RAW_OUTPUT      = 1 << 29
 } option_flags;
 
+/**
+ * A function called by an operation before it writes raw data to
+ * stdout, returning non-zero if the data must not be written.
+ */
+typedef int (*raw_output_begin) (void *data, baton_error_t *error);
+
+/**
+ * A function called by an operation after it has written raw data to
+ * stdout.
+ */
+typedef void (*raw_output_end) (void *data);
+
 typedef struct operation_args {
     option_flags flags;
     size_t buffer_size;
     char *zone_name;
     char *path;
     unsigned long max_connect_time;
+    unsigned num_threads;
+    size_t prefetch_depth;
+    unsigned long flush_interval;
+    rate_limits_t *rate_limits;
+    unsigned max_retries;
+    unsigned long coalesce_window;
+    const char *journal_path;
+    unsigned long bulk_threads;
+    size_t page_size;
+    /** Called with each page of rows of a query whose results are
+        streamed (STREAM_RESULTS), or NULL to print them. */
+    query_visitor stream_rows;
+    /** Called before raw data is written to stdout (PRINT_RAW), so
+        that it may be ordered with other output, or NULL. */
+    raw_output_begin begin_raw;
+    /** Called after raw data has been written to stdout, if begin_raw
+        was called and succeeded, or NULL. */
+    raw_output_end end_raw;
+    /** Data to pass to stream_rows, begin_raw and end_raw. */
+    void *stream_data;
 } operation_args_t;
 
+/**
+ * A baton JSON envelope that has been validated for dispatch.
+ */
+typedef struct prepared_op {
+    /** The operation name, owned by the envelope. */
+    const char *name;
+    /** The operation target, owned by the envelope, or NULL if the
+        envelope has an array of targets. */
+    json_t *target;
+    /** The operation targets, owned by the envelope, or NULL. */
+    json_t *targets;
+    /** The operation arguments, including any given in the envelope. */
+    operation_args_t args;
+} prepared_op_t;
+
 /**
  * Typedef for baton JSON document processing functions.
  *
@@ -114,7 +192,9 @@ typedef struct operation_args {
  * @param[out]     error        An error report struct.
  *
  * @return json_t on success, which may be NULL if the operation
- * is void e.g. side-effect only operations.
+ * is void e.g. side-effect only operations. Operations that report
+ * their target unchanged return a new reference to the target itself,
+ * rather than a copy, so the result must not be modified.
  */
 typedef json_t *(*baton_json_op) (rodsEnv *env,
                                   rcComm_t *conn,
@@ -124,7 +204,12 @@ typedef json_t *(*baton_json_op) (rodsEnv *env,
 
 /**
  * Process a stream of baton JSON documents by executing the specifed
- * function on each one.
+ * function on each one. If args->num_threads is greater than 1, the
+ * documents are processed concurrently, each worker thread using its
+ * own iRODS connection. Results are printed in input order, unless
+ * the UNORDERED flag is set, in which case they are printed as soon as
+ * they complete, each bearing the "id" of its input document (or the
+ * sequence number of the document, if it has no "id").
  *
  * @param[in]  input        A file handle.
  * @param[fn]  fn           A operation function.
@@ -139,6 +224,42 @@ json_t *baton_json_dispatch_op(rodsEnv *env, rcComm_t *conn,
                                json_t *target, const operation_args_t *args,
                                baton_error_t *error);
 
+/**
+ * Validate a baton JSON envelope and prepare it for dispatch, without
+ * contacting the server. The prepared operation must be freed with
+ * free_prepared_op and must not outlive the envelope.
+ *
+ * @param[in]  envelope     A baton JSON envelope.
+ * @param[in]  args         Default operation arguments.
+ * @param[out] prepared     The prepared operation.
+ * @param[out] error        An error report struct.
+ *
+ * @return 0 on success, error code on failure.
+ */
+int baton_json_prepare_op(json_t *envelope, const operation_args_t *args,
+                          prepared_op_t *prepared, baton_error_t *error);
+
+/**
+ * Execute a prepared baton operation. If the operation has an array
+ * of targets, the result is an array with an element for each target,
+ * in the same order. Targets are executed grouped by their parent
+ * collection. An element is the result for its target or, if the
+ * operation failed on that target, a copy of the target with an error
+ * report. If any target failed, the error of the first is reported,
+ * and the result array is still returned.
+ *
+ * @param[in]  env          A populated iRODS environment.
+ * @param[in]  conn         An open iRODS connection.
+ * @param[in]  prepared     A prepared operation.
+ * @param[out] error        An error report struct.
+ *
+ * @return json_t on success, NULL on error.
+ */
+json_t *baton_json_execute_op(rodsEnv *env, rcComm_t *conn,
+                              prepared_op_t *prepared, baton_error_t *error);
+
+void free_prepared_op(prepared_op_t *prepared);
+
 json_t *baton_json_list_op(rodsEnv *env, rcComm_t *conn,
                            json_t *target, const operation_args_t *args,
                            baton_error_t *error);
@@ -0,0 +1,315 @@
+/**
+ * Copyright (C) 2026 Genome Research Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @file path_cache.c
+ * @author Keith James <kdj@sanger.ac.uk>
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "config.h"
+#include "log.h"
+#include "path_cache.h"
+#include "utilities.h"
+
+typedef struct path_cache_entry {
+    /** The absolute iRODS path. */
+    char path[MAX_NAME_LEN];
+    /** The path type, state, size, data ID and checksum, as set in a
+        rodsPath_t by getRodsObjType. */
+    objType_t obj_type;
+    objStat_t obj_state;
+    rodsLong_t size;
+    char data_id[NAME_LEN];
+    char chksum[NAME_LEN];
+    /** The monotonic time in seconds at which the entry expires. */
+    double expires;
+    /** The next entry in the same hash bucket, or in the free list. */
+    struct path_cache_entry *next;
+    /** The adjacent entries in order of use. */
+    struct path_cache_entry *newer;
+    struct path_cache_entry *older;
+} path_cache_entry_t;
+
+// The cache is shared by all threads and guarded by its mutex. Entries
+// are allocated once, up to the capacity, and are either in a hash
+// bucket and the list in order of use, or in the free list.
+static struct {
+    path_cache_entry_t *entries;
+    path_cache_entry_t **buckets;
+    size_t num_buckets;
+    path_cache_entry_t *free_list;
+    path_cache_entry_t *newest;
+    path_cache_entry_t *oldest;
+    double ttl;
+    /** Incremented whenever paths are removed. */
+    unsigned long generation;
+    pthread_mutex_t lock;
+} cache = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static double now_seconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+// Return the slot holding a path, or the empty slot at the end of its
+// bucket's chain if it is not cached
+static path_cache_entry_t **find_slot(const char *path) {
+    size_t hash = 5381;
+    for (const unsigned char *c = (const unsigned char *) path; *c; c++) {
+        hash = hash * 33 + *c;
+    }
+
+    path_cache_entry_t **slot = &cache.buckets[hash % cache.num_buckets];
+    while (*slot && !str_equals((*slot)->path, path, MAX_NAME_LEN)) {
+        slot = &(*slot)->next;
+    }
+
+    return slot;
+}
+
+static void unlink_entry(path_cache_entry_t *entry) {
+    if (entry->newer) entry->newer->older = entry->older;
+    else              cache.newest        = entry->older;
+    if (entry->older) entry->older->newer = entry->newer;
+    else              cache.oldest        = entry->newer;
+
+    entry->newer = NULL;
+    entry->older = NULL;
+}
+
+static void push_newest(path_cache_entry_t *entry) {
+    entry->older = cache.newest;
+    entry->newer = NULL;
+
+    if (cache.newest) cache.newest->newer = entry;
+    cache.newest = entry;
+    if (!cache.oldest) cache.oldest = entry;
+}
+
+static void remove_entry(path_cache_entry_t **slot) {
+    path_cache_entry_t *entry = *slot;
+
+    *slot = entry->next;
+    unlink_entry(entry);
+
+    entry->next     = cache.free_list;
+    cache.free_list = entry;
+}
+
+static void discard_entries(void) {
+    if (cache.entries) free(cache.entries);
+    if (cache.buckets) free(cache.buckets);
+
+    cache.entries     = NULL;
+    cache.buckets     = NULL;
+    cache.num_buckets = 0;
+    cache.free_list   = NULL;
+    cache.newest      = NULL;
+    cache.oldest      = NULL;
+}
+
+int init_path_cache(const size_t capacity, const double ttl,
+                    baton_error_t *error) {
+    init_baton_error(error);
+
+    pthread_mutex_lock(&cache.lock);
+    discard_entries();
+    cache.ttl = ttl;
+
+    if (capacity == 0 || ttl <= 0) goto finally;
+
+    cache.entries     = calloc(capacity, sizeof (path_cache_entry_t));
+    cache.buckets     = calloc(capacity, sizeof (path_cache_entry_t *));
+    cache.num_buckets = capacity;
+    if (!cache.entries || !cache.buckets) {
+        set_baton_error(error, errno, "Failed to allocate memory: "
+                        "error %d %s", errno, strerror(errno));
+        discard_entries();
+        goto finally;
+    }
+
+    for (size_t i = 0; i < capacity; i++) {
+        cache.entries[i].next = cache.free_list;
+        cache.free_list = &cache.entries[i];
+    }
+
+    logmsg(DEBUG, "Caching up to %zu paths for %.1f seconds", capacity, ttl);
+
+finally:
+    pthread_mutex_unlock(&cache.lock);
+
+    return error->code;
+}
+
+int get_cached_path(rodsPath_t *rods_path) {
+    int found = 0;
+
+    pthread_mutex_lock(&cache.lock);
+    if (!cache.entries) goto finally;
+
+    path_cache_entry_t **slot = find_slot(rods_path->outPath);
+    path_cache_entry_t *entry = *slot;
+    if (!entry) goto finally;
+
+    if (entry->expires <= now_seconds()) {
+        remove_entry(slot);
+        goto finally;
+    }
+
+    rods_path->objType  = entry->obj_type;
+    rods_path->objState = entry->obj_state;
+    rods_path->size     = entry->size;
+    snprintf(rods_path->dataId, NAME_LEN, "%s", entry->data_id);
+    snprintf(rods_path->chksum, NAME_LEN, "%s", entry->chksum);
+
+    unlink_entry(entry);
+    push_newest(entry);
+    found = 1;
+
+    logmsg(TRACE, "Found '%s' in the path cache", rods_path->outPath);
+
+finally:
+    pthread_mutex_unlock(&cache.lock);
+
+    return found;
+}
+
+unsigned long path_cache_generation(void) {
+    pthread_mutex_lock(&cache.lock);
+    const unsigned long generation = cache.generation;
+    pthread_mutex_unlock(&cache.lock);
+
+    return generation;
+}
+
+void cache_path(const rodsPath_t *rods_path, const unsigned long generation) {
+    pthread_mutex_lock(&cache.lock);
+    if (!cache.entries) goto finally;
+
+    // A path removed while this one was being resolved may have been
+    // changed after the server answered
+    if (generation != cache.generation) {
+        logmsg(TRACE, "Not caching '%s' resolved before a change",
+               rods_path->outPath);
+        goto finally;
+    }
+
+    path_cache_entry_t **slot = find_slot(rods_path->outPath);
+    path_cache_entry_t *entry = *slot;
+
+    if (entry) {
+        unlink_entry(entry);
+    }
+    else {
+        if (!cache.free_list) {
+            remove_entry(find_slot(cache.oldest->path));
+            // Eviction may have changed the chain leading to the slot
+            slot = find_slot(rods_path->outPath);
+        }
+
+        entry = cache.free_list;
+        cache.free_list = entry->next;
+
+        snprintf(entry->path, MAX_NAME_LEN, "%s", rods_path->outPath);
+        entry->next = NULL;
+        *slot = entry;
+    }
+
+    entry->obj_type  = rods_path->objType;
+    entry->obj_state = rods_path->objState;
+    entry->size      = rods_path->size;
+    snprintf(entry->data_id, NAME_LEN, "%s", rods_path->dataId);
+    snprintf(entry->chksum,  NAME_LEN, "%s", rods_path->chksum);
+    entry->expires = now_seconds() + cache.ttl;
+
+    push_newest(entry);
+
+finally:
+    pthread_mutex_unlock(&cache.lock);
+}
+
+// Remove a path and any of its ancestors cached as not existing, which
+// may have been created with it. Each is looked up by its hash, so the
+// cost is proportional to the depth of the path, not the size of the
+// cache. Must be called with the cache lock held.
+static void remove_path(const char *path) {
+    cache.generation++;
+
+    char ancestor[MAX_NAME_LEN];
+    snprintf(ancestor, MAX_NAME_LEN, "%s", path);
+
+    path_cache_entry_t **slot = find_slot(ancestor);
+    if (*slot) {
+        logmsg(TRACE, "Removing '%s' from the path cache", ancestor);
+        remove_entry(slot);
+    }
+
+    char *sep;
+    while ((sep = strrchr(ancestor, '/')) && sep != ancestor) {
+        *sep = '\0';
+
+        slot = find_slot(ancestor);
+        if (*slot && (*slot)->obj_state == NOT_EXIST_ST) {
+            logmsg(TRACE, "Removing '%s' from the path cache", ancestor);
+            remove_entry(slot);
+        }
+    }
+}
+
+void uncache_path(const char *path) {
+    pthread_mutex_lock(&cache.lock);
+    if (cache.entries) remove_path(path);
+    pthread_mutex_unlock(&cache.lock);
+}
+
+void uncache_collection(const char *path) {
+    pthread_mutex_lock(&cache.lock);
+    if (!cache.entries) goto finally;
+
+    remove_path(path);
+
+    // Descendants have no index, so the whole cache is searched
+    const size_t len = strnlen(path, MAX_NAME_LEN);
+
+    path_cache_entry_t *entry = cache.newest;
+    while (entry) {
+        path_cache_entry_t *older = entry->older;
+
+        if (strncmp(entry->path, path, len) == 0 && entry->path[len] == '/') {
+            logmsg(TRACE, "Removing '%s' from the path cache", entry->path);
+            remove_entry(find_slot(entry->path));
+        }
+
+        entry = older;
+    }
+
+finally:
+    pthread_mutex_unlock(&cache.lock);
+}
+
+void free_path_cache(void) {
+    pthread_mutex_lock(&cache.lock);
+    discard_entries();
+    pthread_mutex_unlock(&cache.lock);
+}
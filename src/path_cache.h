@@ -0,0 +1,109 @@
+/**
+ * Copyright (C) 2026 Genome Research Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @file path_cache.h
+ * @author Keith James <kdj@sanger.ac.uk>
+ */
+
+#ifndef _BATON_PATH_CACHE_H
+#define _BATON_PATH_CACHE_H
+
+#include <rodsClient.h>
+
+#include "config.h"
+#include "error.h"
+
+/** The default maximum number of paths cached */
+#define DEFAULT_PATH_CACHE_SIZE 4096
+
+/**
+ * Enable the process-wide cache of iRODS path types and states, used
+ * by resolve_rods_path and set_rods_path to avoid repeating server
+ * round trips for paths resolved recently. The cache is disabled
+ * until this is called. Any paths already cached are discarded.
+ *
+ * Paths are evicted least recently used first once the cache is full.
+ * Baton's own operations that create, remove or move paths remove
+ * them from the cache, but changes made by other clients are seen
+ * only once a cached path has expired.
+ *
+ * @param[in]  capacity     The maximum number of paths cached.
+ * @param[in]  ttl          The number of seconds for which a path is
+ *                          cached. 0 disables the cache.
+ * @param[out] error        An error report struct.
+ *
+ * @return 0 on success, error code on failure.
+ */
+int init_path_cache(size_t capacity, double ttl, baton_error_t *error);
+
+/**
+ * Copy the cached type and state of a path into an iRODS path whose
+ * outPath is set. The rodsObjStat of the iRODS path is not set.
+ *
+ * @param[in,out] rods_path An iRODS path.
+ *
+ * @return 1 if the path was cached and has not expired, otherwise 0.
+ */
+int get_cached_path(rodsPath_t *rods_path);
+
+/**
+ * Return the generation of the cache, which changes whenever a path is
+ * removed from it. Take this before asking the server for the type of
+ * a path and pass it to cache_path with the result.
+ *
+ * @return The generation of the cache.
+ */
+unsigned long path_cache_generation(void);
+
+/**
+ * Cache the type and state of a resolved iRODS path, if the cache is
+ * enabled. The path is not cached if any path has been removed from
+ * the cache since it was resolved, because the server may have
+ * answered before the change that caused the removal.
+ *
+ * @param[in] rods_path     A resolved iRODS path.
+ * @param[in] generation    The cache generation, from
+ *                          path_cache_generation, taken before the
+ *                          path was resolved.
+ */
+void cache_path(const rodsPath_t *rods_path, unsigned long generation);
+
+/**
+ * Remove a path from the cache because it has been changed, together
+ * with any of its ancestors cached as not existing. Paths beneath it
+ * are not removed; use uncache_collection for a collection that has
+ * been removed or moved.
+ *
+ * @param[in] path          An absolute iRODS path.
+ */
+void uncache_path(const char *path);
+
+/**
+ * Remove a collection from the cache because it has been removed or
+ * moved, together with any paths beneath it and any of its ancestors
+ * cached as not existing. The cost of this grows with the number of
+ * paths cached.
+ *
+ * @param[in] path          An absolute iRODS collection path.
+ */
+void uncache_collection(const char *path);
+
+/**
+ * Disable the cache and free its memory.
+ */
+void free_path_cache(void);
+
+#endif // _BATON_PATH_CACHE_H
@@ -1,6 +1,6 @@
 /**
- * Copyright (C) 2013, 2014, 2015, 2021, 2025 Genome Research Ltd. All
- * rights reserved.
+ * Copyright (C) 2013, 2014, 2015, 2021, 2025, 2026 Genome Research Ltd.
+ * All rights reserved.
  *
  * This program is free software: you can redistribute it and/or modify
  * it under the terms of the GNU General Public License as published by
@@ -27,18 +27,38 @@
 #include <errno.h>
 #include <libgen.h>
 #include <math.h>
+#include <pthread.h>
 #include <string.h>
 #include <sys/types.h>
 #include <regex.h>
+#include <time.h>
 
 #include <jansson.h>
 
 #include "config.h"
+#include "arena.h"
 #include "error.h"
 #include "log.h"
 #include "query.h"
 #include "utilities.h"
 
+typedef struct page_size_setting {
+    size_t page_size;
+    int adaptive;
+} page_size_setting_t;
+
+static pthread_key_t page_size_key;
+static pthread_once_t page_size_once = PTHREAD_ONCE_INIT;
+
+static void make_page_size_key(void) {
+    pthread_key_create(&page_size_key, free);
+}
+
+static page_size_setting_t *get_page_size_setting(void) {
+    pthread_once(&page_size_once, make_page_size_key);
+    return pthread_getspecific(page_size_key);
+}
+
 void log_rods_errstack(const log_level level, const rError_t *error) {
     const int len = error->len;
     for (int i = 0; i < len; i++) {
@@ -93,6 +113,53 @@ error:
     return NULL;
 }
 
+void set_query_page_size(const size_t page_size, const int adaptive) {
+    page_size_setting_t *setting = get_page_size_setting();
+
+    if (!setting) {
+        setting = calloc(1, sizeof (page_size_setting_t));
+        if (!setting) {
+            logmsg(ERROR, "Failed to allocate memory: error %d %s",
+                   errno, strerror(errno));
+            return;
+        }
+        pthread_setspecific(page_size_key, setting);
+    }
+
+    setting->page_size = page_size > MAX_SQL_ROWS ? MAX_SQL_ROWS : page_size;
+    setting->adaptive  = adaptive;
+}
+
+size_t get_query_page_size(void) {
+    const page_size_setting_t *setting = get_page_size_setting();
+
+    if (!setting || setting->page_size == 0) return SEARCH_MAX_ROWS;
+
+    return setting->page_size;
+}
+
+int is_adaptive_page_size(void) {
+    const page_size_setting_t *setting = get_page_size_setting();
+
+    return setting && setting->adaptive;
+}
+
+size_t adapt_page_size(const size_t page_size, const double latency) {
+    size_t size = page_size;
+
+    if (latency < ADAPTIVE_PAGE_LATENCY / 2) {
+        size = page_size * 2;
+    }
+    else if (latency > ADAPTIVE_PAGE_LATENCY) {
+        size = page_size / 2;
+    }
+
+    if (size < 1)            size = 1;
+    if (size > MAX_SQL_ROWS) size = MAX_SQL_ROWS;
+
+    return size;
+}
+
 void free_query_input(genQueryInp_t *query_in) {
     assert(query_in);
 
@@ -175,6 +242,25 @@ error:
     return NULL;
 }
 
+char *make_in_value(const char *values[], const size_t num_values) {
+    size_t len = 3; // Parentheses and NUL
+    for (size_t i = 0; i < num_values; i++) {
+        len += strlen(values[i]) + 4; // Quotes, comma and space
+    }
+
+    char *value = calloc(len, sizeof (char));
+    if (!value) return NULL;
+
+    size_t offset = snprintf(value, len, "(");
+    for (size_t i = 0; i < num_values; i++) {
+        offset += snprintf(value + offset, len - offset, "%s'%s'",
+                           i == 0 ? "" : ", ", values[i]);
+    }
+    snprintf(value + offset, len - offset, ")");
+
+    return value;
+}
+
 genQueryInp_t *prepare_obj_list(genQueryInp_t *query_in,
                                 rodsPath_t *rods_path,
                                 const char *attr_name) {
@@ -365,16 +451,20 @@ genQueryInp_t *limit_to_newest_repl(genQueryInp_t *query_in) {
     return limit_to_good_repl(query_in);
 }
 
-genQueryInp_t *limit_to_good_repl(genQueryInp_t *query_in) {
+int good_repl_status(void) {
     // See https://github.com/irods/irods/issues/5730
     //
     // The #define used in iRODS 4.2.8 and earlier has been replaced
     // with an enum member with the same value.
 #if IRODS_VERSION_INTEGER <= (4*1000000 + 2*1000 + 8)
-    int col_selector = NEWLY_CREATED_COPY;
+    return NEWLY_CREATED_COPY;
 #else
-    int col_selector = GOOD_REPLICA;
+    return GOOD_REPLICA;
 #endif
+}
+
+genQueryInp_t *limit_to_good_repl(genQueryInp_t *query_in) {
+    int col_selector = good_repl_status();
 
     int num_digits = (col_selector == 0) ? 1 : log10(col_selector) + 1;
 
@@ -388,6 +478,14 @@ genQueryInp_t *limit_to_good_repl(genQueryInp_t *query_in) {
     return add_query_conds(query_in, num_conds, (query_cond_t []) { rs });
 }
 
+genQueryInp_t *limit_to_first_repl(genQueryInp_t *query_in) {
+    const query_cond_t rn = { .column   = COL_DATA_REPL_NUM,
+                              .operator = SEARCH_OP_EQUALS,
+                              .value    = "0" };
+    const size_t num_conds = 1;
+    return add_query_conds(query_in, num_conds, (query_cond_t []) { rn });
+}
+
 genQueryInp_t *prepare_obj_acl_search(genQueryInp_t *query_in,
                                       const char *user,
                                       const char *perm) {
@@ -511,7 +609,7 @@ specificQueryInp_t *prepare_specific_query(specificQueryInp_t *squery_in,
     size_t index;
     json_t *value;
 
-    squery_in->maxRows = SEARCH_MAX_ROWS;
+    squery_in->maxRows = get_query_page_size();
     squery_in->continueInx = 0;
     squery_in->sql = (char *)sql;
 
@@ -543,59 +641,86 @@ void free_squery_input(specificQueryInp_t *squery_in) {
     free(squery_in);
 }
 
-query_format_in_t *make_query_format_from_sql(const char *sql) {
-    query_format_in_t *format = NULL;
-    char remsg[MAX_ERROR_MESSAGE_LEN];
+// The regexes used to parse specific queries are compiled once and
+// held for the lifetime of the process; regexec does not modify them,
+// so they may be shared by all threads.
+static const char *select_s_re_str = "^select[[:space:]]";
 
-    const char *select_list_capt_re_str =
-      "^.*?select[[:space:]]+"
-      "(distinct|all[[:space:]]+)?(.*?[^[:space:]])[[:space:]]+"
-      "from[[:space:]].*$";
-    enum { select_list_capt_idx = 2 };
-    regex_t select_list_capt_re;
-    regmatch_t select_list_pmatch[select_list_capt_idx+1];
+static const char *select_list_capt_re_str =
+  "^.*?select[[:space:]]+"
+  "(distinct|all[[:space:]]+)?(.*?[^[:space:]])[[:space:]]+"
+  "from[[:space:]].*$";
+enum { select_list_capt_idx = 2 };
 
-    const char *trim_whitespace_capt_re_str =
-      "^[[:space:]]*(.*?[^[:space:]])[[:space:]]*$";
-    enum { trim_whitespace_capt_idx = 1 };
-    regex_t trim_whitespace_capt_re;
+static const char *trim_whitespace_capt_re_str =
+  "^[[:space:]]*(.*?[^[:space:]])[[:space:]]*$";
+enum { trim_whitespace_capt_idx = 1 };
 
-    const char *as_column_name_capt_re_str =
-      "^.*[[:space:]]+as[[:space:]]+(.*?[^[:space:]])[[:space:]]*$";
-    enum { as_column_name_capt_idx = 1 };
-    regex_t as_column_name_capt_re;
+static const char *as_column_name_capt_re_str =
+  "^.*[[:space:]]+as[[:space:]]+(.*?[^[:space:]])[[:space:]]*$";
+enum { as_column_name_capt_idx = 1 };
 
-    char *select_list, *select_list_tokenize;
-    char *column_trim, *column_name;
-    unsigned int i;
+static regex_t select_s_re;
+static regex_t select_list_capt_re;
+static regex_t trim_whitespace_capt_re;
+static regex_t as_column_name_capt_re;
 
-    unsigned int reti = regcomp(&select_list_capt_re, select_list_capt_re_str,
-                                REG_EXTENDED | REG_ICASE);
-    if (reti != 0) {
-        regerror(reti, &select_list_capt_re, remsg, MAX_ERROR_MESSAGE_LEN);
-        logmsg(ERROR, "Could not compile regex: '%s': %s",
-               select_list_capt_re_str, remsg);
-        goto error;
-    }
+static int sql_regex_status = 0;
+static pthread_once_t sql_regex_once = PTHREAD_ONCE_INIT;
 
-    reti = regcomp(&trim_whitespace_capt_re, trim_whitespace_capt_re_str,
-                   REG_EXTENDED | REG_ICASE);
-    if (reti != 0) {
-        regerror(reti, &trim_whitespace_capt_re, remsg, MAX_ERROR_MESSAGE_LEN);
-        logmsg(ERROR, "Could not compile regex: '%s': %s",
-               trim_whitespace_capt_re_str, remsg);
-        goto error;
-    }
+static int compile_sql_regex(regex_t *re, const char *re_str) {
+    char remsg[MAX_ERROR_MESSAGE_LEN];
 
-    reti = regcomp(&as_column_name_capt_re, as_column_name_capt_re_str,
-                   REG_EXTENDED | REG_ICASE);
+    const int reti = regcomp(re, re_str, REG_EXTENDED | REG_ICASE);
     if (reti != 0) {
-        regerror(reti, &as_column_name_capt_re, remsg, MAX_ERROR_MESSAGE_LEN);
-        logmsg(ERROR, "Could not compile regex: '%s': %s",
-               as_column_name_capt_re_str, remsg);
-        goto error;
+        regerror(reti, re, remsg, MAX_ERROR_MESSAGE_LEN);
+        logmsg(ERROR, "Could not compile regex: '%s': %s", re_str, remsg);
     }
 
+    return reti;
+}
+
+static void compile_sql_regexes(void) {
+    sql_regex_status = compile_sql_regex(&select_s_re, select_s_re_str);
+    if (sql_regex_status != 0) return;
+
+    sql_regex_status = compile_sql_regex(&select_list_capt_re,
+                                         select_list_capt_re_str);
+    if (sql_regex_status != 0) return;
+
+    sql_regex_status = compile_sql_regex(&trim_whitespace_capt_re,
+                                         trim_whitespace_capt_re_str);
+    if (sql_regex_status != 0) return;
+
+    sql_regex_status = compile_sql_regex(&as_column_name_capt_re,
+                                         as_column_name_capt_re_str);
+}
+
+static int get_sql_regexes(void) {
+    pthread_once(&sql_regex_once, compile_sql_regexes);
+    return sql_regex_status;
+}
+
+// Specific query aliases, each having an expiry time and the labels
+// parsed from its SQL. Shared by all threads and guarded by the mutex.
+static json_t *specific_query_cache = NULL;
+static pthread_mutex_t specific_query_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+#define SPECIFIC_QUERY_CACHE_EXPIRES_KEY "expires"
+#define SPECIFIC_QUERY_CACHE_LABELS_KEY  "labels"
+
+query_format_in_t *make_query_format_from_sql(const char *sql) {
+    query_format_in_t *format = NULL;
+
+    regmatch_t select_list_pmatch[select_list_capt_idx+1];
+
+    char *select_list, *select_list_tokenize;
+    char *column_trim, *column_name;
+    unsigned int i;
+    int reti;
+
+    if (get_sql_regexes() != 0) goto error;
+
     format = calloc(1, sizeof(query_format_in_t));
     if (!format) goto error;
 
@@ -704,9 +829,6 @@ query_format_in_t *make_query_format_from_sql(const char *sql) {
     format->num_columns = i;
 
     free(select_list);
-    regfree(&select_list_capt_re);
-    regfree(&trim_whitespace_capt_re);
-    regfree(&as_column_name_capt_re);
     return format;
 
 error_recoverable:
@@ -735,7 +857,7 @@ const char *irods_get_sql_for_specific_alias(rcComm_t *conn,
     specificQueryInp_t *sql_alias_squery_in = calloc(1, sizeof(specificQueryInp_t));
     if (!sql_alias_squery_in) goto error;
 
-    sql_alias_squery_in->maxRows = SEARCH_MAX_ROWS;
+    sql_alias_squery_in->maxRows = get_query_page_size();
     sql_alias_squery_in->continueInx = 0;
     sql_alias_squery_in->sql = "findQueryByAlias";
     sql_alias_squery_in->args[0] = (char *)alias;
@@ -786,44 +908,138 @@ error:
     return NULL;
 }
 
+// Copy a format's labels into a JSON array, or return NULL if any of
+// them is missing
+static json_t *specific_labels_to_json(const query_format_in_t *format) {
+    json_t *labels = json_array();
+    if (!labels) return NULL;
+
+    for (unsigned int i = 0; i < format->num_columns; i++) {
+        if (!format->labels[i] ||
+            json_array_append_new(labels,
+                                  json_string(format->labels[i])) != 0) {
+            json_decref(labels);
+            return NULL;
+        }
+    }
+
+    return labels;
+}
+
+// Make a new format whose labels are copies of those in a JSON array
+static query_format_in_t *specific_labels_from_json(const json_t *labels) {
+    query_format_in_t *format = calloc(1, sizeof(query_format_in_t));
+    if (!format) return NULL;
+
+    size_t index;
+    json_t *label;
+    json_array_foreach(labels, index, label) {
+        format->labels[index] = strdup(json_string_value(label));
+        if (!format->labels[index]) {
+            format->num_columns = index + 1;
+            free_specific_labels(format);
+            return NULL;
+        }
+    }
+    format->num_columns = json_array_size(labels);
+
+    return format;
+}
+
+// Return a copy of the cached format for an alias, or NULL if it is
+// not cached or has expired
+static query_format_in_t *get_cached_specific_labels(const char *alias,
+                                                     const time_t now) {
+    query_format_in_t *format = NULL;
+
+    pthread_mutex_lock(&specific_query_cache_mutex);
+
+    const json_t *entry = json_object_get(specific_query_cache, alias);
+    const json_t *expires =
+        json_object_get(entry, SPECIFIC_QUERY_CACHE_EXPIRES_KEY);
+    if (entry && json_integer_value(expires) > now) {
+        const json_t *labels =
+            json_object_get(entry, SPECIFIC_QUERY_CACHE_LABELS_KEY);
+        format = specific_labels_from_json(labels);
+    }
+
+    pthread_mutex_unlock(&specific_query_cache_mutex);
+
+    if (format) {
+        logmsg(DEBUG, "Using cached labels for specific alias '%s'", alias);
+    }
+
+    return format;
+}
+
+// Cache the format parsed from the SQL of an alias for
+// SPECIFIC_QUERY_CACHE_TTL seconds. The cache outlives any item's
+// arena, so it is built with malloc.
+static void cache_specific_labels(const char *alias,
+                                  const query_format_in_t *format,
+                                  const time_t now) {
+    json_t *entry = NULL;
+    arena_t *previous = set_thread_arena(NULL);
+
+    json_t *labels = specific_labels_to_json(format);
+    if (!labels) {
+        logmsg(DEBUG, "Not caching incomplete labels for specific alias '%s'",
+               alias);
+        goto finally;
+    }
+
+    entry = json_pack("{s:I, s:o}",
+                      SPECIFIC_QUERY_CACHE_EXPIRES_KEY,
+                      (json_int_t) (now + SPECIFIC_QUERY_CACHE_TTL),
+                      SPECIFIC_QUERY_CACHE_LABELS_KEY, labels);
+    // The labels are stolen by the pack, even on failure
+    if (!entry) goto finally;
+
+    pthread_mutex_lock(&specific_query_cache_mutex);
+    if (!specific_query_cache) specific_query_cache = json_object();
+    json_object_set_new(specific_query_cache, alias, entry);
+    pthread_mutex_unlock(&specific_query_cache_mutex);
+
+finally:
+    set_thread_arena(previous);
+}
+
 query_format_in_t *prepare_specific_labels(rcComm_t *conn,
                                            const char *sql_or_alias) {
-    regex_t select_s_re;
-
+    query_format_in_t *format = NULL;
     const char *sql;
-    const char *select_s_re_str ="^select[[:space:]]";
+    struct timespec now;
+
+    if (get_sql_regexes() != 0) goto error;
 
     // does sql_or_alias begin with a SQL SELECT statement?
-    unsigned int reti = regcomp(&select_s_re, select_s_re_str, REG_EXTENDED | REG_ICASE);
-    if (reti != 0) {
-        char re_msg[MAX_ERROR_MESSAGE_LEN];
-        regerror(reti, &select_s_re, re_msg, MAX_ERROR_MESSAGE_LEN);
-        logmsg(ERROR, "Could not compile regex: '%s': %s", select_s_re_str,
-               re_msg);
-        goto error;
-    }
-    reti = regexec(&select_s_re, sql_or_alias, 0, NULL, 0);
+    const int reti = regexec(&select_s_re, sql_or_alias, 0, NULL, 0);
     if (reti == 0) {
         // yes, sql_or_alias does contain SELECT - we already have SQL
         sql = sql_or_alias;
         logmsg(DEBUG, "Already have SQL specific query: '%s'", sql);
-    } else if (reti == REG_NOMATCH) {
-        // no SELECT found in sql_or_alias we must have an alias (or a
-        // bad query, but try to look up the alias anyway)
-        sql = irods_get_sql_for_specific_alias(conn, sql_or_alias);
-        if (sql == NULL) {
-            goto error;
-        }
-        logmsg(DEBUG, "Got SQL for specific alias '%s': '%s'",
-               sql_or_alias, sql);
-    } else {
+
+        return make_query_format_from_sql(sql);
+    } else if (reti != REG_NOMATCH) {
         logmsg(ERROR, "Regex match failed parsing SQL: '%s'", sql_or_alias);
         goto error;
     }
-    regfree(&select_s_re);
-    assert(sql);
 
-    query_format_in_t *format = make_query_format_from_sql(sql);
+    // no SELECT found in sql_or_alias we must have an alias (or a bad
+    // query, but try to look up the alias anyway)
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    format = get_cached_specific_labels(sql_or_alias, now.tv_sec);
+    if (format) return format;
+
+    sql = irods_get_sql_for_specific_alias(conn, sql_or_alias);
+    if (sql == NULL) {
+        goto error;
+    }
+    logmsg(DEBUG, "Got SQL for specific alias '%s': '%s'", sql_or_alias, sql);
+
+    format = make_query_format_from_sql(sql);
+    if (format) cache_specific_labels(sql_or_alias, format, now.tv_sec);
 
     return format;
 
@@ -833,6 +1049,13 @@ error:
     return NULL;
 }
 
+void clear_specific_query_cache(void) {
+    pthread_mutex_lock(&specific_query_cache_mutex);
+    if (specific_query_cache) json_decref(specific_query_cache);
+    specific_query_cache = NULL;
+    pthread_mutex_unlock(&specific_query_cache_mutex);
+}
+
 void free_specific_labels(query_format_in_t *format) {
     assert(format);
 
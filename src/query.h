@@ -1,6 +1,6 @@
 /**
- * Copyright (C) 2013, 2014, 2015, 2016, 2021 Genome Research Ltd. All
- * rights reserved.
+ * Copyright (C) 2013, 2014, 2015, 2016, 2021, 2026 Genome Research Ltd.
+ * All rights reserved.
  *
  * This program is free software: you can redistribute it and/or modify
  * it under the terms of the GNU General Public License as published by
@@ -35,6 +35,13 @@
 
 #define SEARCH_MAX_ROWS      10
 
+/** Target per-page latency (s) for adaptive query page sizing */
+#define ADAPTIVE_PAGE_LATENCY 0.5
+
+/** The number of seconds for which the SQL and column labels of a
+    specific query alias are cached after being fetched */
+#define SPECIFIC_QUERY_CACHE_TTL 300
+
 #define SEARCH_OP_EQUALS   "="
 #define SEARCH_OP_LIKE     "like"
 #define SEARCH_OP_NOT_LIKE "not like"
@@ -67,6 +74,11 @@ typedef struct query_format_in {
     const char *labels[MAX_NUM_COLUMNS];
     /** Return data for good replicates only */
     unsigned int good_repl;
+    /** The aggregate functions to apply to the columns e.g. SELECT_COUNT,
+        or 0 for none */
+    const int modifiers[MAX_NUM_COLUMNS];
+    /** Return data for the first replicate (number 0) only */
+    unsigned int first_repl;
 } query_format_in_t;
 
 typedef struct query_cond {
@@ -119,6 +131,47 @@ void log_rods_errstack(log_level level, const rError_t *error);
  */
 genQueryInp_t *make_query_input(size_t max_rows, size_t num_columns,
                                 const int columns[]);
+
+/**
+ * Set the number of rows fetched per page by queries made on the
+ * calling thread.
+ *
+ * @param[in] page_size  The number of rows, up to MAX_SQL_ROWS. If 0,
+ *                       SEARCH_MAX_ROWS is used.
+ * @param[in] adaptive   If true, the page size is changed after each
+ *                       page to keep its latency near
+ *                       ADAPTIVE_PAGE_LATENCY.
+ */
+void set_query_page_size(size_t page_size, int adaptive);
+
+/**
+ * Return the number of rows fetched per page by queries made on the
+ * calling thread.
+ *
+ * @return The page size.
+ */
+size_t get_query_page_size(void);
+
+/**
+ * Return true if queries made on the calling thread adapt their page
+ * size to the latency of each page.
+ *
+ * @return 1 if adaptive, 0 otherwise.
+ */
+int is_adaptive_page_size(void);
+
+/**
+ * Return the page size to use after a page fetched in latency
+ * seconds. The size is doubled while pages take less than half of
+ * ADAPTIVE_PAGE_LATENCY and halved when they take longer than it,
+ * within the range 1 to MAX_SQL_ROWS.
+ *
+ * @param[in] page_size  The current page size.
+ * @param[in] latency    The time taken to fetch the last page (s).
+ *
+ * @return The new page size.
+ */
+size_t adapt_page_size(size_t page_size, double latency);
 /**
  * Free memory used by an iRODS generic query (see rodsGenQuery.h).
  *
@@ -148,6 +201,18 @@ void free_query_output(genQueryOut_t *query_out);
 genQueryInp_t *add_query_conds(genQueryInp_t *query_in, size_t num_conds,
                                const query_cond_t conds[]);
 
+/**
+ * Return a new value for an "in" query condition listing values,
+ * e.g. "('a', 'b')". The values must not contain single quotes.
+ *
+ * @param[in] values         The values to list.
+ * @param[in] num_values     The number of values.
+ *
+ * @return A new string, which must be freed by the caller, or NULL on
+ * error.
+ */
+char *make_in_value(const char *values[], size_t num_values);
+
 /**
  * Add a clause to a query to list AVUs on a data object, optionally
  * restricting results to a specific attribute.
@@ -255,11 +320,37 @@ void free_squery_input(specificQueryInp_t *squery_in);
 
 void free_specific_labels(query_format_in_t *format);
 
+/**
+ * Clear the cache of specific query aliases used by
+ * prepare_specific_labels, so that the next use of each alias fetches
+ * its SQL from the server again.
+ */
+void clear_specific_query_cache(void);
+
 __attribute__((deprecated("use limit_to_good_repl instead")))
 genQueryInp_t *limit_to_newest_repl(genQueryInp_t *query_in);
 
 genQueryInp_t *limit_to_good_repl(genQueryInp_t *query_in);
 
+/**
+ * Limit a query to the first replicate, number 0, of each data
+ * object. Data objects whose first replicate has been removed are
+ * excluded.
+ *
+ * @param[in] query_in  A query.
+ *
+ * @return The query.
+ */
+genQueryInp_t *limit_to_first_repl(genQueryInp_t *query_in);
+
+/**
+ * Return the replicate status value of good replicates, as used by
+ * limit_to_good_repl.
+ *
+ * @return The status value.
+ */
+int good_repl_status(void);
+
 genQueryInp_t *add_select_modifier(genQueryInp_t *query_in, int column,
                                    int modifier);
 
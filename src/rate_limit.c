@@ -0,0 +1,164 @@
+/**
+ * Copyright (C) 2026 Genome Research Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @file rate_limit.c
+ * @author Keith James <kdj@sanger.ac.uk>
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+#include "log.h"
+#include "rate_limit.h"
+#include "signal_handler.h"
+
+static token_bucket_t *find_bucket(rate_limits_t *limits,
+                                   const char *op_name) {
+    for (size_t i = 0; i < limits->num_buckets; i++) {
+        if (strncmp(limits->buckets[i].name, op_name,
+                    MAX_RATE_LIMIT_NAME_LEN) == 0) {
+            return &limits->buckets[i];
+        }
+    }
+
+    return NULL;
+}
+
+void init_rate_limits(rate_limits_t *limits) {
+    memset(limits, 0, sizeof (rate_limits_t));
+    pthread_mutex_init(&limits->lock, NULL);
+}
+
+int add_rate_limit(rate_limits_t *limits, const char *spec,
+                   baton_error_t *error) {
+    init_baton_error(error);
+
+    const char *eq = strchr(spec, '=');
+    if (!eq || eq == spec) {
+        set_baton_error(error, -1, "Invalid rate limit '%s': expected "
+                        "<operation>=<n>/<unit>", spec);
+        goto error;
+    }
+
+    const size_t name_len = eq - spec;
+    if (name_len >= MAX_RATE_LIMIT_NAME_LEN) {
+        set_baton_error(error, -1, "Invalid rate limit '%s': operation "
+                        "name exceeds %d characters", spec,
+                        MAX_RATE_LIMIT_NAME_LEN - 1);
+        goto error;
+    }
+
+    errno = 0;
+    char *end_ptr;
+    double rate = strtod(eq + 1, &end_ptr);
+    if (errno != 0 || end_ptr == eq + 1 || !isfinite(rate) || rate <= 0) {
+        set_baton_error(error, -1, "Invalid rate limit '%s': the rate "
+                        "must be a positive number", spec);
+        goto error;
+    }
+
+    // The number of seconds per unit
+    double unit;
+    if      (strcmp(end_ptr, "")   == 0) unit = 1;
+    else if (strcmp(end_ptr, "/s") == 0) unit = 1;
+    else if (strcmp(end_ptr, "/m") == 0) unit = 60;
+    else if (strcmp(end_ptr, "/h") == 0) unit = 3600;
+    else {
+        set_baton_error(error, -1, "Invalid rate limit '%s': the unit "
+                        "must be one of /s, /m or /h", spec);
+        goto error;
+    }
+    rate = rate / unit;
+
+    char name[MAX_RATE_LIMIT_NAME_LEN];
+    memcpy(name, spec, name_len);
+    name[name_len] = '\0';
+
+    pthread_mutex_lock(&limits->lock);
+    token_bucket_t *bucket = find_bucket(limits, name);
+    if (!bucket) {
+        if (limits->num_buckets == MAX_RATE_LIMITS) {
+            pthread_mutex_unlock(&limits->lock);
+            set_baton_error(error, -1, "Invalid rate limit '%s': no more "
+                            "than %d operations may be rate limited",
+                            spec, MAX_RATE_LIMITS);
+            goto error;
+        }
+        bucket = &limits->buckets[limits->num_buckets++];
+    }
+
+    snprintf(bucket->name, MAX_RATE_LIMIT_NAME_LEN, "%s", name);
+    bucket->rate     = rate;
+    bucket->capacity = rate > 1 ? rate : 1;
+    bucket->tokens   = bucket->capacity;
+    clock_gettime(CLOCK_MONOTONIC, &bucket->last_fill);
+    pthread_mutex_unlock(&limits->lock);
+
+    logmsg(DEBUG, "Limiting operation '%s' to %.3f per second", name, rate);
+
+    return 0;
+
+error:
+    return error->code;
+}
+
+double reserve_rate_token(rate_limits_t *limits, const char *op_name) {
+    double delay = 0;
+
+    if (!op_name) return delay;
+
+    pthread_mutex_lock(&limits->lock);
+    token_bucket_t *bucket = find_bucket(limits, op_name);
+    if (bucket) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+
+        const double elapsed = (double) (now.tv_sec - bucket->last_fill.tv_sec) +
+            (double) (now.tv_nsec - bucket->last_fill.tv_nsec) / 1e9;
+        bucket->tokens += elapsed * bucket->rate;
+        if (bucket->tokens > bucket->capacity) {
+            bucket->tokens = bucket->capacity;
+        }
+        bucket->last_fill = now;
+
+        // Taking a token that has not yet been added reserves it for
+        // this caller, so that waiting callers proceed in turn
+        bucket->tokens -= 1;
+        if (bucket->tokens < 0) {
+            delay = -bucket->tokens / bucket->rate;
+        }
+    }
+    pthread_mutex_unlock(&limits->lock);
+
+    return delay;
+}
+
+void wait_for_rate_limit(rate_limits_t *limits, const char *op_name) {
+    const double delay = reserve_rate_token(limits, op_name);
+    if (delay > 0) {
+        logmsg(DEBUG, "Rate limiting operation '%s' for %.3f seconds",
+               op_name, delay);
+        sleep_unless_signalled(delay);
+    }
+}
+
+void free_rate_limits(rate_limits_t *limits) {
+    pthread_mutex_destroy(&limits->lock);
+}
@@ -0,0 +1,113 @@
+/**
+ * Copyright (C) 2026 Genome Research Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @file rate_limit.h
+ * @author Keith James <kdj@sanger.ac.uk>
+ */
+
+#ifndef _BATON_RATE_LIMIT_H
+#define _BATON_RATE_LIMIT_H
+
+#include <pthread.h>
+#include <time.h>
+
+#include "config.h"
+#include "error.h"
+
+/** The maximum number of operation types that may be rate limited */
+#define MAX_RATE_LIMITS 16
+
+/** The maximum length of a rate limited operation name */
+#define MAX_RATE_LIMIT_NAME_LEN 32
+
+/**
+ *  @struct token_bucket
+ *  @brief A token bucket limiting the rate of one type of operation.
+ *  The bucket holds up to one second's worth of tokens (and at least
+ *  one), so that short bursts are permitted at the start of a run or
+ *  after a pause.
+ */
+typedef struct token_bucket {
+    /** The operation name. */
+    char name[MAX_RATE_LIMIT_NAME_LEN];
+    /** The rate at which tokens are added, per second. */
+    double rate;
+    /** The maximum number of tokens held. */
+    double capacity;
+    /** The number of tokens held. Negative when tokens have been
+        reserved by callers waiting for them. */
+    double tokens;
+    /** When tokens were last added. */
+    struct timespec last_fill;
+} token_bucket_t;
+
+/**
+ *  @struct rate_limits
+ *  @brief Rate limits for operations, shared between threads.
+ */
+typedef struct rate_limits {
+    /** The token buckets, one per operation type. */
+    token_bucket_t buckets[MAX_RATE_LIMITS];
+    /** The number of buckets. */
+    size_t num_buckets;
+    /** Mutex protecting all of the above. */
+    pthread_mutex_t lock;
+} rate_limits_t;
+
+/**
+ * Initialise a set of rate limits, initially empty.
+ *
+ * @param[out] limits       A set of rate limits.
+ */
+void init_rate_limits(rate_limits_t *limits);
+
+/**
+ * Add a rate limit given as a string of the form <op>=<n>/<unit>,
+ * where unit is one of s, m or h (per second, minute or hour), e.g.
+ * "metaquery=200/s". The unit is optional and defaults to seconds.
+ * A limit given again for the same operation replaces the earlier one.
+ *
+ * @param[in,out] limits    A set of rate limits.
+ * @param[in]     spec      A rate limit specification.
+ * @param[out]    error     An error report struct.
+ *
+ * @return 0 on success, error code on failure.
+ */
+int add_rate_limit(rate_limits_t *limits, const char *spec,
+                   baton_error_t *error);
+
+/**
+ * Reserve a token to perform an operation, without waiting for it.
+ *
+ * @param[in,out] limits    A set of rate limits.
+ * @param[in]     op_name   The operation name.
+ *
+ * @return The time in seconds to wait before the operation may
+ * proceed, 0 if it may proceed at once or is not rate limited.
+ */
+double reserve_rate_token(rate_limits_t *limits, const char *op_name);
+
+/**
+ * Wait until an operation may proceed within its rate limit.
+ *
+ * @param[in,out] limits    A set of rate limits.
+ * @param[in]     op_name   The operation name.
+ */
+void wait_for_rate_limit(rate_limits_t *limits, const char *op_name);
+
+void free_rate_limits(rate_limits_t *limits);
+
+#endif // _BATON_RATE_LIMIT_H
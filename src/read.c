@@ -1,6 +1,6 @@
 /**
- * Copyright (C) 2014, 2015, 2017, 2018, 2020, 2021, 2025 Genome Research
- * Ltd. All rights reserved.
+ * Copyright (C) 2014, 2015, 2017, 2018, 2020, 2021, 2025, 2026 Genome
+ * Research Ltd. All rights reserved.
  *
  * This program is free software: you can redistribute it and/or modify
  * it under the terms of the GNU General Public License as published by
@@ -23,6 +23,7 @@
 
 #include "config.h"
 #include "compat_checksum.h"
+#include "path_cache.h"
 #include "read.h"
 
 static char *do_slurp(rcComm_t *conn, rodsPath_t *rods_path,
@@ -153,6 +154,7 @@ data_obj_file_t *open_data_obj(rcComm_t *conn, rodsPath_t *rods_path,
           obj_open_in.dataSize   = 0;
           addKeyVal(&obj_open_in.condInput, FORCE_FLAG_KW, "");
           descriptor = rcDataObjCreate(conn, &obj_open_in);
+          uncache_path(rods_path->outPath);
           clearKeyVal(&obj_open_in.condInput);
           break;
 
@@ -575,6 +577,7 @@ char *checksum_data_obj(rcComm_t *conn, rodsPath_t *rods_path,
 
     const int status = rcDataObjChksum(conn, &obj_chk_in, &checksum);
     clearKeyVal(&obj_chk_in.condInput);
+    uncache_path(rods_path->outPath);
 
     if (status < 0) {
         char *err_subname;
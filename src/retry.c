@@ -0,0 +1,94 @@
+/**
+ * Copyright (C) 2026 Genome Research Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @file retry.c
+ * @author Keith James <kdj@sanger.ac.uk>
+ */
+
+#include <stdlib.h>
+
+#include <rodsClient.h>
+
+#include "config.h"
+#include "concurrency.h"
+#include "json.h"
+#include "retry.h"
+#include "utilities.h"
+
+// Operations that read, or that write with overwrite forced, so that
+// a partial first attempt does not change the result of a second
+static const char *idempotent_ops[] = {
+    JSON_CHECKSUM_OP, JSON_LIST_OP, JSON_METAQUERY_OP, JSON_PUT_OP, NULL
+};
+
+int irods_error_base(const int code) {
+    return code - (code % 1000);
+}
+
+int is_transient_error(const int code) {
+    if (is_overload_error(code)) return 1;
+
+    switch (irods_error_base(code)) {
+        case SYS_SOCK_CONNECT_TIMEDOUT:
+        case SYS_AGENT_INIT_ERR:
+        case SYS_RESC_IS_DOWN:
+        case SYS_REMOTE_SERVER_TIMEDOUT:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+int is_connection_error(const int code) {
+    if (code >= 0) return 0;
+
+    switch (irods_error_base(code)) {
+        case SYS_HEADER_READ_LEN_ERR:
+        case SYS_HEADER_WRITE_LEN_ERR:
+        case SYS_SOCK_READ_TIMEDOUT:
+        case SYS_SOCK_READ_ERR:
+        case SYS_SOCK_CONNECT_ERR:
+        case USER_SOCK_CONNECT_ERR:
+        case USER_SOCK_CONNECT_TIMEDOUT:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+int is_idempotent_op(const char *op_name) {
+    if (!op_name) return 0;
+
+    for (size_t i = 0; idempotent_ops[i]; i++) {
+        if (str_equals(op_name, idempotent_ops[i], MAX_STR_LEN)) return 1;
+    }
+
+    return 0;
+}
+
+double retry_delay(const unsigned attempt, unsigned *seed) {
+    double bound = RETRY_BASE_DELAY;
+    for (unsigned i = 1; i < attempt && bound < RETRY_MAX_DELAY; i++) {
+        bound *= 2;
+    }
+    if (bound > RETRY_MAX_DELAY) bound = RETRY_MAX_DELAY;
+
+    // Choose between half the bound and the bound, so that the delay
+    // still grows with each attempt
+    const double jitter = (double) rand_r(seed) / RAND_MAX;
+
+    return bound / 2 + jitter * bound / 2;
+}
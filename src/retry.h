@@ -0,0 +1,89 @@
+/**
+ * Copyright (C) 2026 Genome Research Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @file retry.h
+ * @author Keith James <kdj@sanger.ac.uk>
+ */
+
+#ifndef _BATON_RETRY_H
+#define _BATON_RETRY_H
+
+#include "config.h"
+
+/** The default number of times a failed operation is retried */
+#define DEFAULT_MAX_RETRIES 3
+
+/** The delay before the first retry, in seconds */
+#define RETRY_BASE_DELAY 0.5
+
+/** The maximum delay before a retry, in seconds */
+#define RETRY_MAX_DELAY 30.0
+
+/**
+ * Return the base of an iRODS error code. iRODS error codes may have
+ * an errno added, in the last 3 digits, which is removed.
+ *
+ * @param[in] code          An iRODS error code.
+ *
+ * @return The error code without any errno.
+ */
+int irods_error_base(int code);
+
+/**
+ * Test whether an iRODS error code indicates a failure that may not
+ * recur if the operation is retried, such as a lost connection or an
+ * unavailable server.
+ *
+ * @param[in] code          An iRODS error code.
+ *
+ * @return 1 if the error is transient, 0 otherwise.
+ */
+int is_transient_error(int code);
+
+/**
+ * Test whether an iRODS error code indicates that the connection on
+ * which it occurred is no longer usable.
+ *
+ * @param[in] code          An iRODS error code.
+ *
+ * @return 1 if the connection should be closed, 0 otherwise.
+ */
+int is_connection_error(int code);
+
+/**
+ * Test whether a baton operation may safely be repeated after it
+ * has failed part way through.
+ *
+ * @param[in] op_name       A baton operation name.
+ *
+ * @return 1 if the operation is idempotent, 0 otherwise.
+ */
+int is_idempotent_op(const char *op_name);
+
+/**
+ * Return the delay before retrying an operation. The delay grows
+ * exponentially with each attempt, up to RETRY_MAX_DELAY, and is
+ * chosen at random between half that bound and the bound, so that
+ * clients that failed together do not retry together.
+ *
+ * @param[in]     attempt   The number of attempts made, from 1.
+ * @param[in,out] seed      Random number generator state.
+ *
+ * @return The delay in seconds.
+ */
+double retry_delay(unsigned attempt, unsigned *seed);
+
+#endif // _BATON_RETRY_H
@@ -0,0 +1,476 @@
+/**
+ * Copyright (C) 2026 Genome Research Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @file shard.c
+ * @author Keith James <kdj@sanger.ac.uk>
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <jansson.h>
+
+#include "config.h"
+#include "json.h"
+#include "log.h"
+#include "shard.h"
+#include "signal_handler.h"
+
+#define SHARD_READ_SIZE (64 * 1024)
+
+// A worker process and the parent's ends of its pipes
+typedef struct shard {
+    pid_t pid;
+    // Input to the worker
+    FILE *input;
+    // Output from the worker, or -1 when it has been read to the end
+    int output_fd;
+    // Output read from the worker that is not yet a complete line
+    char *pending;
+    size_t pending_length;
+    size_t pending_capacity;
+} shard_t;
+
+typedef struct merger {
+    shard_t *shards;
+    unsigned num_shards;
+    int flush;
+    int status;
+} merger_t;
+
+// Return the FNV-1a hash of a string
+static uint64_t hash_str(const char *str) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (const unsigned char *c = (const unsigned char *) str; *c; c++) {
+        hash ^= *c;
+        hash *= 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+// Return the index of the shard to process an item, chosen by the
+// collection containing its target. Items without a valid target are
+// processed by the first shard, where they fail.
+static unsigned route_item(const json_t *item, const unsigned num_shards) {
+    baton_error_t error;
+    const json_t *target = item;
+
+    if (has_operation(item)) {
+        if (has_operation_targets(item)) {
+            target = json_array_get(get_operation_targets(item, &error), 0);
+        }
+        else {
+            target = get_operation_target(item, &error);
+        }
+        if (!target) return 0;
+    }
+
+    char *path = json_to_path(target, &error);
+    if (error.code != 0 || !path) {
+        if (path) free(path);
+        return 0;
+    }
+
+    char *slash = strrchr(path, '/');
+    if (slash == path) slash[1] = '\0';
+    else if (slash)    slash[0] = '\0';
+
+    const unsigned index = (unsigned) (hash_str(path) % num_shards);
+    free(path);
+
+    return index;
+}
+
+// Run a worker process, reading input from in_fd and writing output
+// to out_fd. Does not return.
+static void run_worker(const int in_fd, const int out_fd,
+                       const baton_json_op fn,
+                       const operation_args_t *args) {
+    if (dup2(out_fd, STDOUT_FILENO) < 0) {
+        logmsg(ERROR, "Failed to redirect worker output: error %d %s",
+               errno, strerror(errno));
+        _exit(1);
+    }
+    close(out_fd);
+
+    FILE *input = fdopen(in_fd, "r");
+    if (!input) {
+        logmsg(ERROR, "Failed to open worker input: error %d %s",
+               errno, strerror(errno));
+        _exit(1);
+    }
+
+    // Workers' outputs are merged line by line as they complete, so
+    // each carries a correlation ID and raw data may not be printed
+    operation_args_t worker_args = *args;
+    worker_args.flags = worker_args.flags | UNORDERED | NO_RAW_OUTPUT;
+
+    const int status = do_operation(input, fn, &worker_args);
+    fclose(input);
+    fflush(stdout);
+
+    _exit(status);
+}
+
+// Write the complete lines of output read from a worker
+static int write_pending_lines(shard_t *shard) {
+    char *end = NULL;
+    for (size_t i = shard->pending_length; i > 0; i--) {
+        if (shard->pending[i - 1] == '\n') {
+            end = shard->pending + i;
+            break;
+        }
+    }
+    if (!end) return 0;
+
+    const size_t length = end - shard->pending;
+    if (fwrite(shard->pending, 1, length, stdout) != length) return -1;
+
+    shard->pending_length -= length;
+    memmove(shard->pending, end, shard->pending_length);
+
+    return 0;
+}
+
+// Read available output from a worker. Returns 0 at the end of the
+// output, -1 on error, otherwise 1.
+static int read_worker_output(shard_t *shard) {
+    if (shard->pending_capacity - shard->pending_length < SHARD_READ_SIZE) {
+        const size_t capacity = shard->pending_capacity + SHARD_READ_SIZE;
+        char *tmp = realloc(shard->pending, capacity);
+        if (!tmp) {
+            logmsg(ERROR, "Failed to allocate memory: error %d %s",
+                   errno, strerror(errno));
+            return -1;
+        }
+        shard->pending          = tmp;
+        shard->pending_capacity = capacity;
+    }
+
+    const ssize_t n = read(shard->output_fd,
+                           shard->pending + shard->pending_length,
+                           SHARD_READ_SIZE);
+    if (n < 0) {
+        if (errno == EINTR || errno == EAGAIN) return 1;
+
+        logmsg(ERROR, "Failed to read output of worker %d: error %d %s",
+               shard->pid, errno, strerror(errno));
+        return -1;
+    }
+    if (n == 0) return 0;
+
+    shard->pending_length += n;
+    if (write_pending_lines(shard) != 0) {
+        logmsg(ERROR, "Failed to write output: error %d %s",
+               errno, strerror(errno));
+        return -1;
+    }
+
+    return 1;
+}
+
+// Merge the output of the workers to STDOUT, a line at a time. Runs in
+// its own thread until all workers' output has been read.
+static void *merge_outputs(void *arg) {
+    merger_t *merger = arg;
+    struct pollfd fds[MAX_NUM_SHARDS];
+    shard_t *polled[MAX_NUM_SHARDS];
+
+    while (1) {
+        nfds_t num_fds = 0;
+        for (unsigned i = 0; i < merger->num_shards; i++) {
+            if (merger->shards[i].output_fd < 0) continue;
+
+            fds[num_fds].fd      = merger->shards[i].output_fd;
+            fds[num_fds].events  = POLLIN;
+            fds[num_fds].revents = 0;
+            polled[num_fds]      = &merger->shards[i];
+            num_fds++;
+        }
+        if (num_fds == 0) break;
+
+        if (poll(fds, num_fds, -1) < 0) {
+            if (errno == EINTR) continue;
+
+            logmsg(ERROR, "Failed to poll worker output: error %d %s",
+                   errno, strerror(errno));
+            merger->status = 1;
+            break;
+        }
+
+        for (nfds_t i = 0; i < num_fds; i++) {
+            if (!(fds[i].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+
+            shard_t *shard = polled[i];
+            const int status = read_worker_output(shard);
+            if (status < 0) merger->status = 1;
+            if (status <= 0) {
+                if (shard->pending_length > 0) {
+                    logmsg(ERROR, "Discarding incomplete output of "
+                           "worker %d", shard->pid);
+                    merger->status = 1;
+                }
+                close(shard->output_fd);
+                shard->output_fd = -1;
+            }
+        }
+
+        if (merger->flush) fflush(stdout);
+    }
+
+    fflush(stdout);
+
+    return NULL;
+}
+
+int do_sharded_operation(FILE *input, const baton_json_op fn,
+                         operation_args_t *args, const unsigned num_shards) {
+    shard_t shards[MAX_NUM_SHARDS];
+    int in_pipes[MAX_NUM_SHARDS][2];
+    int out_pipes[MAX_NUM_SHARDS][2];
+    unsigned num_started = 0;
+    int status = 0;
+    int error_count = 0;
+
+    pthread_t merger_tid;
+    int merger_status = -1;
+    merger_t merger = { .shards     = shards,
+                        .num_shards = 0,
+                        .flush      = args->flags & FLUSH,
+                        .status     = 0 };
+
+    if (num_shards < 1 || num_shards > MAX_NUM_SHARDS) {
+        logmsg(ERROR, "The number of shards (--shards argument) "
+               "must be >=1 and <=%d", MAX_NUM_SHARDS);
+        return 1;
+    }
+
+    if (args->journal_path) {
+        logmsg(ERROR, "A journal may not be used with shards");
+        return 1;
+    }
+
+    if (args->flags & PRINT_RAW) {
+        logmsg(ERROR, "Raw output may not be used with shards");
+        return 1;
+    }
+
+    memset(shards, 0, sizeof shards);
+    for (unsigned i = 0; i < num_shards; i++) {
+        shards[i].output_fd = -1;
+        in_pipes[i][0]  = in_pipes[i][1]  = -1;
+        out_pipes[i][0] = out_pipes[i][1] = -1;
+    }
+
+    // Workers are notified of signals like the parent
+    if (apply_signal_handler() != 0) return 1;
+
+    for (unsigned i = 0; i < num_shards; i++) {
+        if (pipe(in_pipes[i]) != 0 || pipe(out_pipes[i]) != 0) {
+            logmsg(ERROR, "Failed to create pipes for worker %u: "
+                   "error %d %s", i, errno, strerror(errno));
+            status = 1;
+            goto finally;
+        }
+    }
+
+    // Nothing buffered may be written twice by the workers
+    fflush(stdout);
+    fflush(stderr);
+
+    for (unsigned i = 0; i < num_shards; i++) {
+        const pid_t pid = fork();
+        if (pid < 0) {
+            logmsg(ERROR, "Failed to start worker %u: error %d %s",
+                   i, errno, strerror(errno));
+            status = 1;
+            goto finally;
+        }
+
+        if (pid == 0) {
+            // Each worker must hold only its own ends of its own pipes,
+            // so that closing the parent's ends is seen as the end of
+            // input and output
+            for (unsigned j = 0; j < num_shards; j++) {
+                if (shards[j].input)          fclose(shards[j].input);
+                if (shards[j].output_fd >= 0) close(shards[j].output_fd);
+                if (j != i && in_pipes[j][0] >= 0) close(in_pipes[j][0]);
+                if (j != i && out_pipes[j][1] >= 0) close(out_pipes[j][1]);
+                if (in_pipes[j][1] >= 0)  close(in_pipes[j][1]);
+                if (out_pipes[j][0] >= 0) close(out_pipes[j][0]);
+            }
+
+            run_worker(in_pipes[i][0], out_pipes[i][1], fn, args);
+        }
+
+        shards[i].pid = pid;
+        num_started++;
+
+        close(in_pipes[i][0]);
+        close(out_pipes[i][1]);
+        in_pipes[i][0]  = -1;
+        out_pipes[i][1] = -1;
+
+        shards[i].output_fd = out_pipes[i][0];
+        out_pipes[i][0] = -1;
+
+        shards[i].input = fdopen(in_pipes[i][1], "w");
+        if (!shards[i].input) {
+            logmsg(ERROR, "Failed to open input of worker %u: error %d %s",
+                   i, errno, strerror(errno));
+            status = 1;
+            goto finally;
+        }
+        in_pipes[i][1] = -1;
+    }
+
+    logmsg(DEBUG, "Started %u workers", num_started);
+
+    merger.num_shards = num_started;
+    merger_status = pthread_create(&merger_tid, NULL, &merge_outputs,
+                                   &merger);
+    if (merger_status != 0) {
+        logmsg(ERROR, "Failed to start output merger thread: %s",
+               strerror(merger_status));
+        status = 1;
+        goto finally;
+    }
+
+    size_t ordinal = 0;
+    while (!exit_flag && !feof(input)) {
+        const size_t jflags = JSON_DISABLE_EOF_CHECK | JSON_REJECT_DUPLICATES;
+        json_error_t load_error;
+        json_t *item = json_loadf(input, jflags, &load_error);
+
+        if (!item) {
+            if (!feof(input)) {
+                logmsg(ERROR, "JSON error at line %d, column %d: %s",
+                       load_error.line, load_error.column, load_error.text);
+                error_count++;
+            }
+            continue;
+        }
+
+        if (!json_is_object(item)) {
+            logmsg(ERROR, "Item %zu in stream was not a JSON object; "
+                   "skipping", ordinal);
+            error_count++;
+            json_decref(item);
+            continue;
+        }
+
+        // The worker's position for the item is not its position in
+        // the input, so the latter is given as its ID
+        baton_error_t id_error;
+        add_correlation_id(item, item, ordinal, &id_error);
+
+        // Each item is flushed, so that a worker is not left waiting
+        // for items held in the buffer while the input is idle
+        shard_t *shard = &shards[route_item(item, num_shards)];
+        const int written =
+            json_dumpf(item, shard->input, JSON_COMPACT) == 0 &&
+            fputc('\n', shard->input) != EOF &&
+            fflush(shard->input) == 0;
+        json_decref(item);
+        ordinal++;
+
+        if (!written) {
+            logmsg(ERROR, "Failed to send item %zu to worker %d: "
+                   "error %d %s", ordinal - 1, shard->pid, errno,
+                   strerror(errno));
+            status = 1;
+            break;
+        }
+    }
+
+finally:
+    // Closing the workers' input lets them finish
+    for (unsigned i = 0; i < num_shards; i++) {
+        if (shards[i].input) {
+            if (fclose(shards[i].input) != 0) {
+                logmsg(ERROR, "Failed to close input of worker %d: "
+                       "error %d %s", shards[i].pid, errno,
+                       strerror(errno));
+                status = 1;
+            }
+            shards[i].input = NULL;
+        }
+        for (int j = 0; j < 2; j++) {
+            if (in_pipes[i][j] >= 0)  close(in_pipes[i][j]);
+            if (out_pipes[i][j] >= 0) close(out_pipes[i][j]);
+        }
+    }
+
+    if (merger_status != 0) {
+        // With no merger reading their output, the workers are stopped
+        // by closing it
+        for (unsigned i = 0; i < num_started; i++) {
+            close(shards[i].output_fd);
+            shards[i].output_fd = -1;
+        }
+    }
+    else {
+        const int join_status = pthread_join(merger_tid, NULL);
+        if (join_status != 0) {
+            logmsg(ERROR, "Output merger thread failed to join: %s",
+                   strerror(join_status));
+        }
+        if (merger.status != 0 && status == 0) status = merger.status;
+    }
+
+    for (unsigned i = 0; i < num_started; i++) {
+        int worker_status;
+        while (waitpid(shards[i].pid, &worker_status, 0) < 0) {
+            if (errno != EINTR) {
+                worker_status = -1;
+                break;
+            }
+        }
+
+        if (worker_status == -1 || !WIFEXITED(worker_status)) {
+            logmsg(ERROR, "Worker %d failed", shards[i].pid);
+            if (status == 0) status = 1;
+        }
+        else if (WEXITSTATUS(worker_status) != 0) {
+            logmsg(DEBUG, "Worker %d exited with status %d", shards[i].pid,
+                   WEXITSTATUS(worker_status));
+            if (status == 0) status = WEXITSTATUS(worker_status);
+        }
+
+        if (shards[i].output_fd >= 0) close(shards[i].output_fd);
+        if (shards[i].pending)        free(shards[i].pending);
+    }
+
+    if (exit_flag) {
+        logmsg(WARN, "Exiting on signal with code %d", exit_flag);
+        if (status == 0) status = exit_flag;
+    }
+
+    if (error_count > 0) {
+        logmsg(WARN, "Failed to read %d items", error_count);
+        if (status == 0) status = 1;
+    }
+
+    return status;
+}
@@ -0,0 +1,56 @@
+/**
+ * Copyright (C) 2026 Genome Research Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @file shard.h
+ * @author Keith James <kdj@sanger.ac.uk>
+ */
+
+#ifndef _BATON_SHARD_H
+#define _BATON_SHARD_H
+
+#include <stdio.h>
+
+#include "config.h"
+#include "operations.h"
+
+/** The maximum number of worker processes in sharded mode */
+#define MAX_NUM_SHARDS 64
+
+/**
+ * Process a stream of baton JSON documents with a number of worker
+ * processes, each running do_operation with its own iRODS session.
+ * The parent process reads the input and routes each document to a
+ * worker chosen by a hash of the collection containing its target,
+ * so that the documents for one collection are processed by one
+ * worker. The parent merges the workers' output to STDOUT.
+ *
+ * Output is printed in completion order. Each output carries the "id"
+ * of its input document or, if it has none, the document's position
+ * in the input.
+ *
+ * @param[in] input         A file handle.
+ * @param[in] fn            A function to process each document.
+ * @param[in] args          Arguments passed to each worker's
+ *                          do_operation.
+ * @param[in] num_shards    The number of worker processes.
+ *
+ * @return 0 on success, or the first non-zero status of the parent or
+ * a worker.
+ */
+int do_sharded_operation(FILE *input, baton_json_op fn,
+                         operation_args_t *args, unsigned num_shards);
+
+#endif // _BATON_SHARD_H
@@ -1,5 +1,6 @@
 /**
- * Copyright (C) 2021, 2025 Genome Research Ltd. All rights reserved.
+ * Copyright (C) 2021, 2025, 2026 Genome Research Ltd. All rights
+ * reserved.
  *
  * This program is free software: you can redistribute it and/or modify
  * it under the terms of the GNU General Public License as published by
@@ -21,7 +22,9 @@
 #include "signal_handler.h"
 #include "baton.h"
 
+#include <errno.h>
 #include <signal.h>
+#include <time.h>
 
 int signals[] = {SIGINT, SIGQUIT, SIGHUP, SIGTERM, SIGUSR1, SIGUSR2, SIGPIPE, 0};
 int exit_flag;
@@ -69,3 +72,19 @@ int apply_signal_handler() {
 
     return 0;
 }
+
+void sleep_unless_signalled(double seconds) {
+    // Sleep in short intervals so that a signal is noticed promptly
+    while (seconds > 0 && !exit_flag) {
+        const double interval = seconds > 1 ? 1 : seconds;
+        struct timespec req = { .tv_sec  = (time_t) interval,
+                                .tv_nsec = (long) ((interval - (time_t) interval)
+                                                   * 1e9) };
+        struct timespec rem;
+        while (nanosleep(&req, &rem) != 0 && errno == EINTR && !exit_flag) {
+            req = rem;
+        }
+
+        seconds -= interval;
+    }
+}
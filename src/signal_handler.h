@@ -1,5 +1,6 @@
 /**
- * Copyright (C) 2021, 2025 Genome Research Ltd. All rights reserved.
+ * Copyright (C) 2021, 2025, 2026 Genome Research Ltd. All rights
+ * reserved.
  *
  * This program is free software: you can redistribute it and/or modify
  * it under the terms of the GNU General Public License as published by
@@ -27,4 +28,11 @@ void handle_signal(int signal);
 
 int apply_signal_handler();
 
+/**
+ * Sleep for a time, returning early if a signal sets exit_flag.
+ *
+ * @param[in] seconds   The time to sleep, in seconds.
+ */
+void sleep_unless_signalled(double seconds);
+
 #endif /* _BATON_SIGNAL_HANDLER_H */
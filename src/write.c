@@ -1,6 +1,6 @@
 /**
- * Copyright (C) 2014, 2015, 2017, 2018, 2019, 2020, 2021, 2025 Genome
- * Research Ltd. All rights reserved.
+ * Copyright (C) 2014, 2015, 2017, 2018, 2019, 2020, 2021, 2025, 2026
+ * Genome Research Ltd. All rights reserved.
  *
  * This program is free software: you can redistribute it and/or modify
  * it under the terms of the GNU General Public License as published by
@@ -30,6 +30,7 @@ int chksumLocFile( const char *fileName, char *chksumStr, const char* );
 
 #include "config.h"
 #include "compat_checksum.h"
+#include "path_cache.h"
 #include "write.h"
 
 int put_data_obj(rcComm_t *conn, const char *local_path, rodsPath_t *rods_path,
@@ -117,6 +118,8 @@ int put_data_obj(rcComm_t *conn, const char *local_path, rodsPath_t *rods_path,
     addKeyVal(&obj_open_in.condInput, FORCE_FLAG_KW, "");
 
     status = rcDataObjPut(conn, &obj_open_in, tmpname);
+    uncache_path(rods_path->outPath);
+
     if (status < 0) {
         char *err_subname;
         const char *err_name = rodsErrorName(status, &err_subname);
@@ -267,6 +270,8 @@ int create_collection(rcComm_t *conn, rodsPath_t *rods_path, const int flags,
     }
 
     const int status = rcCollCreate(conn, &coll_create_in);
+    uncache_path(rods_path->outPath);
+
     if (status < 0) {
         char *err_subname;
         const char *err_name = rodsErrorName(status, &err_subname);
@@ -291,6 +296,8 @@ int remove_data_object(rcComm_t *conn, rodsPath_t *rods_path, const int flags,
     addKeyVal(&obj_rm_in.condInput, FORCE_FLAG_KW, "");
 
     const int status = rcDataObjUnlink(conn, &obj_rm_in);
+    uncache_path(rods_path->outPath);
+
     if (status < 0) {
         char *err_subname;
         const char *err_name = rodsErrorName(status, &err_subname);
@@ -321,6 +328,8 @@ int remove_collection(rcComm_t *conn, rodsPath_t *rods_path, const int flags,
 
     const int verbose = 0;
     const int status = rcRmColl(conn, &col_rm_in, verbose);
+    uncache_collection(rods_path->outPath);
+
     if (status < 0) {
         char *err_subname;
         const char *err_name = rodsErrorName(status, &err_subname);
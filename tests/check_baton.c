@@ -1,6 +1,6 @@
 /**
  * Copyright (C) 2013, 2014, 2015, 2016, 2017, 2018, 2019, 2020, 2021,
- * 2022, 2023 Genome Research Ltd. All rights reserved.
+ * 2022, 2023, 2026 Genome Research Ltd. All rights reserved.
  *
  * This program is free software: you can redistribute it and/or modify
  * it under the terms of the GNU General Public License as published by
@@ -20,6 +20,7 @@
 
 #include <assert.h>
 #include <limits.h>
+#include <stdint.h>
 #include <unistd.h>
 
 #include <jansson.h>
@@ -30,7 +31,14 @@
 #include "../src/log.h"
 #include "../src/read.h"
 #include "../src/compat_checksum.h"
+#include "../src/concurrency.h"
+#include "../src/retry.h"
+#include "../src/journal.h"
+#include "../src/arena.h"
+#include "../src/shard.h"
+#include "../src/connection_pool.h"
 #include "../src/signal_handler.h"
+#include "../src/path_cache.h"
 
 int exit_flag;
 
@@ -274,6 +282,514 @@ START_TEST(test_to_utf8) {
 }
 END_TEST
 
+// Can we add a correlation ID to a result?
+START_TEST(test_add_correlation_id) {
+    baton_error_t error;
+
+    json_t *with_id = json_pack("{s:s, s:s}",
+                                JSON_OP_KEY, JSON_LIST_OP,
+                                JSON_ID_KEY, "abc");
+    json_t *without_id = json_pack("{s:s}", JSON_OP_KEY, JSON_LIST_OP);
+    json_t *result = json_object();
+
+    // The caller's ID is copied to the result
+    add_correlation_id(result, with_id, 5, &error);
+    ck_assert_int_eq(error.code, 0);
+    ck_assert_str_eq(json_string_value(json_object_get(result, JSON_ID_KEY)),
+                     "abc");
+
+    // The sequence number is used when there is no ID
+    add_correlation_id(without_id, without_id, 5, &error);
+    ck_assert_int_eq(error.code, 0);
+    ck_assert_int_eq(json_integer_value(json_object_get(without_id,
+                                                        JSON_ID_KEY)), 5);
+
+    // Only objects can carry an ID
+    json_t *array = json_array();
+    add_correlation_id(array, with_id, 5, &error);
+    ck_assert_int_ne(error.code, 0);
+
+    json_decref(with_id);
+    json_decref(without_id);
+    json_decref(result);
+    json_decref(array);
+}
+END_TEST
+
+// Can we validate an envelope without contacting the server?
+START_TEST(test_baton_json_prepare_op) {
+    operation_args_t args = { .flags = FLUSH };
+    prepared_op_t prepared;
+    baton_error_t error;
+
+    json_t *target = json_pack("{s:s, s:s}",
+                               JSON_COLLECTION_KEY,  "/zone/coll",
+                               JSON_DATA_OBJECT_KEY, "f1.txt");
+    json_t *envelope = json_pack("{s:s, s:{s:b, s:s, s:s}, s:O}",
+                                 JSON_OP_KEY,      JSON_METAMOD_OP,
+                                 JSON_OP_ARGS_KEY,
+                                 JSON_OP_AVU,       1,
+                                 JSON_OP_OPERATION, JSON_ARG_META_ADD,
+                                 JSON_OP_PATH,      "/zone/other",
+                                 JSON_TARGET_KEY,  target);
+
+    baton_json_prepare_op(envelope, &args, &prepared, &error);
+    ck_assert_int_eq(error.code, 0);
+    ck_assert_str_eq(prepared.name, JSON_METAMOD_OP);
+    ck_assert_ptr_eq(prepared.target, target);
+    ck_assert(prepared.args.flags & FLUSH);
+    ck_assert(prepared.args.flags & PRINT_AVU);
+    ck_assert(prepared.args.flags & ADD_AVU);
+    ck_assert_str_eq(prepared.args.path, "/zone/other");
+    free_prepared_op(&prepared);
+
+    // An invalid operation argument is rejected
+    json_t *invalid = json_pack("{s:s, s:{s:s}, s:O}",
+                                JSON_OP_KEY,      JSON_METAMOD_OP,
+                                JSON_OP_ARGS_KEY,
+                                JSON_OP_OPERATION, "INVALID",
+                                JSON_TARGET_KEY,  target);
+    baton_json_prepare_op(invalid, &args, &prepared, &error);
+    ck_assert_int_ne(error.code, 0);
+
+    // An envelope must have a target
+    json_t *no_target = json_pack("{s:s}", JSON_OP_KEY, JSON_LIST_OP);
+    baton_json_prepare_op(no_target, &args, &prepared, &error);
+    ck_assert_int_ne(error.code, 0);
+
+    // Or an array of targets
+    json_t *batch = json_pack("{s:s, s:[O, O]}",
+                              JSON_OP_KEY,      JSON_LIST_OP,
+                              JSON_TARGETS_KEY, target, target);
+    baton_json_prepare_op(batch, &args, &prepared, &error);
+    ck_assert_int_eq(error.code, 0);
+    ck_assert_ptr_eq(prepared.target, NULL);
+    ck_assert_int_eq(json_array_size(prepared.targets), 2);
+    free_prepared_op(&prepared);
+
+    // But not both
+    json_t *both = json_pack("{s:s, s:O, s:[O]}",
+                             JSON_OP_KEY,      JSON_LIST_OP,
+                             JSON_TARGET_KEY,  target,
+                             JSON_TARGETS_KEY, target);
+    baton_json_prepare_op(both, &args, &prepared, &error);
+    ck_assert_int_ne(error.code, 0);
+
+    // Targets must be objects
+    json_t *invalid_batch = json_pack("{s:s, s:[O, s]}",
+                                      JSON_OP_KEY,      JSON_LIST_OP,
+                                      JSON_TARGETS_KEY, target, "INVALID");
+    baton_json_prepare_op(invalid_batch, &args, &prepared, &error);
+    ck_assert_int_ne(error.code, 0);
+
+    json_decref(target);
+    json_decref(envelope);
+    json_decref(invalid);
+    json_decref(no_target);
+    json_decref(batch);
+    json_decref(both);
+    json_decref(invalid_batch);
+}
+END_TEST
+
+// Can we serialise JSON into a reusable buffer?
+START_TEST(test_json_buffer) {
+    json_buffer_t buffer;
+    ck_assert_int_eq(init_json_buffer(&buffer, 4), 0);
+
+    json_t *obj = json_pack("{s:s, s:s}",
+                            JSON_DATA_OBJECT_KEY, "f1.txt",
+                            JSON_COLLECTION_KEY,  "/zone/coll");
+
+    // The buffer grows as required
+    ck_assert_int_eq(append_json_buffer(&buffer, obj), 0);
+    ck_assert_int_eq(append_json_buffer(&buffer, obj), 0);
+
+    const char *expected =
+        "{\"collection\": \"/zone/coll\", \"data_object\": \"f1.txt\"}\n";
+    ck_assert_int_eq(buffer.length, 2 * strlen(expected));
+    ck_assert(strncmp(buffer.data, expected, strlen(expected)) == 0);
+
+    // Writing empties the buffer
+    FILE *tmp = tmpfile();
+    ck_assert_int_eq(write_json_buffer(&buffer, tmp), 0);
+    ck_assert_int_eq(buffer.length, 0);
+    ck_assert_int_eq(ftell(tmp), 2 * strlen(expected));
+
+    fclose(tmp);
+    json_decref(obj);
+    free_json_buffer(&buffer);
+}
+END_TEST
+
+// Does the concurrency limit increase additively and decrease
+// multiplicatively?
+START_TEST(test_concurrency_controller) {
+    concurrency_controller_t controller;
+    init_concurrency_controller(&controller, 1, 8, 4);
+    ck_assert_int_eq(get_concurrency_limit(&controller), 4);
+
+    // One limit's worth of successes raises the limit by one
+    for (int i = 0; i < 4; i++) {
+        start_operation(&controller);
+        finish_operation(&controller, JSON_LIST_OP, 0.01, 0);
+    }
+    ck_assert_int_eq(get_concurrency_limit(&controller), 5);
+
+    // An overload error halves it
+    start_operation(&controller);
+    finish_operation(&controller, JSON_LIST_OP, 0.01,
+                     SYS_HEADER_READ_LEN_ERR);
+    ck_assert_int_eq(get_concurrency_limit(&controller), 2);
+
+    // Other errors do not change it
+    start_operation(&controller);
+    finish_operation(&controller, JSON_LIST_OP, 0.01, CAT_NO_ROWS_FOUND);
+    ck_assert_int_eq(get_concurrency_limit(&controller), 2);
+
+    ck_assert(is_overload_error(USER_SOCK_CONNECT_ERR - 111));
+    ck_assert(!is_overload_error(CAT_INVALID_ARGUMENT));
+    ck_assert(!is_overload_error(0));
+
+    free_concurrency_controller(&controller);
+}
+END_TEST
+
+// Can we parse rate limits and do token buckets limit the rate?
+START_TEST(test_rate_limits) {
+    rate_limits_t limits;
+    init_rate_limits(&limits);
+
+    baton_error_t error;
+    ck_assert_int_ne(add_rate_limit(&limits, "metaquery", &error), 0);
+    ck_assert_int_ne(add_rate_limit(&limits, "=10/s", &error), 0);
+    ck_assert_int_ne(add_rate_limit(&limits, "metaquery=0/s", &error), 0);
+    ck_assert_int_ne(add_rate_limit(&limits, "metaquery=10/d", &error), 0);
+    ck_assert_int_ne(add_rate_limit(&limits, "metaquery=x/s", &error), 0);
+    ck_assert_int_eq(limits.num_buckets, 0);
+
+    ck_assert_int_eq(add_rate_limit(&limits, "put=60/m", &error), 0);
+    ck_assert_int_eq(add_rate_limit(&limits, "metaquery=100", &error), 0);
+    ck_assert_int_eq(add_rate_limit(&limits, "metaquery=2/s", &error), 0);
+    ck_assert_int_eq(limits.num_buckets, 2);
+    ck_assert(limits.buckets[0].rate == 1);
+    ck_assert(limits.buckets[1].rate == 2);
+
+    // A burst of up to one second's worth proceeds at once
+    ck_assert(reserve_rate_token(&limits, JSON_METAQUERY_OP) == 0);
+    ck_assert(reserve_rate_token(&limits, JSON_METAQUERY_OP) == 0);
+
+    // Then each caller waits in turn
+    double delay1 = reserve_rate_token(&limits, JSON_METAQUERY_OP);
+    double delay2 = reserve_rate_token(&limits, JSON_METAQUERY_OP);
+    ck_assert(delay1 > 0.4 && delay1 <= 0.5);
+    ck_assert(delay2 > 0.9 && delay2 <= 1.0);
+
+    // Other operations are unaffected
+    ck_assert(reserve_rate_token(&limits, JSON_LIST_OP) == 0);
+    ck_assert(reserve_rate_token(&limits, JSON_PUT_OP) == 0);
+
+    free_rate_limits(&limits);
+}
+END_TEST
+
+// Does an arena allocate aligned memory and release it on reset?
+START_TEST(test_arena) {
+    arena_t arena;
+    init_arena(&arena, 1024);
+
+    char *a = arena_alloc(&arena, 1);
+    char *b = arena_alloc(&arena, 100);
+    ck_assert_ptr_ne(a, NULL);
+    ck_assert_ptr_ne(b, NULL);
+    ck_assert_int_eq((uintptr_t) a % 16, 0);
+    ck_assert_int_eq((uintptr_t) b % 16, 0);
+    ck_assert(b >= a + 16);
+    memset(b, 'x', 100);
+
+    // A large allocation has a block of its own and the current block
+    // is still used
+    char *large = arena_alloc(&arena, 4096);
+    ck_assert_ptr_ne(large, NULL);
+    memset(large, 'x', 4096);
+    char *c = arena_alloc(&arena, 16);
+    ck_assert(c > b && c < b + 1024);
+
+    // Filling the block starts another
+    for (size_t i = 0; i < 100; i++) {
+        ck_assert_ptr_ne(arena_alloc(&arena, 64), NULL);
+    }
+
+    // One standard block is kept for reuse
+    reset_arena(&arena);
+    ck_assert_ptr_ne(arena.blocks, NULL);
+    ck_assert_ptr_eq(arena.blocks->next, NULL);
+    ck_assert_int_eq(arena.blocks->size, 1024);
+    ck_assert_int_eq(arena.blocks->used, 0);
+
+    free_arena(&arena);
+    ck_assert_ptr_eq(arena.blocks, NULL);
+}
+END_TEST
+
+// Can we free strings from json_dumps once the arena allocator is
+// installed, whether or not they were allocated from an arena?
+START_TEST(test_free_json_string) {
+    // JSON created before the arena allocator is installed cannot be
+    // freed afterwards, so the allocator must not leak into other tests
+    const char *fork = getenv("CK_FORK");
+    if (fork && str_equals(fork, "no", 3)) {
+        logmsg(WARN, "!!! Skipping arena test because tests are not "
+               "running in separate processes !!!");
+        return;
+    }
+
+    install_arena_allocator();
+
+    json_t *json = json_pack("{s:s}", JSON_COLLECTION_KEY, "/unit");
+    char *str = json_dumps(json, JSON_COMPACT);
+    ck_assert_str_eq(str, "{\"collection\":\"/unit\"}");
+    free_json_string(str);
+
+    arena_t arena;
+    init_arena(&arena, DEFAULT_ARENA_BLOCK_SIZE);
+    arena_t *previous = set_thread_arena(&arena);
+    str = json_dumps(json, JSON_COMPACT);
+    set_thread_arena(previous);
+    ck_assert_str_eq(str, "{\"collection\":\"/unit\"}");
+    free_json_string(str);
+    free_arena(&arena);
+
+    json_decref(json);
+}
+END_TEST
+
+// Can we set an iRODS path of known type without resolving it?
+START_TEST(test_set_trusted_rods_path) {
+    rodsPath_t rods_path;
+    baton_error_t error;
+
+    char obj_path[] = "/zone/a/b.txt";
+    ck_assert_int_eq(set_trusted_rods_path(&rods_path, obj_path, DATA_OBJ_T,
+                                           &error), 0);
+    ck_assert_int_eq(error.code, 0);
+    ck_assert_str_eq(rods_path.outPath, obj_path);
+    ck_assert_int_eq(rods_path.objType, DATA_OBJ_T);
+    ck_assert_int_eq(rods_path.objState, EXIST_ST);
+    ck_assert_ptr_eq(rods_path.rodsObjStat, NULL);
+
+    char coll_path[] = "/zone/a";
+    ck_assert_int_eq(set_trusted_rods_path(&rods_path, coll_path, COLL_OBJ_T,
+                                           &error), 0);
+    ck_assert_str_eq(rods_path.outPath, coll_path);
+    ck_assert_int_eq(rods_path.objType, COLL_OBJ_T);
+}
+END_TEST
+
+// Are path types cached, evicted and invalidated?
+START_TEST(test_path_cache) {
+    rodsPath_t rods_path;
+    baton_error_t error;
+
+    init_rods_path(&rods_path, "/zone/a/b.txt");
+    snprintf(rods_path.outPath, MAX_NAME_LEN, "%s", "/zone/a/b.txt");
+    rods_path.objType  = DATA_OBJ_T;
+    rods_path.objState = EXIST_ST;
+
+    // Disabled by default
+    cache_path(&rods_path, path_cache_generation());
+    ck_assert(!get_cached_path(&rods_path));
+
+    ck_assert_int_eq(init_path_cache(2, 60, &error), 0);
+    cache_path(&rods_path, path_cache_generation());
+
+    rodsPath_t cached;
+    init_rods_path(&cached, "/zone/a/b.txt");
+    snprintf(cached.outPath, MAX_NAME_LEN, "%s", "/zone/a/b.txt");
+    ck_assert(get_cached_path(&cached));
+    ck_assert_int_eq(cached.objType, DATA_OBJ_T);
+    ck_assert_int_eq(cached.objState, EXIST_ST);
+    ck_assert_ptr_eq(cached.rodsObjStat, NULL);
+
+    // Changing a path does not invalidate the paths beneath it, but
+    // removing a collection does
+    uncache_path("/zone/a");
+    ck_assert(get_cached_path(&cached));
+    uncache_collection("/zone/a");
+    ck_assert(!get_cached_path(&cached));
+
+    // Creating a path invalidates missing ancestors, but no others
+    rodsPath_t missing;
+    init_rods_path(&missing, "/zone/c");
+    snprintf(missing.outPath, MAX_NAME_LEN, "%s", "/zone/c");
+    missing.objState = NOT_EXIST_ST;
+    cache_path(&missing, path_cache_generation());
+    cache_path(&rods_path, path_cache_generation());
+    uncache_path("/zone/c/d");
+    ck_assert(!get_cached_path(&missing));
+    ck_assert(get_cached_path(&cached));
+
+    // The least recently used path is evicted when full
+    cache_path(&missing, path_cache_generation());
+    ck_assert(get_cached_path(&cached));
+
+    rodsPath_t other;
+    init_rods_path(&other, "/zone/e");
+    snprintf(other.outPath, MAX_NAME_LEN, "%s", "/zone/e");
+    other.objType  = COLL_OBJ_T;
+    other.objState = EXIST_ST;
+    cache_path(&other, path_cache_generation());
+    ck_assert(!get_cached_path(&missing));
+    ck_assert(get_cached_path(&cached));
+    ck_assert(get_cached_path(&other));
+
+    // A path resolved before another was changed is not cached
+    const unsigned long generation = path_cache_generation();
+    uncache_path("/zone/e");
+    cache_path(&other, generation);
+    ck_assert(!get_cached_path(&other));
+
+    // A zero TTL disables the cache
+    ck_assert_int_eq(init_path_cache(2, 0, &error), 0);
+    ck_assert(!get_cached_path(&cached));
+    cache_path(&rods_path, path_cache_generation());
+    ck_assert(!get_cached_path(&cached));
+
+    free_path_cache();
+}
+END_TEST
+
+// Can we set and adapt the query page size?
+START_TEST(test_query_page_size) {
+    ck_assert_int_eq(get_query_page_size(), SEARCH_MAX_ROWS);
+    ck_assert(!is_adaptive_page_size());
+
+    set_query_page_size(100, 1);
+    ck_assert_int_eq(get_query_page_size(), 100);
+    ck_assert(is_adaptive_page_size());
+
+    set_query_page_size(MAX_SQL_ROWS + 1, 0);
+    ck_assert_int_eq(get_query_page_size(), MAX_SQL_ROWS);
+    ck_assert(!is_adaptive_page_size());
+
+    set_query_page_size(0, 0);
+    ck_assert_int_eq(get_query_page_size(), SEARCH_MAX_ROWS);
+
+    // Fast pages grow, slow pages shrink and others are unchanged
+    const double target = ADAPTIVE_PAGE_LATENCY;
+    ck_assert_int_eq(adapt_page_size(10, target / 10), 20);
+    ck_assert_int_eq(adapt_page_size(200, target / 10), MAX_SQL_ROWS);
+    ck_assert_int_eq(adapt_page_size(20, target * 2), 10);
+    ck_assert_int_eq(adapt_page_size(1, target * 2), 1);
+    ck_assert_int_eq(adapt_page_size(20, target * 0.75), 20);
+
+    baton_error_t error;
+    json_t *args = json_pack("{s:i}", JSON_OP_PAGE_SIZE, 100);
+    ck_assert(has_op_page_size(args));
+    ck_assert_int_eq(get_op_page_size(args, &error), 100);
+    ck_assert_int_eq(error.code, 0);
+    json_decref(args);
+
+    args = json_pack("{s:i}", JSON_OP_PAGE_SIZE, MAX_SQL_ROWS + 1);
+    get_op_page_size(args, &error);
+    ck_assert_int_eq(error.code, CAT_INVALID_ARGUMENT);
+    json_decref(args);
+
+    args = json_pack("{s:s}", JSON_OP_PAGE_SIZE, "100");
+    get_op_page_size(args, &error);
+    ck_assert_int_eq(error.code, CAT_INVALID_ARGUMENT);
+    json_decref(args);
+}
+END_TEST
+
+// Can we resume from a journal?
+START_TEST(test_journal) {
+    char path[] = "/tmp/baton_journal_XXXXXX";
+    const int fd = mkstemp(path);
+    ck_assert_int_ne(fd, -1);
+    close(fd);
+    unlink(path);
+
+    // A new journal resumes from the start
+    journal_t journal;
+    baton_error_t error;
+    ck_assert_int_eq(open_journal(&journal, path, &error), 0);
+    ck_assert_int_eq(journal.resume_ordinal, 0);
+    ck_assert_int_eq(journal.resume_offset, -1);
+    ck_assert(!is_journalled(&journal, 0));
+
+    const journal_entry_t entries[] = { { 1, 20 }, { 0, 10 }, { 3, 40 } };
+    for (size_t i = 0; i < 3; i++) {
+        ck_assert_int_eq(stage_journal_entry(&journal, entries[i], &error), 0);
+    }
+    ck_assert_int_eq(commit_journal(&journal, 1, &error), 0);
+    close_journal(&journal);
+
+    // A partial entry from an interrupted run is ignored
+    FILE *file = fopen(path, "a");
+    ck_assert_ptr_ne(file, NULL);
+    fputs("4 5", file);
+    fclose(file);
+
+    ck_assert_int_eq(open_journal(&journal, path, &error), 0);
+    ck_assert_int_eq(journal.resume_ordinal, 2);
+    ck_assert_int_eq(journal.resume_offset, 20);
+    ck_assert(is_journalled(&journal, 0));
+    ck_assert(is_journalled(&journal, 1));
+    ck_assert(!is_journalled(&journal, 2));
+    ck_assert(is_journalled(&journal, 3));
+    ck_assert(!is_journalled(&journal, 4));
+
+    const journal_entry_t entry = { 2, 30 };
+    ck_assert_int_eq(stage_journal_entry(&journal, entry, &error), 0);
+    close_journal(&journal);
+
+    // Entries written after a partial entry are read
+    ck_assert_int_eq(open_journal(&journal, path, &error), 0);
+    ck_assert_int_eq(journal.resume_ordinal, 4);
+    ck_assert_int_eq(journal.resume_offset, 40);
+    close_journal(&journal);
+
+    unlink(path);
+}
+END_TEST
+
+// Are errors and operations classified for retry and are retry delays
+// bounded?
+START_TEST(test_retry_policy) {
+    ck_assert(is_transient_error(SYS_HEADER_READ_LEN_ERR));
+    ck_assert(is_transient_error(USER_SOCK_CONNECT_ERR - 111));
+    ck_assert(is_transient_error(SYS_RESC_IS_DOWN));
+    ck_assert(!is_transient_error(CAT_NO_ROWS_FOUND));
+    ck_assert(!is_transient_error(USER_CHKSUM_MISMATCH));
+    ck_assert(!is_transient_error(0));
+
+    ck_assert_int_eq(irods_error_base(SYS_SOCK_READ_ERR - 104),
+                     SYS_SOCK_READ_ERR);
+    ck_assert(is_connection_error(SYS_SOCK_READ_ERR - 104));
+    ck_assert(!is_connection_error(SYS_RESC_IS_DOWN));
+    ck_assert(!is_connection_error(SYS_SERVER_LOAD_TOO_HIGH));
+
+    ck_assert(is_idempotent_op(JSON_LIST_OP));
+    ck_assert(is_idempotent_op(JSON_METAQUERY_OP));
+    ck_assert(is_idempotent_op(JSON_CHECKSUM_OP));
+    ck_assert(is_idempotent_op(JSON_PUT_OP));
+    ck_assert(!is_idempotent_op(JSON_METAMOD_OP));
+    ck_assert(!is_idempotent_op(JSON_MOVE_OP));
+    ck_assert(!is_idempotent_op(NULL));
+
+    unsigned seed = 1;
+    for (unsigned attempt = 1; attempt <= 10; attempt++) {
+        double bound = RETRY_BASE_DELAY * (1 << (attempt - 1));
+        if (bound > RETRY_MAX_DELAY) bound = RETRY_MAX_DELAY;
+
+        const double delay = retry_delay(attempt, &seed);
+        ck_assert(delay >= bound / 2);
+        ck_assert(delay <= bound);
+    }
+}
+END_TEST
+
 // Can we log in?
 START_TEST(test_rods_login) {
     rodsEnv env;
@@ -286,6 +802,41 @@ START_TEST(test_rods_login) {
 }
 END_TEST
 
+// Can we acquire and reuse connections from a pool?
+START_TEST(test_connection_pool) {
+    baton_error_t error;
+    connection_pool_t *pool = make_connection_pool(2, 10, &error);
+    ck_assert_int_eq(error.code, 0);
+    ck_assert_ptr_ne(pool, NULL);
+
+    pooled_connection_t *pconn1 = acquire_connection(pool, &error);
+    ck_assert_int_eq(error.code, 0);
+    ck_assert_ptr_ne(pconn1, NULL);
+    ck_assert(is_connection_open(pconn1->conn));
+
+    pooled_connection_t *pconn2 = acquire_connection(pool, &error);
+    ck_assert_int_eq(error.code, 0);
+    ck_assert_ptr_ne(pconn2, pconn1);
+
+    // A released connection is reused
+    rcComm_t *conn = pconn1->conn;
+    release_connection(pool, pconn1, 1);
+    pconn1 = acquire_connection(pool, &error);
+    ck_assert_int_eq(error.code, 0);
+    ck_assert_ptr_eq(pconn1->conn, conn);
+
+    // An unhealthy connection is replaced
+    release_connection(pool, pconn1, 0);
+    pconn1 = acquire_connection(pool, &error);
+    ck_assert_int_eq(error.code, 0);
+    ck_assert(is_connection_open(pconn1->conn));
+
+    release_connection(pool, pconn1, 1);
+    release_connection(pool, pconn2, 1);
+    free_connection_pool(pool);
+}
+END_TEST
+
 // Can we test that iRODS is accepting connections?
 START_TEST(test_is_irods_available) {
     const int avail = is_irods_available();
@@ -501,6 +1052,26 @@ START_TEST(test_list_obj) {
     ck_assert_str_eq(json_string_value(checksum),
                      "d41d8cd98f00b204e9800998ecf8427e");
 
+    // With replicates, matching the data object enriched one attribute
+    // at a time
+    baton_error_t error7;
+    json_t *results7 = list_path(conn, &rods_obj_path,
+                                 flags | PRINT_SIZE | PRINT_ACL | PRINT_AVU |
+                                 PRINT_TIMESTAMP | PRINT_CHECKSUM |
+                                 PRINT_REPLICATE, &error7);
+    ck_assert_int_eq(error7.code, 0);
+    json_t *replicates = json_object_get(results7, JSON_REPLICATE_KEY);
+    ck_assert_int_eq(json_array_size(replicates), 2);
+
+    baton_error_t error8;
+    json_t *expected7 = list_path(conn, &rods_obj_path,
+                                  flags | PRINT_SIZE | PRINT_ACL | PRINT_AVU,
+                                  &error8);
+    ck_assert_ptr_ne(add_checksum_json_object(conn, expected7, &error8), NULL);
+    ck_assert_ptr_ne(add_tps_json_object(conn, expected7, &error8), NULL);
+    ck_assert_ptr_ne(add_repl_json_object(conn, expected7, &error8), NULL);
+    ck_assert_int_eq(json_equal(results7, expected7), 1);
+
     json_decref(results1);
     json_decref(expected1);
 
@@ -516,6 +1087,9 @@ START_TEST(test_list_obj) {
     json_decref(results5);
     json_decref(results6);
 
+    json_decref(results7);
+    json_decref(expected7);
+
     json_decref(perm);
     json_decref(avu);
 
@@ -523,6 +1097,115 @@ START_TEST(test_list_obj) {
 }
 END_TEST
 
+// Do replicates map to the same locations with and without cached
+// resources?
+START_TEST(test_list_obj_resource_cache) {
+    option_flags flags = 0;
+    rodsEnv env;
+    rcComm_t *conn = rods_login(&env);
+
+    char rods_root[MAX_PATH_LEN];
+    set_current_rods_root(TEST_COLL, rods_root);
+
+    char obj_path[MAX_PATH_LEN];
+    snprintf(obj_path, MAX_PATH_LEN, "%s/f1.txt", rods_root);
+
+    rodsPath_t rods_obj_path;
+    baton_error_t resolve_obj_error;
+    ck_assert_int_eq(resolve_rods_path(conn, &env, &rods_obj_path, obj_path,
+                                       flags, &resolve_obj_error), EXIST_ST);
+
+    flags = PRINT_REPLICATE;
+    clear_resource_cache();
+
+    baton_error_t error1;
+    json_t *results1 = list_path(conn, &rods_obj_path, flags, &error1);
+    ck_assert_int_eq(error1.code, 0);
+
+    baton_error_t error2;
+    json_t *results2 = list_path(conn, &rods_obj_path, flags, &error2);
+    ck_assert_int_eq(error2.code, 0);
+    ck_assert_int_eq(json_equal(results1, results2), 1);
+
+    clear_resource_cache();
+
+    baton_error_t error3;
+    json_t *results3 = list_path(conn, &rods_obj_path, flags, &error3);
+    ck_assert_int_eq(error3.code, 0);
+    ck_assert_int_eq(json_equal(results1, results3), 1);
+
+    json_decref(results1);
+    json_decref(results2);
+    json_decref(results3);
+
+    if (conn) rcDisconnect(conn);
+}
+END_TEST
+
+// Does the resource cache survive the reset of the arena of the item
+// that filled it, as when baton-do runs items with --arena?
+START_TEST(test_list_obj_resource_cache_arena) {
+    // JSON created before the arena allocator is installed cannot be
+    // freed afterwards, so the allocator must not leak into other tests
+    const char *fork = getenv("CK_FORK");
+    if (fork && str_equals(fork, "no", 3)) {
+        logmsg(WARN, "!!! Skipping arena test because tests are not "
+               "running in separate processes !!!");
+        return;
+    }
+
+    option_flags flags = 0;
+    rodsEnv env;
+    rcComm_t *conn = rods_login(&env);
+
+    char rods_root[MAX_PATH_LEN];
+    set_current_rods_root(TEST_COLL, rods_root);
+
+    char obj_path[MAX_PATH_LEN];
+    snprintf(obj_path, MAX_PATH_LEN, "%s/f1.txt", rods_root);
+
+    rodsPath_t rods_obj_path;
+    baton_error_t resolve_obj_error;
+    ck_assert_int_eq(resolve_rods_path(conn, &env, &rods_obj_path, obj_path,
+                                       flags, &resolve_obj_error), EXIST_ST);
+
+    flags = PRINT_REPLICATE;
+    clear_resource_cache();
+    install_arena_allocator();
+
+    arena_t arena;
+    init_arena(&arena, DEFAULT_ARENA_BLOCK_SIZE);
+
+    // The first item fills the cache while its arena is current
+    baton_error_t error1;
+    arena_t *previous = set_thread_arena(&arena);
+    json_t *results1 = list_path(conn, &rods_obj_path, flags, &error1);
+    set_thread_arena(previous);
+    ck_assert_int_eq(error1.code, 0);
+
+    json_t *expected = json_deep_copy(results1);
+
+    // Its output is written and the arena reset and reused
+    reset_arena(&arena);
+    ck_assert_ptr_ne(arena.blocks, NULL);
+    memset(arena.blocks->data, 0xff, arena.blocks->size);
+
+    // The second item is answered from the cache
+    baton_error_t error2;
+    previous = set_thread_arena(&arena);
+    json_t *results2 = list_path(conn, &rods_obj_path, flags, &error2);
+    set_thread_arena(previous);
+    ck_assert_int_eq(error2.code, 0);
+    ck_assert_int_eq(json_equal(expected, results2), 1);
+
+    free_arena(&arena);
+    json_decref(expected);
+    clear_resource_cache();
+
+    if (conn) rcDisconnect(conn);
+}
+END_TEST
+
 // Can we list a collection?
 START_TEST(test_list_coll) {
     const option_flags flags = 0;
@@ -559,6 +1242,68 @@ START_TEST(test_list_coll) {
 }
 END_TEST
 
+// Can we list several data objects in a collection together?
+START_TEST(test_list_data_objects) {
+    const option_flags flags = PRINT_SIZE | PRINT_CHECKSUM;
+    rodsEnv env;
+    rcComm_t *conn = rods_login(&env);
+
+    char rods_root[MAX_PATH_LEN];
+    set_current_rods_root(TEST_COLL, rods_root);
+
+    rodsPath_t rods_path;
+    baton_error_t resolve_error;
+    ck_assert_int_eq(resolve_rods_path(conn, &env, &rods_path, rods_root,
+                                       0, &resolve_error), EXIST_ST);
+
+    const char *data_names[] = { "f1.txt", "f2.txt", "no_such.txt" };
+    json_t *results[3];
+    baton_error_t error;
+    ck_assert_int_eq(list_data_objects(conn, rods_path.outPath, data_names,
+                                       3, flags, results, &error), 0);
+    ck_assert_int_eq(error.code, 0);
+
+    // Each result is the same as listing its data object alone
+    for (size_t i = 0; i < 2; i++) {
+        char obj_path[MAX_PATH_LEN];
+        snprintf(obj_path, MAX_PATH_LEN, "%s/%s", rods_path.outPath,
+                 data_names[i]);
+
+        rodsPath_t rods_obj_path;
+        baton_error_t resolve_obj_error;
+        ck_assert_int_eq(resolve_rods_path(conn, &env, &rods_obj_path,
+                                           obj_path, 0, &resolve_obj_error),
+                         EXIST_ST);
+
+        baton_error_t list_error;
+        json_t *expected = list_path(conn, &rods_obj_path, flags,
+                                     &list_error);
+        ck_assert_int_eq(list_error.code, 0);
+        ck_assert_ptr_ne(results[i], NULL);
+        ck_assert_int_eq(json_equal(results[i], expected), 1);
+
+        json_decref(expected);
+        json_decref(results[i]);
+    }
+
+    // A missing data object is left to be listed alone
+    ck_assert_ptr_eq(results[2], NULL);
+
+    // With metadata
+    ck_assert_int_eq(list_data_objects(conn, rods_path.outPath, data_names,
+                                       2, flags | PRINT_AVU, results,
+                                       &error), 0);
+    ck_assert_int_eq(error.code, 0);
+    for (size_t i = 0; i < 2; i++) {
+        ck_assert_ptr_ne(results[i], NULL);
+        ck_assert(json_is_array(json_object_get(results[i], JSON_AVUS_KEY)));
+        json_decref(results[i]);
+    }
+
+    if (conn) rcDisconnect(conn);
+}
+END_TEST
+
 // Can we list a collection's contents?
 START_TEST(test_list_coll_contents) {
     const option_flags flags = 0;
@@ -977,8 +1722,270 @@ START_TEST(test_list_timestamps_obj) {
 }
 END_TEST
 
-START_TEST(test_list_timestamps_coll) {
-    const option_flags flags = 0;
+START_TEST(test_list_timestamps_coll) {
+    const option_flags flags = 0;
+    rodsEnv env;
+    rcComm_t *conn = rods_login(&env);
+
+    char rods_root[MAX_PATH_LEN];
+    set_current_rods_root(TEST_COLL, rods_root);
+
+    rodsPath_t rods_path;
+    baton_error_t resolve_error;
+    ck_assert_int_eq(resolve_rods_path(conn, &env, &rods_path, rods_root,
+                                       flags, &resolve_error), EXIST_ST);
+
+    baton_error_t error;
+    json_t *timestamps = list_timestamps(conn, &rods_path, &error);
+
+    ck_assert_int_eq(error.code, 0);
+    ck_assert(json_is_array(timestamps));
+    ck_assert_int_eq(json_array_size(timestamps), 1);
+
+    // These are raw timestamps where both created and modified times
+    // are present iRODS query results. Unlike data object timestamps,
+    // there is no replicate number.
+    size_t index;
+    json_t *timestamp;
+    json_array_foreach(timestamps, index, timestamp) {
+        ck_assert(json_is_object(timestamp));
+        ck_assert_int_eq(json_object_size(timestamp), 2);
+        ck_assert(json_object_get(timestamp, JSON_CREATED_KEY));
+        ck_assert(json_object_get(timestamp, JSON_MODIFIED_KEY));
+    }
+
+    json_decref(timestamps);
+
+    if (conn) rcDisconnect(conn);
+}
+END_TEST
+
+// Can we search for data objects by their metadata?
+START_TEST(test_search_metadata_obj) {
+    option_flags flags = 0;
+    rodsEnv env;
+    rcComm_t *conn = rods_login(&env);
+
+    char rods_root[MAX_PATH_LEN];
+    set_current_rods_root(TEST_COLL, rods_root);
+
+    rodsPath_t rods_path;
+    baton_error_t resolve_error;
+    ck_assert_int_eq(resolve_rods_path(conn, &env, &rods_path, rods_root,
+                                       flags, &resolve_error), EXIST_ST);
+
+    json_t *avu = json_pack("{s:s, s:s}",
+                            JSON_ATTRIBUTE_KEY, "attr1",
+                            JSON_VALUE_KEY,     "value1");
+    json_t *query = json_pack("{s:s, s:[o]}",
+                              JSON_COLLECTION_KEY, rods_path.outPath,
+                              JSON_AVUS_KEY,       avu);
+    flags = SEARCH_COLLECTIONS | SEARCH_OBJECTS;
+
+    baton_error_t expected_error1;
+    search_metadata(conn, NULL, NULL, flags | PRINT_AVU, &expected_error1);
+    ck_assert_int_ne(expected_error1.code, 0);
+
+    baton_error_t expected_error2;
+    search_metadata(conn, json_pack("[]"), NULL, flags | PRINT_AVU,
+                    &expected_error2);
+    ck_assert_int_ne(expected_error2.code, 0);
+
+    baton_error_t error;
+    json_t *results = search_metadata(conn, query, NULL, flags | PRINT_AVU,
+                                      &error);
+    ck_assert_int_eq(json_array_size(results), 12);
+
+    for (size_t i = 0; i < 12; i++) {
+        const json_t *obj = json_array_get(results, i);
+        ck_assert_ptr_ne(json_object_get(obj, JSON_COLLECTION_KEY), NULL);
+        ck_assert_ptr_ne(json_object_get(obj, JSON_DATA_OBJECT_KEY), NULL);
+    }
+    ck_assert_int_eq(error.code, 0);
+
+    json_decref(query);
+    json_decref(results);
+
+    if (conn) rcDisconnect(conn);
+}
+END_TEST
+
+typedef struct row_count {
+    size_t num_pages;
+    size_t num_rows;
+    size_t num_with_avus;
+} row_count_t;
+
+static int count_rows(json_t *rows, void *data, baton_error_t *error) {
+    row_count_t *count = data;
+
+    init_baton_error(error);
+
+    count->num_pages++;
+    count->num_rows += json_array_size(rows);
+
+    size_t i;
+    json_t *row;
+    json_array_foreach(rows, i, row) {
+        if (json_object_get(row, JSON_AVUS_KEY)) count->num_with_avus++;
+    }
+
+    return error->code;
+}
+
+static int refuse_rows(json_t *rows, void *data, baton_error_t *error) {
+    data = data; // Silence unused parameter warning
+    set_baton_error(error, -1, "Refused %zu rows", json_array_size(rows));
+
+    return error->code;
+}
+
+// Can we visit the results of a metadata search page by page?
+START_TEST(test_visit_metadata) {
+    option_flags flags = 0;
+    rodsEnv env;
+    rcComm_t *conn = rods_login(&env);
+
+    char rods_root[MAX_PATH_LEN];
+    set_current_rods_root(TEST_COLL, rods_root);
+
+    rodsPath_t rods_path;
+    baton_error_t resolve_error;
+    ck_assert_int_eq(resolve_rods_path(conn, &env, &rods_path, rods_root,
+                                       flags, &resolve_error), EXIST_ST);
+
+    json_t *avu = json_pack("{s:s, s:s}",
+                            JSON_ATTRIBUTE_KEY, "attr1",
+                            JSON_VALUE_KEY,     "value1");
+    json_t *query = json_pack("{s:s, s:[o]}",
+                              JSON_COLLECTION_KEY, rods_path.outPath,
+                              JSON_AVUS_KEY,       avu);
+    flags = SEARCH_COLLECTIONS | SEARCH_OBJECTS | PRINT_AVU;
+
+    set_query_page_size(5, 0);
+
+    row_count_t count = { 0, 0, 0 };
+    baton_error_t error;
+    ck_assert_int_eq(visit_metadata(conn, query, NULL, flags, count_rows,
+                                    &count, &error), 0);
+    ck_assert_int_eq(error.code, 0);
+    ck_assert_int_eq(count.num_rows, 12);
+    ck_assert_int_ge(count.num_pages, 3);
+    ck_assert_int_eq(count.num_with_avus, 12);
+
+    // A visitor error stops the search
+    baton_error_t expected_error;
+    visit_metadata(conn, query, NULL, flags, refuse_rows, NULL,
+                   &expected_error);
+    ck_assert_int_eq(expected_error.code, -1);
+
+    set_query_page_size(0, 0);
+
+    json_decref(query);
+
+    if (conn) rcDisconnect(conn);
+}
+END_TEST
+
+// Does a streamed metaquery operation pass its rows to the visitor
+// given, rather than returning them?
+START_TEST(test_stream_metaquery_op) {
+    option_flags flags = 0;
+    rodsEnv env;
+    rcComm_t *conn = rods_login(&env);
+
+    char rods_root[MAX_PATH_LEN];
+    set_current_rods_root(TEST_COLL, rods_root);
+
+    rodsPath_t rods_path;
+    baton_error_t resolve_error;
+    ck_assert_int_eq(resolve_rods_path(conn, &env, &rods_path, rods_root,
+                                       flags, &resolve_error), EXIST_ST);
+
+    json_t *avu = json_pack("{s:s, s:s}",
+                            JSON_ATTRIBUTE_KEY, "attr1",
+                            JSON_VALUE_KEY,     "value1");
+    json_t *query = json_pack("{s:s, s:[o]}",
+                              JSON_COLLECTION_KEY, rods_path.outPath,
+                              JSON_AVUS_KEY,       avu);
+
+    row_count_t count = { 0, 0, 0 };
+    operation_args_t args = { .flags = SEARCH_COLLECTIONS | SEARCH_OBJECTS |
+                                       STREAM_RESULTS,
+                              .max_connect_time = 10,
+                              .stream_rows      = count_rows,
+                              .stream_data      = &count };
+
+    baton_error_t error;
+    json_t *result = baton_json_metaquery_op(&env, conn, query, &args,
+                                             &error);
+    ck_assert_int_eq(error.code, 0);
+    ck_assert_ptr_eq(result, NULL);
+    ck_assert_int_eq(count.num_rows, 12);
+
+    json_decref(query);
+
+    if (conn) rcDisconnect(conn);
+}
+END_TEST
+
+// Can we limit the number of results of a metadata search?
+START_TEST(test_search_metadata_limit) {
+    option_flags flags = 0;
+    rodsEnv env;
+    rcComm_t *conn = rods_login(&env);
+
+    char rods_root[MAX_PATH_LEN];
+    set_current_rods_root(TEST_COLL, rods_root);
+
+    rodsPath_t rods_path;
+    baton_error_t resolve_error;
+    ck_assert_int_eq(resolve_rods_path(conn, &env, &rods_path, rods_root,
+                                       flags, &resolve_error), EXIST_ST);
+    flags = SEARCH_COLLECTIONS | SEARCH_OBJECTS;
+
+    // Limits within a page, across pages and beyond the results
+    set_query_page_size(2, 0);
+
+    const size_t limits[] = { 1, 5, 100 };
+    const size_t expected[] = { 1, 5, 12 };
+    for (size_t i = 0; i < 3; i++) {
+        json_t *query = json_pack("{s:s, s:[{s:s, s:s}], s:i}",
+                                  JSON_COLLECTION_KEY, rods_path.outPath,
+                                  JSON_AVUS_KEY,
+                                  JSON_ATTRIBUTE_KEY,  "attr1",
+                                  JSON_VALUE_KEY,      "value1",
+                                  JSON_LIMIT_KEY,      (int) limits[i]);
+
+        baton_error_t error;
+        json_t *results = search_metadata(conn, query, NULL, flags, &error);
+        ck_assert_int_eq(error.code, 0);
+        ck_assert_int_eq(json_array_size(results), expected[i]);
+
+        json_decref(query);
+        json_decref(results);
+    }
+
+    set_query_page_size(0, 0);
+
+    json_t *query = json_pack("{s:s, s:[{s:s, s:s}], s:i}",
+                              JSON_COLLECTION_KEY, rods_path.outPath,
+                              JSON_AVUS_KEY,
+                              JSON_ATTRIBUTE_KEY,  "attr1",
+                              JSON_VALUE_KEY,      "value1",
+                              JSON_LIMIT_KEY,      0);
+    baton_error_t expected_error;
+    search_metadata(conn, query, NULL, flags, &expected_error);
+    ck_assert_int_eq(expected_error.code, CAT_INVALID_ARGUMENT);
+    json_decref(query);
+
+    if (conn) rcDisconnect(conn);
+}
+END_TEST
+
+// Can we count the results of a metadata search on the server?
+START_TEST(test_search_metadata_aggregate) {
+    option_flags flags = 0;
     rodsEnv env;
     rcComm_t *conn = rods_login(&env);
 
@@ -990,33 +1997,104 @@ START_TEST(test_list_timestamps_coll) {
     ck_assert_int_eq(resolve_rods_path(conn, &env, &rods_path, rods_root,
                                        flags, &resolve_error), EXIST_ST);
 
+    json_t *avu = json_pack("{s:s, s:s}",
+                            JSON_ATTRIBUTE_KEY, "attr1",
+                            JSON_VALUE_KEY,     "value1");
+    json_t *query = json_pack("{s:s, s:[o]}",
+                              JSON_COLLECTION_KEY, rods_path.outPath,
+                              JSON_AVUS_KEY,       avu);
+    flags = SEARCH_COLLECTIONS | SEARCH_OBJECTS | AGGREGATE_RESULTS;
+
     baton_error_t error;
-    json_t *timestamps = list_timestamps(conn, &rods_path, &error);
+    json_t *results = search_metadata(conn, query, NULL, flags, &error);
+    ck_assert_int_eq(error.code, 0);
+    ck_assert_int_eq(json_array_size(results), 1);
 
+    const json_t *aggregate = json_array_get(results, 0);
+    ck_assert_int_eq(json_integer_value(json_object_get(aggregate,
+                                                        JSON_COUNT_KEY)), 12);
+
+    const json_int_t total = json_integer_value
+        (json_object_get(aggregate, JSON_TOTAL_SIZE_KEY));
+    const json_int_t min = json_integer_value
+        (json_object_get(aggregate, JSON_MIN_SIZE_KEY));
+    const json_int_t max = json_integer_value
+        (json_object_get(aggregate, JSON_MAX_SIZE_KEY));
+    ck_assert(min <= max);
+    ck_assert(max <= total);
+
+    json_decref(results);
+
+    // Each data object is counted and sized once, whatever its number
+    // of replicates, as when the items themselves are listed
+    flags = SEARCH_OBJECTS | AGGREGATE_RESULTS;
+    results = search_metadata(conn, query, NULL, flags, &error);
     ck_assert_int_eq(error.code, 0);
-    ck_assert(json_is_array(timestamps));
-    ck_assert_int_eq(json_array_size(timestamps), 1);
+    aggregate = json_array_get(results, 0);
 
-    // These are raw timestamps where both created and modified times
-    // are present iRODS query results. Unlike data object timestamps,
-    // there is no replicate number.
+    json_t *items = search_metadata(conn, query, NULL,
+                                    SEARCH_OBJECTS | PRINT_SIZE, &error);
+    ck_assert_int_eq(error.code, 0);
+
+    json_int_t items_total = 0;
     size_t index;
-    json_t *timestamp;
-    json_array_foreach(timestamps, index, timestamp) {
-        ck_assert(json_is_object(timestamp));
-        ck_assert_int_eq(json_object_size(timestamp), 2);
-        ck_assert(json_object_get(timestamp, JSON_CREATED_KEY));
-        ck_assert(json_object_get(timestamp, JSON_MODIFIED_KEY));
+    json_t *item;
+    json_array_foreach(items, index, item) {
+        const char *size =
+            json_string_value(json_object_get(item, JSON_SIZE_KEY));
+        ck_assert_ptr_ne(size, NULL);
+        items_total += strtoll(size, NULL, 10);
     }
 
-    json_decref(timestamps);
+    ck_assert_int_eq(json_integer_value(json_object_get(aggregate,
+                                                        JSON_COUNT_KEY)),
+                     json_array_size(items));
+    ck_assert_int_eq(json_integer_value(json_object_get(aggregate,
+                                                        JSON_TOTAL_SIZE_KEY)),
+                     items_total);
+
+    json_decref(results);
+
+    // The server aggregates over the first replicate of each data
+    // object. Each of these has one matching AVU and a first
+    // replicate, so the results are the same.
+    results = search_metadata(conn, query, NULL, flags | SERVER_AGGREGATE,
+                              &error);
+    ck_assert_int_eq(error.code, 0);
+    ck_assert_int_eq(json_array_size(results), 1);
+
+    json_t *server = json_array_get(results, 0);
+    ck_assert_int_eq(json_integer_value
+                     (json_object_get(server, JSON_MATCH_COUNT_KEY)),
+                     json_array_size(items));
+    ck_assert_int_eq(json_integer_value
+                     (json_object_get(server, JSON_MATCH_TOTAL_SIZE_KEY)),
+                     items_total);
+    ck_assert_ptr_eq(json_object_get(server, JSON_COUNT_KEY), NULL);
+
+    json_decref(items);
+    json_decref(results);
+
+    // Nothing matches, so only the count is reported
+    json_object_set_new(avu, JSON_VALUE_KEY, json_string("no_such_value"));
+    results = search_metadata(conn, query, NULL, flags, &error);
+    ck_assert_int_eq(error.code, 0);
+
+    aggregate = json_array_get(results, 0);
+    ck_assert_int_eq(json_integer_value(json_object_get(aggregate,
+                                                        JSON_COUNT_KEY)), 0);
+    ck_assert_ptr_eq(json_object_get(aggregate, JSON_TOTAL_SIZE_KEY), NULL);
+
+    json_decref(query);
+    json_decref(results);
 
     if (conn) rcDisconnect(conn);
 }
 END_TEST
 
-// Can we search for data objects by their metadata?
-START_TEST(test_search_metadata_obj) {
+// Does enriching an array of results in groups match enriching each
+// result alone?
+START_TEST(test_enrich_json_array) {
     option_flags flags = 0;
     rodsEnv env;
     rcComm_t *conn = rods_login(&env);
@@ -1037,29 +2115,38 @@ START_TEST(test_search_metadata_obj) {
                               JSON_AVUS_KEY,       avu);
     flags = SEARCH_COLLECTIONS | SEARCH_OBJECTS;
 
-    baton_error_t expected_error1;
-    search_metadata(conn, NULL, NULL, flags | PRINT_AVU, &expected_error1);
-    ck_assert_int_ne(expected_error1.code, 0);
-
-    baton_error_t expected_error2;
-    search_metadata(conn, json_pack("[]"), NULL, flags | PRINT_AVU,
-                    &expected_error2);
-    ck_assert_int_ne(expected_error2.code, 0);
-
     baton_error_t error;
-    json_t *results = search_metadata(conn, query, NULL, flags | PRINT_AVU,
-                                      &error);
+    json_t *results = search_metadata(conn, query, NULL, flags, &error);
+    ck_assert_int_eq(error.code, 0);
     ck_assert_int_eq(json_array_size(results), 12);
 
-    for (size_t i = 0; i < 12; i++) {
-        const json_t *obj = json_array_get(results, i);
-        ck_assert_ptr_ne(json_object_get(obj, JSON_COLLECTION_KEY), NULL);
-        ck_assert_ptr_ne(json_object_get(obj, JSON_DATA_OBJECT_KEY), NULL);
+    json_t *expected = json_deep_copy(results);
+
+    size_t i;
+    json_t *item;
+    json_array_foreach(expected, i, item) {
+        ck_assert_ptr_ne(add_avus_json_object(conn, item, &error), NULL);
+        ck_assert_ptr_ne(add_acl_json_object(conn, item, &error), NULL);
+
+        if (represents_data_object(item)) {
+            ck_assert_ptr_ne(add_checksum_json_object(conn, item, &error),
+                             NULL);
+            ck_assert_ptr_ne(add_tps_json_object(conn, item, &error), NULL);
+            ck_assert_ptr_ne(add_repl_json_object(conn, item, &error), NULL);
+        }
     }
-    ck_assert_int_eq(error.code, 0);
+
+    ck_assert_ptr_ne(add_avus_json_array(conn, results, &error), NULL);
+    ck_assert_ptr_ne(add_acl_json_array(conn, results, &error), NULL);
+    ck_assert_ptr_ne(add_checksum_json_array(conn, results, &error), NULL);
+    ck_assert_ptr_ne(add_tps_json_array(conn, results, &error), NULL);
+    ck_assert_ptr_ne(add_repl_json_array(conn, results, &error), NULL);
+
+    ck_assert(json_equal(results, expected));
 
     json_decref(query);
     json_decref(results);
+    json_decref(expected);
 
     if (conn) rcDisconnect(conn);
 }
@@ -2390,6 +3477,105 @@ START_TEST(test_remove_coll) {
 }
 END_TEST
 
+// Redirect stdout to a file, returning a descriptor of the original
+static int redirect_stdout(FILE *file) {
+    fflush(stdout);
+    const int saved = dup(STDOUT_FILENO);
+    ck_assert_int_ge(saved, 0);
+    ck_assert_int_ge(dup2(fileno(file), STDOUT_FILENO), 0);
+
+    return saved;
+}
+
+// Restore stdout redirected by redirect_stdout
+static void restore_stdout(const int saved) {
+    fflush(stdout);
+    ck_assert_int_ge(dup2(saved, STDOUT_FILENO), 0);
+    close(saved);
+}
+
+// Return the content of a file as a null-terminated string, setting
+// its length
+static char *slurp_file(FILE *file, size_t *length) {
+    ck_assert_int_eq(fseek(file, 0, SEEK_END), 0);
+    const long size = ftell(file);
+    ck_assert_int_ge(size, 0);
+    rewind(file);
+
+    char *content = calloc(size + 1, sizeof (char));
+    ck_assert_ptr_ne(content, NULL);
+    ck_assert_int_eq(fread(content, 1, size, file), size);
+    *length = size;
+
+    return content;
+}
+
+// Run an operation over a stream of JSON documents, in num_shards
+// worker processes if num_shards > 0, returning its exit status and
+// setting outputs to an array of the documents it printed
+static int capture_do_operation(FILE *input, operation_args_t *args,
+                                const unsigned num_shards,
+                                json_t **outputs) {
+    FILE *out_tmp = tmpfile();
+    ck_assert_ptr_ne(out_tmp, NULL);
+
+    rewind(input);
+    const int saved = redirect_stdout(out_tmp);
+    const int status = num_shards > 0 ?
+        do_sharded_operation(input, baton_json_dispatch_op, args,
+                             num_shards) :
+        do_operation(input, baton_json_dispatch_op, args);
+    restore_stdout(saved);
+
+    *outputs = json_array();
+    rewind(out_tmp);
+    while (!feof(out_tmp)) {
+        json_error_t load_error;
+        json_t *output = json_loadf(out_tmp, JSON_DISABLE_EOF_CHECK,
+                                    &load_error);
+        if (!output) {
+            ck_assert(feof(out_tmp));
+            break;
+        }
+        json_array_append_new(*outputs, output);
+    }
+    fclose(out_tmp);
+
+    return status;
+}
+
+// Return the name of the data object targeted by an output document
+static const char *output_data_object(const json_t *output) {
+    const json_t *target = json_object_get(output, JSON_TARGET_KEY);
+    return json_string_value(json_object_get(target, JSON_DATA_OBJECT_KEY));
+}
+
+// Assert that each of num_items outputs carries the position of its
+// input document as its ID, once, and return the positions in output
+// order
+static void assert_output_ids(const json_t *outputs, const size_t num_items,
+                              size_t positions[]) {
+    ck_assert_int_eq(json_array_size(outputs), num_items);
+
+    int *seen = calloc(num_items, sizeof (int));
+    ck_assert_ptr_ne(seen, NULL);
+
+    size_t i;
+    json_t *output;
+    json_array_foreach(outputs, i, output) {
+        const json_t *id = json_object_get(output, JSON_ID_KEY);
+        ck_assert(json_is_integer(id));
+
+        const json_int_t position = json_integer_value(id);
+        ck_assert(position >= 0 && (size_t) position < num_items);
+        ck_assert(!seen[position]);
+        seen[position] = 1;
+        positions[i] = position;
+    }
+
+    free(seen);
+}
+
 // Can we do a sequence of baton operations described by a JSON
 // stream?
 START_TEST(test_do_operation) {
@@ -2469,6 +3655,400 @@ START_TEST(test_do_operation) {
 }
 END_TEST
 
+// Tests that items can be processed concurrently on several connections
+START_TEST(test_do_operation_threads) {
+    rodsEnv env;
+    rcComm_t *conn = rods_login(&env);
+
+    char rods_root[MAX_PATH_LEN];
+    set_current_rods_root(TEST_COLL, rods_root);
+
+    FILE *json_tmp = tmpfile();
+    const int num_items = 100;
+
+    for (int i = 0; i < num_items; i++) {
+        json_t *obj = json_pack("{s:s, s:s}",
+                                JSON_COLLECTION_KEY,  rods_root,
+                                JSON_DATA_OBJECT_KEY, i % 2 ? "f1.txt" : "f2.txt");
+        json_t *envelope = json_pack("{s:s, s:o}",
+                                     JSON_OP_KEY,     JSON_LIST_OP,
+                                     JSON_TARGET_KEY, obj);
+        json_dumpf(envelope, json_tmp, 0);
+        json_decref(envelope);
+    }
+
+    operation_args_t args = { .flags            = 0,
+                              .buffer_size      = 1024,
+                              .zone_name        = NULL,
+                              .max_connect_time = 10,
+                              .num_threads      = 4 };
+
+    // Results are printed in input order
+    json_t *outputs;
+    ck_assert_int_eq(capture_do_operation(json_tmp, &args, 0, &outputs), 0);
+    ck_assert_int_eq(json_array_size(outputs), num_items);
+
+    size_t i;
+    json_t *output;
+    json_array_foreach(outputs, i, output) {
+        ck_assert_str_eq(output_data_object(output),
+                         i % 2 ? "f1.txt" : "f2.txt");
+    }
+    json_decref(outputs);
+
+    // Unordered results each carry the position of their input
+    args.flags = UNORDERED;
+    ck_assert_int_eq(capture_do_operation(json_tmp, &args, 0, &outputs), 0);
+
+    size_t positions[num_items];
+    assert_output_ids(outputs, num_items, positions);
+    json_array_foreach(outputs, i, output) {
+        ck_assert_str_eq(output_data_object(output),
+                         positions[i] % 2 ? "f1.txt" : "f2.txt");
+    }
+    json_decref(outputs);
+    args.flags = 0;
+
+    // Add JSON for a non-existent file; should fail
+    json_t *incorrect_obj = json_pack("{s:s, s:s}",
+                                      JSON_COLLECTION_KEY,  rods_root,
+                                      JSON_DATA_OBJECT_KEY, "INVALID");
+    json_t *incorrect_envelope = json_pack("{s:s, s:o}",
+                                           JSON_OP_KEY,     JSON_LIST_OP,
+                                           JSON_TARGET_KEY, incorrect_obj);
+    json_dumpf(incorrect_envelope, json_tmp, 0);
+    json_decref(incorrect_envelope);
+
+    rewind(json_tmp);
+    const int fail_status = do_operation(json_tmp, baton_json_dispatch_op,
+                                         &args);
+    ck_assert_int_ne(fail_status, 0);
+
+    fclose(json_tmp);
+
+    if (conn) rcDisconnect(conn);
+}
+END_TEST
+
+// Can we process a stream of JSON documents with a limit on the
+// threads used for data transfers?
+START_TEST(test_do_operation_bulk_threads) {
+    rodsEnv env;
+    rcComm_t *conn = rods_login(&env);
+
+    char rods_root[MAX_PATH_LEN];
+    set_current_rods_root(TEST_COLL, rods_root);
+
+    FILE *json_tmp = tmpfile();
+    const int num_items = 100;
+
+    for (int i = 0; i < num_items; i++) {
+        json_t *obj = json_pack("{s:s, s:s}",
+                                JSON_COLLECTION_KEY,  rods_root,
+                                JSON_DATA_OBJECT_KEY, "f1.txt");
+        json_t *envelope = json_pack("{s:s, s:o}",
+                                     JSON_OP_KEY,
+                                     i % 4 ? JSON_LIST_OP : JSON_GET_OP,
+                                     JSON_TARGET_KEY, obj);
+        json_dumpf(envelope, json_tmp, 0);
+        json_decref(envelope);
+    }
+
+    // Ordered and unordered output
+    const option_flags flags[] = { 0, UNORDERED };
+    for (size_t i = 0; i < 2; i++) {
+        operation_args_t args = { .flags            = flags[i],
+                                  .buffer_size      = 1024,
+                                  .zone_name        = NULL,
+                                  .max_connect_time = 10,
+                                  .num_threads      = 4,
+                                  .bulk_threads     = 1 };
+
+        json_t *outputs;
+        ck_assert_int_eq(capture_do_operation(json_tmp, &args, 0, &outputs),
+                         0);
+
+        // Every output arrives, whichever lane its item took
+        size_t positions[num_items];
+        if (flags[i] & UNORDERED) {
+            assert_output_ids(outputs, num_items, positions);
+        }
+        else {
+            ck_assert_int_eq(json_array_size(outputs), num_items);
+            for (int j = 0; j < num_items; j++) positions[j] = j;
+        }
+
+        size_t j;
+        json_t *output;
+        json_array_foreach(outputs, j, output) {
+            ck_assert_str_eq(json_string_value(json_object_get(output,
+                                                               JSON_OP_KEY)),
+                             positions[j] % 4 ? JSON_LIST_OP : JSON_GET_OP);
+            ck_assert_ptr_ne(json_object_get(output, JSON_RESULT_KEY), NULL);
+        }
+        json_decref(outputs);
+    }
+
+    fclose(json_tmp);
+
+    if (conn) rcDisconnect(conn);
+}
+END_TEST
+
+// Is the raw data of a get written in turn with the JSON output of
+// the other items?
+START_TEST(test_do_operation_raw_order) {
+    rodsEnv env;
+    rcComm_t *conn = rods_login(&env);
+
+    char rods_root[MAX_PATH_LEN];
+    set_current_rods_root(TEST_COLL, rods_root);
+
+    FILE *local = fopen("data/lorem_1k.txt", "r");
+    ck_assert_ptr_ne(local, NULL);
+    size_t data_len;
+    char *data = slurp_file(local, &data_len);
+    fclose(local);
+
+    // Repeats of: list, raw get, list
+    FILE *json_tmp = tmpfile();
+    const int num_repeats = 8;
+
+    for (int i = 0; i < num_repeats; i++) {
+        json_t *list1 = json_pack("{s:s, s:{s:s, s:s}}",
+                                  JSON_OP_KEY,     JSON_LIST_OP,
+                                  JSON_TARGET_KEY,
+                                  JSON_COLLECTION_KEY,  rods_root,
+                                  JSON_DATA_OBJECT_KEY, "f1.txt");
+        json_t *get = json_pack("{s:s, s:{s:b}, s:{s:s, s:s}}",
+                                JSON_OP_KEY,      JSON_GET_OP,
+                                JSON_OP_ARGS_KEY, JSON_OP_RAW, 1,
+                                JSON_TARGET_KEY,
+                                JSON_COLLECTION_KEY,  rods_root,
+                                JSON_DATA_OBJECT_KEY, "lorem_1k.txt");
+        json_t *list2 = json_pack("{s:s, s:{s:s, s:s}}",
+                                  JSON_OP_KEY,     JSON_LIST_OP,
+                                  JSON_TARGET_KEY,
+                                  JSON_COLLECTION_KEY,  rods_root,
+                                  JSON_DATA_OBJECT_KEY, "f2.txt");
+        json_dumpf(list1, json_tmp, 0);
+        json_dumpf(get,   json_tmp, 0);
+        json_dumpf(list2, json_tmp, 0);
+        json_decref(list1);
+        json_decref(get);
+        json_decref(list2);
+    }
+
+    const unsigned num_threads[] = { 1, 4 };
+    for (size_t i = 0; i < 2; i++) {
+        operation_args_t args = { .flags            = 0,
+                                  .buffer_size      = 1024,
+                                  .zone_name        = NULL,
+                                  .max_connect_time = 10,
+                                  .num_threads      = num_threads[i] };
+
+        FILE *out_tmp = tmpfile();
+        rewind(json_tmp);
+        const int saved = redirect_stdout(out_tmp);
+        const int status = do_operation(json_tmp, baton_json_dispatch_op,
+                                        &args);
+        restore_stdout(saved);
+        ck_assert_int_eq(status, 0);
+
+        size_t out_len;
+        char *out = slurp_file(out_tmp, &out_len);
+        fclose(out_tmp);
+
+        // Each get's data follows the output of the list before it and
+        // precedes the get's own output
+        const char *expected[] = { "f1.txt", NULL, "lorem_1k.txt", "f2.txt" };
+        size_t pos = 0;
+        for (int j = 0; j < num_repeats; j++) {
+            for (int k = 0; k < 4; k++) {
+                if (!expected[k]) {
+                    ck_assert(pos + data_len <= out_len);
+                    ck_assert(memcmp(out + pos, data, data_len) == 0);
+                    pos += data_len;
+                    continue;
+                }
+
+                json_error_t load_error;
+                json_t *output = json_loadb(out + pos, out_len - pos,
+                                            JSON_DISABLE_EOF_CHECK,
+                                            &load_error);
+                ck_assert_ptr_ne(output, NULL);
+                pos += load_error.position;
+
+                const json_t *target = json_object_get(output,
+                                                       JSON_TARGET_KEY);
+                ck_assert_str_eq(json_string_value
+                                 (json_object_get(target,
+                                                  JSON_DATA_OBJECT_KEY)),
+                                 expected[k]);
+                json_decref(output);
+
+                // Skip the newline after the JSON
+                while (pos < out_len && out[pos] == '\n') pos++;
+            }
+        }
+        ck_assert_int_eq(pos, out_len);
+
+        free(out);
+    }
+
+    free(data);
+    fclose(json_tmp);
+
+    if (conn) rcDisconnect(conn);
+}
+END_TEST
+
+// Can we process a stream of JSON documents in worker processes?
+START_TEST(test_do_sharded_operation) {
+    rodsEnv env;
+    rcComm_t *conn = rods_login(&env);
+
+    char rods_root[MAX_PATH_LEN];
+    set_current_rods_root(TEST_COLL, rods_root);
+
+    FILE *json_tmp = tmpfile();
+    const int num_items = 100;
+
+    for (int i = 0; i < num_items; i++) {
+        json_t *obj = json_pack("{s:s, s:s}",
+                                JSON_COLLECTION_KEY,  rods_root,
+                                JSON_DATA_OBJECT_KEY, i % 2 ? "f1.txt" : "f2.txt");
+        json_t *envelope = json_pack("{s:s, s:o}",
+                                     JSON_OP_KEY,     JSON_LIST_OP,
+                                     JSON_TARGET_KEY, obj);
+        json_dumpf(envelope, json_tmp, 0);
+        json_decref(envelope);
+    }
+
+    operation_args_t args = { .flags            = 0,
+                              .buffer_size      = 1024,
+                              .zone_name        = NULL,
+                              .max_connect_time = 10,
+                              .num_threads      = 2 };
+
+    rewind(json_tmp);
+    ck_assert_int_ne(do_sharded_operation(json_tmp, baton_json_dispatch_op,
+                                          &args, MAX_NUM_SHARDS + 1), 0);
+
+    // Results are merged as they complete, each carrying the position
+    // of its input
+    json_t *outputs;
+    ck_assert_int_eq(capture_do_operation(json_tmp, &args, 3, &outputs), 0);
+
+    size_t positions[num_items];
+    assert_output_ids(outputs, num_items, positions);
+
+    size_t i;
+    json_t *output;
+    json_array_foreach(outputs, i, output) {
+        ck_assert_str_eq(output_data_object(output),
+                         positions[i] % 2 ? "f1.txt" : "f2.txt");
+    }
+    json_decref(outputs);
+
+    // Raw output cannot be merged
+    args.flags = PRINT_RAW;
+    rewind(json_tmp);
+    ck_assert_int_ne(do_sharded_operation(json_tmp, baton_json_dispatch_op,
+                                          &args, 3), 0);
+    args.flags = 0;
+
+    // Add JSON for a non-existent file; should fail
+    json_t *incorrect_obj = json_pack("{s:s, s:s}",
+                                      JSON_COLLECTION_KEY,  rods_root,
+                                      JSON_DATA_OBJECT_KEY, "INVALID");
+    json_t *incorrect_envelope = json_pack("{s:s, s:o}",
+                                           JSON_OP_KEY,     JSON_LIST_OP,
+                                           JSON_TARGET_KEY, incorrect_obj);
+    json_dumpf(incorrect_envelope, json_tmp, 0);
+    json_decref(incorrect_envelope);
+
+    rewind(json_tmp);
+    const int fail_status = do_sharded_operation(json_tmp,
+                                                 baton_json_dispatch_op,
+                                                 &args, 3);
+    ck_assert_int_ne(fail_status, 0);
+
+    fclose(json_tmp);
+
+    if (conn) rcDisconnect(conn);
+}
+END_TEST
+
+// Can we dispatch an operation on an array of targets?
+START_TEST(test_dispatch_op_targets) {
+    rodsEnv env;
+    rcComm_t *conn = rods_login(&env);
+
+    char rods_root[MAX_PATH_LEN];
+    set_current_rods_root(TEST_COLL, rods_root);
+
+    json_t *envelope =
+        json_pack("{s:s, s:[{s:s, s:s}, {s:s}, {s:s, s:s}]}",
+                  JSON_OP_KEY,      JSON_LIST_OP,
+                  JSON_TARGETS_KEY,
+                  JSON_COLLECTION_KEY,  rods_root,
+                  JSON_DATA_OBJECT_KEY, "f2.txt",
+                  JSON_COLLECTION_KEY,  rods_root,
+                  JSON_COLLECTION_KEY,  rods_root,
+                  JSON_DATA_OBJECT_KEY, "f1.txt");
+
+    operation_args_t args = { .flags            = 0,
+                              .buffer_size      = 1024,
+                              .zone_name        = NULL,
+                              .max_connect_time = 10 };
+
+    baton_error_t error;
+    json_t *results = baton_json_dispatch_op(&env, conn, envelope, &args,
+                                             &error);
+    ck_assert_int_eq(error.code, 0);
+    ck_assert(json_is_array(results));
+    ck_assert_int_eq(json_array_size(results), 3);
+
+    // Results are in target order
+    ck_assert_str_eq(json_string_value(json_object_get
+                                       (json_array_get(results, 0),
+                                        JSON_DATA_OBJECT_KEY)), "f2.txt");
+    ck_assert(represents_collection(json_array_get(results, 1)));
+    ck_assert_str_eq(json_string_value(json_object_get
+                                       (json_array_get(results, 2),
+                                        JSON_DATA_OBJECT_KEY)), "f1.txt");
+    json_decref(results);
+
+    // A target that fails is reported in place, without stopping the
+    // others
+    json_t *targets = json_object_get(envelope, JSON_TARGETS_KEY);
+    json_array_insert_new(targets, 1,
+                          json_pack("{s:s, s:s}",
+                                    JSON_COLLECTION_KEY,  rods_root,
+                                    JSON_DATA_OBJECT_KEY, "INVALID"));
+
+    results = baton_json_dispatch_op(&env, conn, envelope, &args, &error);
+    ck_assert_int_ne(error.code, 0);
+    ck_assert_int_eq(json_array_size(results), 4);
+    ck_assert_ptr_eq(json_object_get(json_array_get(results, 0),
+                                     JSON_ERROR_KEY), NULL);
+    ck_assert_ptr_ne(json_object_get(json_array_get(results, 1),
+                                     JSON_ERROR_KEY), NULL);
+    ck_assert_ptr_eq(json_object_get(json_array_get(results, 3),
+                                     JSON_ERROR_KEY), NULL);
+
+    // The input target is not modified
+    ck_assert_ptr_eq(json_object_get(json_array_get(targets, 1),
+                                     JSON_ERROR_KEY), NULL);
+
+    json_decref(results);
+    json_decref(envelope);
+
+    if (conn) rcDisconnect(conn);
+}
+END_TEST
+
 // Tests that the `irods_get_sql_for_specific_alias` method can be
 // used to get the SQL associated to a given alias.
 START_TEST(test_irods_get_sql_for_specific_alias_with_alias) {
@@ -2546,6 +4126,106 @@ START_TEST(test_make_query_format_from_sql_with_invalid_query) {
 }
 END_TEST
 
+// Tests that `prepare_specific_labels` returns the same labels for an
+// alias whether they are fetched from the server or from the cache.
+START_TEST(test_prepare_specific_labels_with_cached_alias) {
+    if (!have_rodsadmin()) {
+        logmsg(WARN, "!!! Skipping specific query tests because we are "
+               "not rodsadmin !!!");
+        return;
+    }
+    rodsEnv env;
+    rcComm_t *conn = rods_login(&env);
+    const char *alias = "dataModifiedIdOnly";
+
+    clear_specific_query_cache();
+
+    for (int i = 0; i < 2; i++) {
+        query_format_in_t *format = prepare_specific_labels(conn, alias);
+
+        ck_assert_ptr_ne(format, NULL);
+        ck_assert_int_eq(format->num_columns, 1);
+        ck_assert_str_eq(format->labels[0], "data_id");
+
+        free_specific_labels(format);
+    }
+
+    // Cached copies are independent of each other
+    query_format_in_t *format1 = prepare_specific_labels(conn, alias);
+    query_format_in_t *format2 = prepare_specific_labels(conn, alias);
+    ck_assert_ptr_ne(format1, NULL);
+    ck_assert_ptr_ne(format2, NULL);
+    ck_assert_ptr_ne(format1->labels[0], format2->labels[0]);
+    ck_assert_str_eq(format1->labels[0], format2->labels[0]);
+
+    free_specific_labels(format1);
+    free_specific_labels(format2);
+
+    // An unknown alias is not cached
+    ck_assert_ptr_eq(prepare_specific_labels(conn, "invalidAlias"), NULL);
+    ck_assert_ptr_eq(prepare_specific_labels(conn, "invalidAlias"), NULL);
+
+    clear_specific_query_cache();
+
+    if (conn) rcDisconnect(conn);
+}
+END_TEST
+
+// Does the specific query alias cache survive the reset of the arena
+// of the item that filled it, as when baton-do runs items with --arena?
+START_TEST(test_prepare_specific_labels_with_arena) {
+    if (!have_rodsadmin()) {
+        logmsg(WARN, "!!! Skipping specific query tests because we are "
+               "not rodsadmin !!!");
+        return;
+    }
+    // JSON created before the arena allocator is installed cannot be
+    // freed afterwards, so the allocator must not leak into other tests
+    const char *fork = getenv("CK_FORK");
+    if (fork && str_equals(fork, "no", 3)) {
+        logmsg(WARN, "!!! Skipping arena test because tests are not "
+               "running in separate processes !!!");
+        return;
+    }
+
+    rodsEnv env;
+    rcComm_t *conn = rods_login(&env);
+    const char *alias = "dataModifiedIdOnly";
+
+    clear_specific_query_cache();
+    install_arena_allocator();
+
+    arena_t arena;
+    init_arena(&arena, DEFAULT_ARENA_BLOCK_SIZE);
+
+    // The first item fills the cache while its arena is current
+    arena_t *previous = set_thread_arena(&arena);
+    query_format_in_t *format1 = prepare_specific_labels(conn, alias);
+    set_thread_arena(previous);
+    ck_assert_ptr_ne(format1, NULL);
+    free_specific_labels(format1);
+
+    // Its output is written and the arena reset and reused
+    reset_arena(&arena);
+    ck_assert_ptr_ne(arena.blocks, NULL);
+    memset(arena.blocks->data, 0xff, arena.blocks->size);
+
+    // The second item is answered from the cache
+    previous = set_thread_arena(&arena);
+    query_format_in_t *format2 = prepare_specific_labels(conn, alias);
+    set_thread_arena(previous);
+    ck_assert_ptr_ne(format2, NULL);
+    ck_assert_int_eq(format2->num_columns, 1);
+    ck_assert_str_eq(format2->labels[0], "data_id");
+    free_specific_labels(format2);
+
+    free_arena(&arena);
+    clear_specific_query_cache();
+
+    if (conn) rcDisconnect(conn);
+}
+END_TEST
+
 // Tests that the `search_specific` method can be used with a valid
 // setup.
 START_TEST(test_search_specific_with_valid_setup) {
@@ -2816,6 +4496,10 @@ START_TEST(test_regression_github_issue242) {
     ck_assert(json_object_get(result, JSON_CHECKSUM_KEY));
     ck_assert(json_equal(json_object_get(result, JSON_CHECKSUM_KEY),
                          json_string("d41d8cd98f00b204e9800998ecf8427e")));
+
+    // The checksum is added to a copy of the target
+    ck_assert_ptr_ne(result, target);
+    ck_assert_ptr_eq(json_object_get(target, JSON_CHECKSUM_KEY), NULL);
 }
 END_TEST
 
@@ -2910,12 +4594,25 @@ Suite *baton_suite(void) {
     tcase_add_test(utilities, test_parse_timestamp);
     tcase_add_test(utilities, test_parse_size);
     tcase_add_test(utilities, test_to_utf8);
+    tcase_add_test(utilities, test_add_correlation_id);
+    tcase_add_test(utilities, test_baton_json_prepare_op);
+    tcase_add_test(utilities, test_json_buffer);
+    tcase_add_test(utilities, test_concurrency_controller);
+    tcase_add_test(utilities, test_rate_limits);
+    tcase_add_test(utilities, test_retry_policy);
+    tcase_add_test(utilities, test_journal);
+    tcase_add_test(utilities, test_arena);
+    tcase_add_test(utilities, test_free_json_string);
+    tcase_add_test(utilities, test_query_page_size);
+    tcase_add_test(utilities, test_path_cache);
+    tcase_add_test(utilities, test_set_trusted_rods_path);
 
     TCase *basic = tcase_create("basic");
     tcase_add_unchecked_fixture(basic, setup, teardown);
     tcase_add_checked_fixture(basic, basic_setup, basic_teardown);
 
     tcase_add_test(basic, test_get_version);
+    tcase_add_test(basic, test_connection_pool);
     tcase_add_test(basic, test_rods_login);
     tcase_add_test(basic, test_is_irods_available);
     tcase_add_test(basic, test_init_rods_path);
@@ -2928,8 +4625,11 @@ Suite *baton_suite(void) {
 
     tcase_add_test(path, test_list_missing_path);
     tcase_add_test(path, test_list_obj);
+    tcase_add_test(path, test_list_obj_resource_cache);
+    tcase_add_test(path, test_list_obj_resource_cache_arena);
     tcase_add_test(path, test_list_coll);
     tcase_add_test(path, test_list_coll_contents);
+    tcase_add_test(path, test_list_data_objects);
     tcase_add_test(path, test_list_permissions_missing_path);
     tcase_add_test(path, test_list_permissions_obj);
     tcase_add_test(path, test_list_permissions_coll);
@@ -2952,6 +4652,11 @@ Suite *baton_suite(void) {
     tcase_add_test(metadata, test_add_json_metadata_obj);
     tcase_add_test(metadata, test_remove_json_metadata_obj);
     tcase_add_test(metadata, test_search_metadata_obj);
+    tcase_add_test(metadata, test_visit_metadata);
+    tcase_add_test(metadata, test_stream_metaquery_op);
+    tcase_add_test(metadata, test_search_metadata_limit);
+    tcase_add_test(metadata, test_search_metadata_aggregate);
+    tcase_add_test(metadata, test_enrich_json_array);
     tcase_add_test(metadata, test_search_metadata_coll);
     tcase_add_test(metadata, test_search_metadata_path_obj);
     tcase_add_test(metadata, test_search_metadata_perm_obj);
@@ -2984,6 +4689,11 @@ Suite *baton_suite(void) {
     tcase_add_test(json, test_json_to_path);
     tcase_add_test(json, test_json_to_local_path);
     tcase_add_test(json, test_do_operation);
+    tcase_add_test(json, test_do_operation_threads);
+    tcase_add_test(json, test_do_operation_bulk_threads);
+    tcase_add_test(json, test_do_operation_raw_order);
+    tcase_add_test(json, test_do_sharded_operation);
+    tcase_add_test(json, test_dispatch_op_targets);
 
     TCase *specific_query = tcase_create("specific_query");
     tcase_add_unchecked_fixture(specific_query, setup, teardown);
@@ -2999,6 +4709,10 @@ Suite *baton_suite(void) {
                    test_make_query_format_from_sql_with_select_query_using_column_alias);
     tcase_add_test(specific_query,
                    test_make_query_format_from_sql_with_invalid_query);
+    tcase_add_test(specific_query,
+                   test_prepare_specific_labels_with_cached_alias);
+    tcase_add_test(specific_query,
+                   test_prepare_specific_labels_with_arena);
     tcase_add_test(specific_query,
                    test_search_specific_with_valid_setup);
 